@@ -10,6 +10,9 @@
 #include "sources/Model.h"
 #include "sources/Light.h"
 #include "sources/Engine.h"
+#include "sources/ObjBenchmark.h"
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 
 const unsigned int SCR_WIDTH = 800;
@@ -27,8 +30,12 @@ bool Engine::show_another_window = false;
 ImVec4 Engine::clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
 
 
-int main()
+int main(int argc, char** argv)
 {
+	// --bench-obj [runs]: compare the OBJ parsers on the bundled models and exit, no window needed
+	if (argc > 1 && strcmp(argv[1], "--bench-obj") == 0)
+		return runObjBenchmark(argc > 2 ? atoi(argv[2]) : 5) == 0 ? 0 : 1;
+
 	Engine myEngine("DEMO_3D",
 		1920, 1080,
 		3, 3,
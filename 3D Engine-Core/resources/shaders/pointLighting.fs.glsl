@@ -5,58 +5,77 @@ out vec4 FragColor;
 in vec3 Normal;  
 in vec3 FragPos;  
 in vec2 TexCoords;
+in vec4 Tint;
 
 struct Material{
 	sampler2D diffuse;
 	sampler2D specular;
 	float shininess;
 };
-  
-struct Light{
-	vec3 position;
-	vec3 direction;
-	vec3 color;
-
-	vec3 ambient;
-	vec3 diffuse;
-	vec3 specular;
-
-	float constant;
-	float linear;
-	float quadratic;
+
+// std140 point light of FrameUniforms, vec3 members padded to vec4
+struct PointLight{
+	vec4 position;
+	vec4 color;
+
+	vec4 ambient;
+	vec4 diffuse;
+	vec4 specular;
+
+	vec4 attenuation; // constant, linear, quadratic
+};
+
+#define MAX_POINT_LIGHTS 8
+
+// per frame data of FrameUniforms
+layout (std140) uniform Camera
+{
+	mat4 view;
+	mat4 projection;
+	vec4 viewPosition;
+};
+
+layout (std140) uniform Lights
+{
+	PointLight pointLights[MAX_POINT_LIGHTS];
+	ivec4 pointLightCount;
 };
 
-uniform vec3 viewPos;
 uniform Material material;
-uniform Light light;
 
-void main()
+vec3 pointLight(PointLight light, vec3 norm, vec3 viewDir, vec3 diffuseColor, vec3 specularColor)
 {
-	
-	vec3 lightDir = normalize(light.position - FragPos);
+	vec3 lightDir = normalize(light.position.xyz - FragPos);
 
 	// ambient
-	vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords)).rgb * light.color;
+	vec3 ambient = light.ambient.rgb * diffuseColor * light.color.rgb;
 	
 	// diffuse 
-	vec3 norm = normalize(Normal);
 	float diff = max(dot(norm, lightDir), 0.0);
-	vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords)).rgb * light.color;
+	vec3 diffuse = light.diffuse.rgb * diff * diffuseColor * light.color.rgb;
 
 	//specular
-	vec3 viewDir = normalize(viewPos - FragPos);
 	vec3 reflectDir = reflect(-lightDir, norm);
 	float spec = pow(max(dot(viewDir, reflectDir), 0.5f), material.shininess);
-	vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords)).rgb * light.color;
+	vec3 specular = light.specular.rgb * spec * specularColor * light.color.rgb;
 			
 	// attenuation;
-	float distance = length(light.position - FragPos);
-	float attenuation = 1.0f / (light.constant + light.linear * distance + light.quadratic *(distance*distance));
+	float distance = length(light.position.xyz - FragPos);
+	float attenuation = 1.0f / (light.attenuation.x + light.attenuation.y * distance + light.attenuation.z *(distance*distance));
+
+	return (ambient + diffuse + specular) * attenuation;
+}
+
+void main()
+{
+	vec3 diffuseColor = vec3(texture(material.diffuse, TexCoords)).rgb * Tint.rgb;
+	vec3 specularColor = vec3(texture(material.specular, TexCoords)).rgb;
+	vec3 norm = normalize(Normal);
+	vec3 viewDir = normalize(viewPosition.xyz - FragPos);
 
 	//result
-	ambient *= attenuation;
-	diffuse *= attenuation;
-	specular *= attenuation;
-	vec3 result = (ambient + diffuse + specular);
+	vec3 result = vec3(0.0);
+	for(int i = 0; i < min(pointLightCount.x, MAX_POINT_LIGHTS); i++)
+		result += pointLight(pointLights[i], norm, viewDir, diffuseColor, specularColor);
 	FragColor = vec4(result, 0.8);
-} 
\ No newline at end of file
+}
\ No newline at end of file
@@ -2,15 +2,24 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+// per instance model matrix and tint of the RenderQueue
+layout (location = 5) in mat4 model;
+layout (location = 9) in vec4 tint;
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
+out vec4 Tint;
 
 //uniform mat4 MVP;
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+// per frame camera of FrameUniforms
+layout (std140) uniform Camera
+{
+	mat4 view;
+	mat4 projection;
+	vec4 viewPosition;
+};
 
 void main()
 {
@@ -18,6 +27,7 @@ void main()
 	//gl_Position = MVP * vec4(aPos, 1.0);
 	FragPos = vec3(model * vec4(aPos, 1.0));
 	TexCoords = aTexCoords;
+	Tint = tint;
 	Normal = mat3(transpose(inverse(model))) * aNormal;
     //Normal = normalize(vec3(model * vec4(aNormal, 0.0)));
 }
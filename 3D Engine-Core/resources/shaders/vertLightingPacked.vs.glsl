@@ -0,0 +1,46 @@
+#version 330 core
+// vertLighting.vs.glsl for the PackedVertex layout of Mesh.h
+layout (location = 0) in vec4 aPos;       // xyz quantized in the mesh bounds, w = bitangent sign
+layout (location = 1) in vec2 aNormal;    // octahedral encoded
+layout (location = 2) in vec2 aTexCoords; // half floats
+layout (location = 3) in vec2 aTangent;   // octahedral encoded
+// per instance model matrix, tint and position dequantization of the RenderQueue
+layout (location = 5) in mat4 model;
+layout (location = 9) in vec4 tint;
+layout (location = 10) in vec3 posOffset;
+layout (location = 11) in vec3 posScale;
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec2 TexCoords;
+out vec4 Tint;
+
+// per frame camera of FrameUniforms
+layout (std140) uniform Camera
+{
+	mat4 view;
+	mat4 projection;
+	vec4 viewPosition;
+};
+
+vec3 octahedralDecode(vec2 e)
+{
+	vec3 v = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+	if (v.z < 0.0)
+		v.xy = (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+	return normalize(v);
+}
+
+void main()
+{
+	vec3 position = posOffset + aPos.xyz * posScale;
+	vec3 normal = octahedralDecode(aNormal);
+	// tangent frame for normal mapping shaders:
+	// tangent = octahedralDecode(aTangent), bitangent = cross(normal, tangent) * (aPos.w * 2.0 - 1.0)
+
+	gl_Position = projection * view * model * vec4(position, 1.0);
+	FragPos = vec3(model * vec4(position, 1.0));
+	TexCoords = aTexCoords;
+	Tint = tint;
+	Normal = mat3(transpose(inverse(model))) * normal;
+}
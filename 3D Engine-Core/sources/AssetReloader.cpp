@@ -0,0 +1,206 @@
+#include "AssetReloader.h"
+#include "ObjLoader.h"
+#include "TextureRegistry.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <iostream>
+#include <set>
+
+bool AssetReloader::enabled = true;
+
+// the .mtl files an OBJ model reads its materials from, whichever importer reads it
+static std::vector<std::string> materialLibraries(const Model *model)
+{
+	std::string extension = model->path.size() >= 4 ? model->path.substr(model->path.size() - 4) : std::string();
+	for (size_t i = 0; i < extension.size(); i++)
+		extension[i] = static_cast<char>(tolower(static_cast<unsigned char>(extension[i])));
+	if (extension != ".obj")
+		return std::vector<std::string>();
+	return ObjLoader::materialLibraries(model->path);
+}
+
+AssetReloader::~AssetReloader()
+{
+	// imports wait for their worker stage, the other jobs only hold copies of what they read
+	for (size_t i = 0; i < this->modelReloads.size(); i++)
+		delete this->modelReloads[i].second;
+}
+
+void AssetReloader::watchShader(Shader *shader)
+{
+	if (!enabled)
+		return;
+
+	this->watcher.watch(shader->vertexPath);
+	this->watcher.watch(shader->fragmentPath);
+}
+
+void AssetReloader::watchModel(Model *model)
+{
+	if (!enabled || model->path.empty())
+		return;
+
+	this->watcher.watch(model->path);
+	std::vector<std::string> libraries = materialLibraries(model);
+	for (size_t i = 0; i < libraries.size(); i++)
+		this->watcher.watch(libraries[i]);
+	map<string, TextureUsage> textures = model->textureFiles();
+	for (map<string, TextureUsage>::const_iterator it = textures.begin(); it != textures.end(); ++it)
+		this->watcher.watch(it->first);
+}
+
+void AssetReloader::reload(const std::string &path, std::vector<Shader*> &shaders, std::vector<Model*> &models)
+{
+	for (size_t i = 0; i < shaders.size(); i++)
+	{
+		Shader *shader = shaders[i];
+		if (shader->vertexPath != path && shader->fragmentPath != path)
+			continue;
+
+		std::string vertexPath = shader->vertexPath, fragmentPath = shader->fragmentPath;
+		ShaderReload reload;
+		reload.shader = shader;
+		reload.sources = ThreadPool::shared().submit([vertexPath, fragmentPath]()
+		{
+			std::pair<std::string, std::string> sources;
+			if (!Shader::readFile(vertexPath, sources.first) || !Shader::readFile(fragmentPath, sources.second))
+				sources.first.clear();
+			return sources;
+		});
+		this->shaderReloads.push_back(std::move(reload));
+	}
+
+	std::set<TextureUsage> usages;
+	for (size_t i = 0; i < models.size(); i++)
+	{
+		Model *model = models[i];
+		std::vector<std::string> libraries = model->path == path ? std::vector<std::string>() : materialLibraries(model);
+		if (model->path == path || std::find(libraries.begin(), libraries.end(), path) != libraries.end())
+		{
+			// a newer change restarts the import of the model
+			for (size_t j = 0; j < this->modelReloads.size(); j++)
+			{
+				if (this->modelReloads[j].first != model)
+					continue;
+				delete this->modelReloads[j].second;
+				this->modelReloads.erase(this->modelReloads.begin() + j);
+				break;
+			}
+			this->modelReloads.push_back(std::make_pair(model, new ModelImport(model->path, model->gammaCorrection)));
+		}
+
+		map<string, TextureUsage> textures = model->textureFiles();
+		map<string, TextureUsage>::const_iterator texture = textures.find(path);
+		if (texture != textures.end())
+			usages.insert(texture->second);
+	}
+
+	if (usages.empty())
+		return;
+
+	// the file is hashed again when the new texture is acquired, even if its stamp did not change
+	TextureRegistry::shared().invalidate(path);
+	for (std::set<TextureUsage>::const_iterator usage = usages.begin(); usage != usages.end(); ++usage)
+	{
+		TextureReload reload;
+		reload.filename = path;
+		reload.usage = *usage;
+		TextureUsage textureUsage = *usage;
+		reload.image = ThreadPool::shared().submit([path, textureUsage]() { return TextureLoader::prepare(path, textureUsage); });
+		this->textureReloads.push_back(std::move(reload));
+	}
+}
+
+// true once the job behind a future is done, without waiting for it
+template<class T>
+static bool finished(const std::future<T> &result)
+{
+	return result.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+void AssetReloader::update(std::vector<Shader*> &shaders, std::vector<Model*> &models, double importBudget)
+{
+	if (!enabled)
+		return;
+
+	std::vector<std::string> changed = this->watcher.poll();
+	for (size_t i = 0; i < changed.size(); i++)
+	{
+		std::cout << "RELOAD:: " << changed[i] << std::endl;
+		reload(changed[i], shaders, models);
+	}
+
+	for (size_t i = 0; i < this->shaderReloads.size();)
+	{
+		ShaderReload &reload = this->shaderReloads[i];
+		if (!finished(reload.sources))
+		{
+			i++;
+			continue;
+		}
+
+		std::pair<std::string, std::string> sources = reload.sources.get();
+		if (sources.first.empty())
+			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << reload.shader->vertexPath << ", " << reload.shader->fragmentPath << std::endl;
+		else if (!reload.shader->reload(sources.first, sources.second))
+			std::cout << "WARNING::SHADER:: keeping the last program of " << reload.shader->fragmentPath << std::endl;
+		this->shaderReloads.erase(this->shaderReloads.begin() + i);
+	}
+
+	for (size_t i = 0; i < this->textureReloads.size();)
+	{
+		TextureReload &reload = this->textureReloads[i];
+		if (!finished(reload.image))
+		{
+			i++;
+			continue;
+		}
+
+		DecodedImage image = reload.image.get();
+		if (!image.valid())
+			std::cout << "WARNING::TEXTURE:: keeping the last texture of " << reload.filename << std::endl;
+		else
+			for (size_t j = 0; j < models.size(); j++)
+				models[j]->replaceTexture(reload.filename, reload.usage, image);
+		this->textureReloads.erase(this->textureReloads.begin() + i);
+	}
+
+	for (size_t i = 0; i < this->modelReloads.size();)
+	{
+		Model *old = this->modelReloads[i].first;
+		ModelImport *import = this->modelReloads[i].second;
+
+		// the whole model is swapped once all of its meshes are uploaded
+		Model *model = import->update(importBudget);
+		if (model)
+		{
+			std::vector<Model*>::iterator slot = std::find(models.begin(), models.end(), old);
+			if (slot != models.end())
+			{
+				model->position = old->position;
+				model->scale = old->scale;
+				model->rotation = old->rotation;
+				model->instances = old->instances;
+				*slot = model;
+				delete old;
+				watchModel(model);
+			}
+			else
+				delete model;
+		}
+
+		if (import->isDone())
+		{
+			if (import->getState() == ModelImport::FAILED)
+				std::cout << "WARNING::MODEL:: keeping the last meshes of " << import->getPath() << std::endl;
+
+			delete import;
+			this->modelReloads.erase(this->modelReloads.begin() + i);
+		}
+		else
+			i++;
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "FileWatcher.h"
+#include "Model.h"
+#include "ModelImport.h"
+#include "Shader.h"
+#include "TextureLoader.h"
+
+#include <future>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Hot reload of the shaders, models and textures the engine has loaded. A FileWatcher reports the files written
+// while the engine runs and only the assets reading them are loaded again: shader sources are read, models
+// imported and textures prepared on the worker pool. update() swaps the results in on the GL thread between two
+// frames, so a frame never sees a half loaded asset and a file that fails to load leaves the old one in place.
+class AssetReloader
+{
+public:
+	// watch the files of loaded assets
+	static bool enabled;
+
+	~AssetReloader();
+
+	// reloads the program when one of the shader sources changes
+	void watchShader(Shader *shader);
+
+	// reloads the meshes when the model file or one of its material libraries changes and each texture when its
+	// file changes
+	void watchModel(Model *model);
+
+	// starts the reloads of the files changed since the last call and swaps in those that finished.
+	// Reloaded models replace the old ones in models. GL thread only.
+	void update(std::vector<Shader*> &shaders, std::vector<Model*> &models, double importBudget);
+
+private:
+	struct ShaderReload
+	{
+		Shader *shader;
+		// vertex and fragment code, empty if a file could not be read
+		std::future<std::pair<std::string, std::string>> sources;
+	};
+
+	struct TextureReload
+	{
+		std::string filename;
+		TextureUsage usage;
+		std::future<DecodedImage> image;
+	};
+
+	// starts the reloads of the assets reading a changed file
+	void reload(const std::string &path, std::vector<Shader*> &shaders, std::vector<Model*> &models);
+
+	FileWatcher watcher;
+	std::vector<ShaderReload> shaderReloads;
+	std::vector<TextureReload> textureReloads;
+	// model being replaced and the import replacing it
+	std::vector<std::pair<Model*, ModelImport*>> modelReloads;
+};
@@ -3,6 +3,9 @@
 #include "externals/imgui/imgui_impl_glfw.h"
 #include "externals/imgui/ImGuiFileDialog/ImGuiFileDialog.h"
 #include "../sources/Global_Variable.h"
+#include "GLExtensions.h"
+#include "GLState.h"
+#include "TextureStreamer.h"
 
 // Private functions
 void Engine::initGLFW()
@@ -56,18 +59,23 @@ int Engine::initGLAD()
 		std::cout << "Failed to initialize GLAD" << std::endl;
 		return -1;
 	}
+
+	// texture compression formats are picked on the worker threads from these, the draw submission path too
+	GLExtensions::load((GLADloadproc)glfwGetProcAddress);
+	// nothing is known of the new context yet
+	GLState::invalidate();
 }
 
 // init openGl option
 void Engine::initOpenGLOptions()
 {
 	// enable z coordiante
-	glEnable(GL_DEPTH_TEST);
+	GLState::enable(GL_DEPTH_TEST);
 
 	// hide things behind
 
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	GLState::enable(GL_BLEND);
+	GLState::blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 
@@ -94,7 +102,9 @@ void Engine::initShaders()
 {
 	// build and compile shaders
 	// -------------------------
-	Shader* ourShader0 = new Shader("resources/shaders/vertLighting.vs.glsl", "resources/shaders/pointLighting.fs.glsl");
+	// packed vertices are decoded in their own vertex shader
+	const char* modelVertexShader = this->compactVertices ? "resources/shaders/vertLightingPacked.vs.glsl" : "resources/shaders/vertLighting.vs.glsl";
+	Shader* ourShader0 = new Shader(modelVertexShader, "resources/shaders/pointLighting.fs.glsl");
 	this->shaders.push_back(ourShader0);
 
 	Shader* ourShader1 = new Shader("resources/shaders/skybox_vs.glsl", "resources/shaders/skybox_fs.glsl");
@@ -110,6 +120,15 @@ void Engine::initModels()
 	this->models.push_back(new Model("resources/objects/nanosuit/nanosuit.obj"));
 }
 
+void Engine::initHotReload()
+{
+	this->reloader = new AssetReloader();
+	for (size_t i = 0; i < this->shaders.size(); i++)
+		this->reloader->watchShader(this->shaders[i]);
+	for (size_t i = 0; i < this->models.size(); i++)
+		this->reloader->watchModel(this->models[i]);
+}
+
 void Engine::initPointLights()
 {
 	this->Light.push_back(new PointLight(glm::vec3(1.0f, 1.0f, 1.0f), 4.0f, glm::vec3(0.0f), glm::vec3(0.0f)));
@@ -122,25 +141,29 @@ void Engine::initLights()
 
 void Engine::initUniforms()
 {
-	this->shaders[0]->setUniformVec3("viewPos", camera.Position);
-	//INIT UNIFORMS
-	this->shaders[0]->setUniformMat4("view", this->ViewMatrix, false);
-	this->shaders[0]->setUniformMat4("projection", this->ProjectionMatrix, false);
-
-	for each (PointLight * pl in this->Light)
-	{
-		pl->sendToShader(*this->shaders[0]);
-	}
+	// per frame data of all programs, filled by updateUniforms
+	this->frameUniforms = new FrameUniforms();
 }
 
 Engine::~Engine()
 {
-	glfwDestroyWindow(this->window);
-	glfwTerminate();
+	// models release their GL textures and geometry, so they go before the context
+	for (auto*& i : this->imports)
+		delete i;
+
+	delete this->reloader;
 
 	for (auto*& i : this->models)
 		delete i;
 
+	delete this->frameUniforms;
+	this->streamBuffer.release();
+
+	GeometryHeap::destroyAll();
+
+	glfwDestroyWindow(this->window);
+	glfwTerminate();
+
 	for (size_t i = 0; i < this->Light.size(); i++)
 		delete this->Light[i];
 
@@ -267,6 +290,41 @@ void Engine::update()
 	//UPDATE INPUT ---
 	this->updateDt();
 	this->updateInput();
+
+	//UPDATE IMPORTS ---
+	this->updateImports();
+
+	//UPDATE HOT RELOAD --- swap in the assets whose files changed
+	this->reloader->update(this->shaders, this->models, this->importBudget);
+
+	//UPDATE GEOMETRY --- compact the shared buffers once removed models left too many holes
+	GeometryHeap::compactAll();
+}
+
+void Engine::updateImports()
+{
+	for (size_t i = 0; i < this->imports.size();)
+	{
+		ModelImport* import = this->imports[i];
+
+		Model* model = import->update(this->importBudget);
+		if (model)
+		{
+			this->models.push_back(model);
+			this->reloader->watchModel(model);
+		}
+
+		if (import->isDone())
+		{
+			if (import->getState() == ModelImport::FAILED)
+				std::cout << "ERROR::MODEL_IMPORT_FAILED: " << import->getPath() << std::endl;
+
+			delete import;
+			this->imports.erase(this->imports.begin() + i);
+		}
+		else
+			i++;
+	}
 }
 
 void Engine::initIMGUI()
@@ -295,7 +353,7 @@ void Engine::ImGuiRender()
 		//static int counter = 0;
 		ImGui::Begin("Trasnformation");
 		ImGui::SetWindowPos(ImVec2(0, 0));
-		ImGui::SetWindowSize(ImVec2(400, 150));
+		ImGui::SetWindowSize(ImVec2(400, 175));
 		glm::vec3 Trans_Val = this->models[0]->position;
 		ImGui::SliderFloat3("Translation", &Trans_Val.x, -100.0f, 100.0f);
 		models[0]->position = Trans_Val;
@@ -308,11 +366,16 @@ void Engine::ImGuiRender()
 
 		ImGui::SliderFloat("Radian", &Radian, 0.0f, 360.0f);
 
+		// instanced copies of the model, drawn with one call per mesh
+		int copies = (int)this->models[0]->instances.size();
+		if (ImGui::SliderInt("Copies", &copies, 1, 1024))
+			this->models[0]->placeCopies((unsigned int)copies);
+
 		ImGui::End();
 		// open Dialog Simple
 		ImGui::Begin("Choose Object");
-		ImGui::SetWindowPos(ImVec2(0, 160));
-		ImGui::SetWindowSize(ImVec2(400, 80));
+		ImGui::SetWindowPos(ImVec2(0, 185));
+		ImGui::SetWindowSize(ImVec2(400, 80.0f + 25.0f * this->imports.size()));
 		if (ImGui::Button("Pick a Object model"))
 			ImGuiFileDialog::Instance()->OpenDialog("ChooseFileDlgKey", "Choose File", ".obj", ".");
 
@@ -326,32 +389,85 @@ void Engine::ImGuiRender()
 				std::string filePath = ImGuiFileDialog::Instance()->GetCurrentPath();
 				filePathName.replace(filePathName.find_last_of('\\'), 1, std::string("/"));
 				std::cout << filePathName;
-				this->models.push_back(new Model(filePathName));
+				// import in the background, the model shows up once it is uploaded
+				this->imports.push_back(new ModelImport(filePathName));
 				// action
 			}
 
 			// close
 			ImGuiFileDialog::Instance()->Close();
 		}
+
+		// progress of running imports
+		for (size_t i = 0; i < this->imports.size(); i++)
+		{
+			ModelImport* import = this->imports[i];
+			std::string name = import->getPath().substr(import->getPath().find_last_of('/') + 1);
+
+			ImGui::PushID((int)i);
+			ImGui::ProgressBar(import->getProgress(), ImVec2(250.0f, 0.0f), name.c_str());
+			ImGui::SameLine();
+			if (ImGui::Button("Cancel"))
+				import->cancel();
+			ImGui::PopID();
+		}
+		ImGui::End();
+	}
+
+	// Frame statistics
+	{
+		ImGui::Begin("Stats");
+		ImGui::SetWindowPos(ImVec2(this->framebufferWidth - 300.0f, 0));
+		ImGui::SetWindowSize(ImVec2(300, 430));
+		ImGui::Text("%.2f ms/frame (%.1f FPS)", this->dt * 1000.0f, this->dt > 0.0f ? 1.0f / this->dt : 0.0f);
+
+		ImGui::Checkbox("Levels of detail", &this->useLods);
+		ImGui::SliderFloat("Max error (px)", &this->lodPixelError, 0.1f, 8.0f);
+		size_t saved = this->stats.fullTriangles - this->stats.lodTriangles;
+		ImGui::Text("Triangles: %u of %u", (unsigned int)this->stats.drawnTriangles, (unsigned int)this->stats.fullTriangles);
+		ImGui::Text("LOD savings: %u (%.1f%%)", (unsigned int)saved,
+			this->stats.fullTriangles > 0 ? 100.0f * saved / this->stats.fullTriangles : 0.0f);
+
+		ImGui::Checkbox("Frustum culling", &this->useFrustumCulling);
+		ImGui::Text("Meshes culled: %u of %u (%u triangles)", this->stats.frustumCulledMeshes, this->stats.meshes,
+			(unsigned int)this->stats.frustumCulledTriangles);
+		ImGui::Text("Scene BVH: %.2fx build cost%s", this->sceneBVH.degradation(), this->sceneBVH.rebuilding() ? ", rebuilding" : "");
+
+		ImGui::Checkbox("Cluster culling", &this->useClusterCulling);
+		ImGui::Text("Clusters culled: %u of %u", this->stats.culledClusters, this->stats.clusters);
+		ImGui::Text("Culling savings: %u triangles", (unsigned int)(this->stats.lodTriangles - this->stats.frustumCulledTriangles - this->stats.drawnTriangles));
+		ImGui::Text("Draws: %u of %u instances, programs: %u", this->stats.draws, this->stats.instances, this->stats.programBinds);
+		ImGui::Text("Texture sets: %u, vertex arrays: %u", this->stats.textureSetBinds, this->stats.vertexArrayBinds);
+		if (GLExtensions::multiDrawIndirect)
+			ImGui::Checkbox("Multi draw indirect", &RenderQueue::useIndirect);
+		else
+			ImGui::Text("Multi draw indirect: not supported");
+		ImGui::Text("Draw calls: %u", this->stats.drawCalls);
+		ImGui::Text("Stream buffer: %u of %u KB, %s", (unsigned int)(this->streamBuffer.frameUsage() >> 10),
+			(unsigned int)(this->streamBuffer.frameCapacity() >> 10), this->streamBuffer.persistent() ? "persistent" : "orphaned");
+		ImGui::Text("GPU waits: %u", this->streamBuffer.waits());
+		unsigned int stateCalls = GLState::issuedCalls() + GLState::savedCalls();
+		ImGui::Text("GL state calls: %u, skipped %u (%.0f%%)", GLState::issuedCalls(), GLState::savedCalls(),
+			stateCalls > 0 ? 100.0f * GLState::savedCalls() / stateCalls : 0.0f);
+
+		TextureStreamer& streamer = TextureStreamer::shared();
+		int budgetMB = (int)(streamer.budgetBytes >> 20);
+		if (ImGui::SliderInt("Texture budget (MB)", &budgetMB, 16, 2048))
+			streamer.budgetBytes = (size_t)budgetMB << 20;
+		ImGui::Text("Textures: %.1f MB, %u of %u streaming", streamer.residentBytes() / (1024.0f * 1024.0f),
+			streamer.pendingTextures(), (unsigned int)streamer.size());
 		ImGui::End();
 	}
 
 	// Rendering ImGui
 	ImGui::Render();
+	// the backend restores the GL state it changes, so GLState stays right
 	ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 }
 
 void Engine::updateUniforms()
 {
-	// Enable shader
-	this->shaders[0]->use();
 	//this->Light[0]->setPosition(camera.Position); // Uncomment to move the light along with camera
-	//this->Light[0]->setViewPos(camera.Position);
-
-	for each (PointLight * pl in this->Light)
-	{
-		pl->sendToShader(*this->shaders[0]);
-	}
 
 	// Update view matrix (camera)
 	this->ViewMatrix = this->camera.GetViewMatrix();
@@ -362,19 +478,98 @@ void Engine::updateUniforms()
 		this->nearPlane,
 		this->farPlane);
 
-	this->shaders[0]->setUniformMat4("projection", this->ProjectionMatrix, false);
-	this->shaders[0]->setUniformMat4("view", this->ViewMatrix, false);
-	for (auto& i : this->models) 
+	// Camera and lights go to the shared uniform blocks once for every program, in the stream buffer segment of the frame
+	this->streamBuffer.beginFrame();
+	this->frameUniforms->camera.view = this->ViewMatrix;
+	this->frameUniforms->camera.projection = this->ProjectionMatrix;
+	this->frameUniforms->camera.viewPosition = glm::vec4(camera.Position, 1.0f);
+	int lightCount = 0;
+	for each (PointLight * pl in this->Light)
+	{
+		if (lightCount < MAX_POINT_LIGHTS)
+			pl->writeUniforms(this->frameUniforms->lights.pointLights[lightCount++]);
+	}
+	this->frameUniforms->lights.pointLightCount = glm::ivec4(lightCount, 0, 0, 0);
+	this->frameUniforms->update(this->streamBuffer);
+	// the skybox reads the blocks too, even when the render queue has nothing to draw
+	this->streamBuffer.commit();
+
+	// Enable shader
+	this->shaders[0]->use();
+	this->shaders[0]->setUniform1f("material.shininess", 30.4f);
+
+	// pixels covered by one unit at distance one, for the level of detail selection
+	const float projectionScale = this->framebufferHeight / (2.0f * tanf(glm::radians(camera.Zoom) * 0.5f));
+	this->stats.reset();
+
+	// Model matrices of the frame, the BVH refits the models that moved
+	std::vector<glm::mat4> transforms(this->models.size());
+	for (size_t i = 0; i < this->models.size(); i++)
 	{
 		glm::mat4 model;
-		model = glm::translate(model, i->position);
-		model = glm::scale(model, i->scale);
+		model = glm::translate(model, this->models[i]->position);
+		model = glm::scale(model, this->models[i]->scale);
 		model = glm::rotate(model, Radian, glm::vec3(0.0f, 1.0f, 0.0f));
+		transforms[i] = model;
 
-		// Send updated uniform to shader program
-		this->shaders[0]->setUniformMat4("model", model, false);
-		i->Draw(*(this->shaders[0]));
+		for (auto& mesh : this->models[i]->meshes)
+		{
+			mesh.visibleInstances.clear();
+			if (!this->useFrustumCulling)
+			{
+				for (unsigned int copy = 0; copy < this->models[i]->instances.size(); copy++)
+					mesh.visibleInstances.push_back(copy);
+			}
+		}
+	}
+	this->sceneBVH.sync(this->models, transforms);
+
+	// Meshes off screen: subtrees inside the view are taken whole, the meshes of the leaves on its border are tested one by one
+	this->stats.meshes = (unsigned int)this->sceneBVH.size();
+	if (this->useFrustumCulling)
+	{
+		const Frustum frustum(this->ProjectionMatrix * this->ViewMatrix);
+		std::vector<unsigned int> inside, border;
+		this->sceneBVH.queryFrustum(frustum, inside, border);
+		for (unsigned int index : inside)
+		{
+			const SceneBVH::Instance& instance = this->sceneBVH.instance(index);
+			this->models[instance.model]->meshes[instance.mesh].visibleInstances.push_back(instance.copy);
+		}
+		this->frustumCuller.clear();
+		for (unsigned int index : border)
+		{
+			const SceneBVH::Instance& instance = this->sceneBVH.instance(index);
+			const Model* m = this->models[instance.model];
+			this->frustumCuller.add(m->meshes[instance.mesh], m->instanceTransform(transforms[instance.model], instance.copy));
+		}
+		unsigned int culled = this->frustumCuller.cull(frustum);
+		for (size_t i = 0; i < border.size(); i++)
+		{
+			const SceneBVH::Instance& instance = this->sceneBVH.instance(border[i]);
+			if (this->frustumCuller.isVisible(i))
+				this->models[instance.model]->meshes[instance.mesh].visibleInstances.push_back(instance.copy);
+		}
+		this->stats.frustumCulledMeshes = this->stats.meshes - (unsigned int)(inside.size() + border.size()) + culled;
 	}
+
+	for (size_t i = 0; i < this->models.size(); i++)
+	{
+		Model* m = this->models[i];
+		const glm::mat4& model = transforms[i];
+
+		m->selectLods(model, camera.Position, projectionScale, this->useLods ? this->lodPixelError : 0.0f, this->stats);
+		m->requestTextures(model, camera.Position, projectionScale);
+		if (this->useClusterCulling)
+			m->cullClusters(this->ProjectionMatrix * this->ViewMatrix, model, camera.Position, this->stats);
+		else
+			this->stats.drawnTriangles = this->stats.lodTriangles - this->stats.frustumCulledTriangles;
+
+		m->submit(this->renderQueue, *(this->shaders[0]), model, camera.Position);
+	}
+	this->renderQueue.flush(this->stats, this->streamBuffer);
+	// mip levels for the next frames from what was requested while drawing this one
+	TextureStreamer::shared().update();
 	// Transform the loaded model
 
 	//Update framebuffer size and projection matrix
@@ -386,8 +581,8 @@ void Engine::initSkyBox()
 	// skybox VAO
 	glGenVertexArrays(1, &skyboxVAO);
 	glGenBuffers(1, &skyboxVBO);
-	glBindVertexArray(skyboxVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
+	GLState::bindVertexArray(skyboxVAO);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), skyboxVertices, GL_STATIC_DRAW);
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
@@ -413,8 +608,8 @@ void Engine::initGround()
 	// skybox VAO
 	glGenVertexArrays(1, &groundVAO);
 	glGenBuffers(1, &groundVBO);
-	glBindVertexArray(groundVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, groundVBO);
+	GLState::bindVertexArray(groundVAO);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, groundVBO);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(GrassVertices), GrassVertices, GL_STATIC_DRAW);
 
 	glEnableVertexAttribArray(0);
@@ -455,15 +650,11 @@ void Engine::render()
 		i->Draw(*this->shaders[0]);*/
 	// this->shaders[0]->unUse();
 	glPopMatrix();
-	glBindVertexArray(0);
 	//this->shaders[0]->unUse();
 
 
 	// this->shaders[2]->use();
 	// draw scene as normal
-	glm::mat4 model_m = glm::mat4(1.0f);
-	glm::mat4 view = camera.GetViewMatrix();
-	glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)WINDOW_WIDTH / (float)WINDOW_HEIGHT, 0.1f, 100.0f);
 
 	// *********************** Render Ground *********************************
 	///////////////////////////////////////////////////////////////////////////
@@ -487,27 +678,24 @@ void Engine::render()
 
 	// Render Sky box
 	// Draw skybox as last
-	glDepthFunc(GL_LEQUAL);  // Change depth function so depth test passes when values are equal to depth buffer's content
+	GLState::depthFunc(GL_LEQUAL);  // Change depth function so depth test passes when values are equal to depth buffer's content
+	// the skybox shader drops the translation of the view matrix of the Camera block
 	this->shaders[1]->use();
-	view = glm::mat4(glm::mat3(camera.GetViewMatrix())); // remove translation from the view matrix
-	this->shaders[1]->setUniformMat4("view", view, false);
-	this->shaders[1]->setUniformMat4("projection", projection, false);
 
 	// skybox cube
-	glBindVertexArray(this->skyboxVAO);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, this->cubemapTexture);
+	GLState::bindVertexArray(this->skyboxVAO);
+	GLState::bindTexture(0, GL_TEXTURE_CUBE_MAP, this->cubemapTexture);
 	glDrawArrays(GL_TRIANGLES, 0, 36);
-	glBindVertexArray(0);
-	glDepthFunc(GL_LESS); // set depth function back to default
+	GLState::depthFunc(GL_LESS); // set depth function back to default
 
 	ImGuiRender();
+	// nothing drawn after this reads the stream buffer, its segment is reused once the GPU passed here
+	this->streamBuffer.endFrame();
+	GLState::endFrame();
 
 	// End Draw
 	glfwSwapBuffers(window);
 	//glFlush();
-	glActiveTexture(0);
-	glBindTexture(GL_TEXTURE_2D, 0);
 	glfwPollEvents();
 }
 
@@ -555,6 +743,20 @@ Engine::Engine(
 	this->mouseOffsetY = 0.0;
 	this->firstMouse = true;
 
+	// Upload at most 4 ms of imported data per frame
+	this->importBudget = 0.004;
+
+	// Quantized vertices take 20 instead of 56 bytes
+	this->compactVertices = true;
+	Mesh::compactVertices = this->compactVertices;
+
+	// Levels of detail may be off by about a pixel
+	this->useLods = true;
+	this->lodPixelError = 1.0f;
+	this->useClusterCulling = true;
+	this->useFrustumCulling = true;
+	this->stats.reset();
+
 	// Initilaize our engine system
 	this->initGLFW();
 	this->initWindow(title, resizable);
@@ -565,6 +767,7 @@ Engine::Engine(
 	this->initMatrices();
 	this->initShaders();
 	this->initModels();
+	this->initHotReload();
 	this->initLights();
 	this->initUniforms();
 	this->initSkyBox();
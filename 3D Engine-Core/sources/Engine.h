@@ -11,9 +11,17 @@
 #include "../imgui/imgui_impl_glfw.h"
 #include "../imgui/imgui_impl_opengl3.h"
 // Component
+#include "AssetReloader.h"
 #include "Camera.h"
+#include "FrameUniforms.h"
+#include "FrustumCuller.h"
 #include "Shader.h"
 #include "Model.h"
+#include "ModelImport.h"
+#include "RenderQueue.h"
+#include "RenderStats.h"
+#include "SceneBVH.h"
+#include "StreamBuffer.h"
 #include "Light.h"
 
 #include <iostream>
@@ -82,10 +90,40 @@ public:
 
 	//Models
 	std::vector<Model*> models;
+	// store model vertices in the 20 byte packed layout, needs the packed vertex shader
+	bool compactVertices;
+	// draw simplified levels of detail of distant meshes, keeping their error below lodPixelError pixels
+	bool useLods;
+	float lodPixelError;
+	// cull off screen and back facing clusters of meshes at full detail
+	bool useClusterCulling;
+
+	//Counters of the last frame, for the stats overlay
+	RenderStats stats;
+	// hierarchy over the meshes of all models, synced with their transforms every frame
+	SceneBVH sceneBVH;
+	// world bounds of the meshes the BVH finds on the border of the view, tested one by one
+	FrustumCuller frustumCuller;
+	bool useFrustumCulling;
+	// visible meshes of the frame, drawn sorted by state
+	RenderQueue renderQueue;
+	// ring buffer the frame uniforms, instances and indirect commands of every frame are written to
+	StreamBuffer streamBuffer;
+
+	//Imports running in the background, moved to models once uploaded
+	std::vector<ModelImport*> imports;
+	// time per frame the render thread may spend on uploading imports
+	double importBudget;
+
+	//Hot reload of the shaders, models and textures whose files change
+	AssetReloader* reloader;
 
 	//Lights
 	std::vector<PointLight*> Light;
 
+	//Uniform blocks of the camera and lights, shared by all programs
+	FrameUniforms* frameUniforms;
+
 	// Private functions
 	void initGLFW();
 
@@ -111,6 +149,9 @@ public:
 	// init loaded model
 	void initModels();
 
+	// watch the files of the loaded shaders and models
+	void initHotReload();
+
 	// init sky box
 	void initSkyBox();
 
@@ -124,6 +165,9 @@ public:
 
 	void initGround();
 
+	// advances background imports and moves finished models into the scene
+	void updateImports();
+
 
 public:
 	//Constructors / Destructors
@@ -0,0 +1,225 @@
+#include "FileUtils.h"
+
+#include <cctype>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+	: bytes(nullptr), length(0), fileHandle(nullptr), mappingHandle(nullptr)
+{
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const std::string& path)
+{
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (view == NULL)
+	{
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	this->fileHandle = file;
+	this->mappingHandle = mapping;
+	this->bytes = static_cast<const unsigned char*>(view);
+	this->length = static_cast<size_t>(fileSize.QuadPart);
+#else
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0)
+	{
+		::close(fd);
+		return false;
+	}
+
+	void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	if (view == MAP_FAILED)
+	{
+		::close(fd);
+		return false;
+	}
+
+	this->fileHandle = reinterpret_cast<void*>(static_cast<intptr_t>(fd));
+	this->bytes = static_cast<const unsigned char*>(view);
+	this->length = static_cast<size_t>(info.st_size);
+#endif
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (this->bytes == nullptr)
+		return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(this->bytes);
+	CloseHandle(static_cast<HANDLE>(this->mappingHandle));
+	CloseHandle(static_cast<HANDLE>(this->fileHandle));
+#else
+	munmap(const_cast<unsigned char*>(this->bytes), this->length);
+	::close(static_cast<int>(reinterpret_cast<intptr_t>(this->fileHandle)));
+#endif
+
+	this->bytes = nullptr;
+	this->length = 0;
+	this->fileHandle = nullptr;
+	this->mappingHandle = nullptr;
+}
+
+static inline uint64_t mix64(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed)
+{
+	const unsigned char* p = static_cast<const unsigned char*>(data);
+	uint64_t h = seed ^ (0x9e3779b97f4a7c15ULL + size);
+
+	// consume 8 bytes at a time, the tail is folded in byte by byte
+	size_t words = size / 8;
+	for (size_t i = 0; i < words; i++)
+	{
+		uint64_t k;
+		std::memcpy(&k, p + i * 8, sizeof(k));
+		h = (h ^ mix64(k)) * 0x100000001b3ULL;
+	}
+	for (size_t i = words * 8; i < size; i++)
+		h = (h ^ p[i]) * 0x100000001b3ULL;
+
+	return mix64(h);
+}
+
+bool hashFile(const std::string& path, uint64_t& hash)
+{
+	MappedFile file;
+	if (!file.open(path))
+		return false;
+
+	hash = hashBytes(file.data(), file.size());
+	return true;
+}
+
+std::string canonicalPath(const std::string& path)
+{
+#ifdef _WIN32
+	char resolved[_MAX_PATH];
+	if (_fullpath(resolved, path.c_str(), _MAX_PATH) == NULL)
+		return path;
+	// windows paths are case insensitive and accept both separators
+	for (char* c = resolved; *c; c++)
+		*c = (*c == '\\') ? '/' : static_cast<char>(tolower(static_cast<unsigned char>(*c)));
+	return resolved;
+#else
+	char resolved[PATH_MAX];
+	if (realpath(path.c_str(), resolved) == nullptr)
+		return path;
+	return resolved;
+#endif
+}
+
+bool fileStamp(const std::string& path, int64_t& mtime, int64_t& size)
+{
+#ifdef _WIN32
+	struct _stat64 info;
+	if (_stat64(path.c_str(), &info) != 0)
+		return false;
+#else
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0)
+		return false;
+#endif
+	mtime = static_cast<int64_t>(info.st_mtime);
+	size = static_cast<int64_t>(info.st_size);
+	return true;
+}
+
+bool listFiles(const std::string& directory, std::vector<std::string>& files)
+{
+#ifdef _WIN32
+	WIN32_FIND_DATAA entry;
+	HANDLE find = FindFirstFileA((directory + "/*").c_str(), &entry);
+	if (find == INVALID_HANDLE_VALUE)
+		return false;
+	do
+	{
+		std::string name = entry.cFileName;
+		if (name == "." || name == "..")
+			continue;
+		if (entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			listFiles(directory + '/' + name, files);
+		else
+			files.push_back(directory + '/' + name);
+	} while (FindNextFileA(find, &entry));
+	FindClose(find);
+#else
+	DIR* dir = opendir(directory.c_str());
+	if (dir == nullptr)
+		return false;
+	while (dirent* entry = readdir(dir))
+	{
+		std::string name = entry->d_name;
+		if (name == "." || name == "..")
+			continue;
+
+		std::string path = directory + '/' + name;
+		struct stat info;
+		if (stat(path.c_str(), &info) != 0)
+			continue;
+		if (S_ISDIR(info.st_mode))
+			listFiles(path, files);
+		else if (S_ISREG(info.st_mode))
+			files.push_back(path);
+	}
+	closedir(dir);
+#endif
+	return true;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Read-only memory mapping of a whole file. The mapping is released when the object goes out of scope.
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	// maps the file at path, returns false if it does not exist or cannot be mapped
+	bool open(const std::string& path);
+	void close();
+
+	const unsigned char* data() const { return this->bytes; }
+	size_t size() const { return this->length; }
+	bool isOpen() const { return this->bytes != nullptr; }
+
+private:
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const unsigned char* bytes;
+	size_t length;
+	// platform handles (HANDLE on windows, file descriptor on posix)
+	void* fileHandle;
+	void* mappingHandle;
+};
+
+// 64 bit hash of a memory block, used to key cooked caches by content
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0);
+
+// hashes the whole content of a file, returns false if the file cannot be read
+bool hashFile(const std::string& path, uint64_t& hash);
+
+// absolute path with "." and ".." resolved, so different spellings of one file compare equal.
+// Falls back to the given path if it cannot be resolved.
+std::string canonicalPath(const std::string& path);
+
+// modification time and size of a file, returns false if the file does not exist
+bool fileStamp(const std::string& path, int64_t& mtime, int64_t& size);
+
+// appends the paths of all regular files below directory, descending into subdirectories.
+// Returns false if directory cannot be read.
+bool listFiles(const std::string& directory, std::vector<std::string>& files);
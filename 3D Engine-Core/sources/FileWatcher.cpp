@@ -0,0 +1,248 @@
+#include "FileWatcher.h"
+#include "FileUtils.h"
+
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+struct FileWatcher::Directory
+{
+	std::string path;
+#ifdef _WIN32
+	HANDLE handle;
+	OVERLAPPED overlapped;
+	bool reading;
+	// ReadDirectoryChangesW needs a DWORD aligned buffer
+	DWORD buffer[4096];
+#else
+	int descriptor;
+#endif
+};
+
+FileWatcher::FileWatcher()
+	: stopping(false), handle(nullptr)
+{
+#ifdef _WIN32
+	this->handle = CreateEventA(NULL, FALSE, FALSE, NULL);
+#else
+	int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	// stored plus one, so descriptor 0 is not taken for a missing handle
+	if (fd >= 0)
+		this->handle = reinterpret_cast<void*>(static_cast<intptr_t>(fd + 1));
+#endif
+	if (!this->handle)
+	{
+		std::cout << "WARNING::FILE_WATCHER:: cannot watch files, hot reload is disabled" << std::endl;
+		return;
+	}
+	this->thread = std::thread([this]() { this->watchLoop(); });
+}
+
+FileWatcher::~FileWatcher()
+{
+	this->stopping = true;
+#ifdef _WIN32
+	if (this->handle)
+		SetEvent(static_cast<HANDLE>(this->handle));
+#endif
+	if (this->thread.joinable())
+		this->thread.join();
+
+	for (size_t i = 0; i < this->directories.size(); i++)
+	{
+#ifdef _WIN32
+		CancelIo(this->directories[i]->handle);
+		CloseHandle(this->directories[i]->handle);
+		CloseHandle(this->directories[i]->overlapped.hEvent);
+#endif
+		delete this->directories[i];
+	}
+
+	if (!this->handle)
+		return;
+#ifdef _WIN32
+	CloseHandle(static_cast<HANDLE>(this->handle));
+#else
+	// closing the descriptor removes its watches
+	close(static_cast<int>(reinterpret_cast<intptr_t>(this->handle)) - 1);
+#endif
+}
+
+void FileWatcher::watch(const std::string &path)
+{
+	if (!this->handle)
+		return;
+
+	std::string canonical = canonicalPath(path);
+	size_t slash = canonical.find_last_of("/\\");
+	std::string directory = slash == std::string::npos ? "." : canonical.substr(0, slash);
+
+	std::lock_guard<std::mutex> lock(this->mutex);
+	if (!this->files.insert(std::make_pair(canonical, path)).second)
+		return;
+	for (size_t i = 0; i < this->directories.size(); i++)
+		if (this->directories[i]->path == directory)
+			return;
+
+	Directory *watched = new Directory();
+	watched->path = directory;
+#ifdef _WIN32
+	// one wait handle per directory next to the wake event
+	if (this->directories.size() + 1 >= MAXIMUM_WAIT_OBJECTS)
+	{
+		std::cout << "WARNING::FILE_WATCHER:: too many directories, not watching " << directory << std::endl;
+		delete watched;
+		return;
+	}
+	watched->handle = CreateFileA(directory.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+	if (watched->handle == INVALID_HANDLE_VALUE)
+	{
+		std::cout << "WARNING::FILE_WATCHER:: cannot watch " << directory << std::endl;
+		delete watched;
+		return;
+	}
+	std::memset(&watched->overlapped, 0, sizeof(watched->overlapped));
+	watched->overlapped.hEvent = CreateEventA(NULL, FALSE, FALSE, NULL);
+	watched->reading = false;
+	this->directories.push_back(watched);
+	// the watching thread issues the reads of the new directory
+	SetEvent(static_cast<HANDLE>(this->handle));
+#else
+	int fd = static_cast<int>(reinterpret_cast<intptr_t>(this->handle)) - 1;
+	// editors either write the file in place or rename a new one over it
+	watched->descriptor = inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+	if (watched->descriptor < 0)
+	{
+		std::cout << "WARNING::FILE_WATCHER:: cannot watch " << directory << std::endl;
+		delete watched;
+		return;
+	}
+	this->directories.push_back(watched);
+#endif
+}
+
+void FileWatcher::changed(const std::string &directory, const std::string &name)
+{
+	std::string path = directory + '/' + name;
+	std::lock_guard<std::mutex> lock(this->mutex);
+	if (this->files.count(path))
+		this->changes[path] = std::chrono::steady_clock::now();
+}
+
+std::vector<std::string> FileWatcher::poll()
+{
+	std::vector<std::string> settled;
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+	std::lock_guard<std::mutex> lock(this->mutex);
+	for (std::unordered_map<std::string, std::chrono::steady_clock::time_point>::iterator it = this->changes.begin(); it != this->changes.end();)
+	{
+		if (now - it->second < std::chrono::milliseconds(SETTLE_MS))
+		{
+			++it;
+			continue;
+		}
+		settled.push_back(this->files[it->first]);
+		it = this->changes.erase(it);
+	}
+	return settled;
+}
+
+#ifdef _WIN32
+void FileWatcher::watchLoop()
+{
+	std::vector<HANDLE> events;
+	std::vector<Directory*> watched;
+	while (!this->stopping)
+	{
+		// start the reads of new directories, then wait on all of them and the wake event
+		events.assign(1, static_cast<HANDLE>(this->handle));
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			watched = this->directories;
+		}
+		for (size_t i = 0; i < watched.size(); i++)
+		{
+			Directory &directory = *watched[i];
+			if (!directory.reading)
+				directory.reading = ReadDirectoryChangesW(directory.handle, directory.buffer, sizeof(directory.buffer), FALSE,
+					FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME, NULL, &directory.overlapped, NULL) != 0;
+			events.push_back(directory.overlapped.hEvent);
+		}
+
+		DWORD signaled = WaitForMultipleObjects(static_cast<DWORD>(events.size()), events.data(), FALSE, INFINITE);
+		if (signaled <= WAIT_OBJECT_0 || signaled >= WAIT_OBJECT_0 + events.size())
+			continue;
+
+		Directory &directory = *watched[signaled - WAIT_OBJECT_0 - 1];
+		directory.reading = false;
+		DWORD bytes = 0;
+		// no bytes means the buffer overflowed, the changes it missed are lost
+		if (!GetOverlappedResult(directory.handle, &directory.overlapped, &bytes, FALSE) || bytes == 0)
+			continue;
+
+		const unsigned char *entry = reinterpret_cast<const unsigned char*>(directory.buffer);
+		for (;;)
+		{
+			const FILE_NOTIFY_INFORMATION *info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(entry);
+			if (info->Action == FILE_ACTION_MODIFIED || info->Action == FILE_ACTION_ADDED || info->Action == FILE_ACTION_RENAMED_NEW_NAME)
+			{
+				char name[MAX_PATH];
+				int length = WideCharToMultiByte(CP_ACP, 0, info->FileName, static_cast<int>(info->FileNameLength / sizeof(WCHAR)), name, MAX_PATH - 1, NULL, NULL);
+				// spelled like canonicalPath: lower case with forward slashes
+				for (int i = 0; i < length; i++)
+					name[i] = (name[i] == '\\') ? '/' : static_cast<char>(tolower(static_cast<unsigned char>(name[i])));
+				changed(directory.path, std::string(name, length));
+			}
+			if (info->NextEntryOffset == 0)
+				break;
+			entry += info->NextEntryOffset;
+		}
+	}
+}
+#else
+void FileWatcher::watchLoop()
+{
+	int fd = static_cast<int>(reinterpret_cast<intptr_t>(this->handle)) - 1;
+	// inotify_event is followed by its name, the buffer keeps the alignment of the struct
+	alignas(inotify_event) char buffer[16384];
+	while (!this->stopping)
+	{
+		// the timeout only bounds how long stopping takes
+		pollfd waiting = { fd, POLLIN, 0 };
+		if (::poll(&waiting, 1, 50) <= 0)
+			continue;
+
+		ssize_t length = read(fd, buffer, sizeof(buffer));
+		for (ssize_t offset = 0; offset < length;)
+		{
+			const inotify_event *event = reinterpret_cast<const inotify_event*>(buffer + offset);
+			offset += sizeof(inotify_event) + event->len;
+			if (event->len == 0)
+				continue;
+
+			std::string directory;
+			{
+				std::lock_guard<std::mutex> lock(this->mutex);
+				for (size_t i = 0; i < this->directories.size(); i++)
+					if (this->directories[i]->descriptor == event->wd)
+						directory = this->directories[i]->path;
+			}
+			if (!directory.empty())
+				changed(directory, event->name);
+		}
+	}
+}
+#endif
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Reports writes to a set of files. The directories holding them are watched on a background thread, with inotify
+// on linux and ReadDirectoryChangesW on windows, so nothing is polled on disk. A change is reported once the file
+// stayed untouched for SETTLE_MS, which folds the several events of one save into a single change.
+class FileWatcher
+{
+public:
+	// quiet time before a change is reported
+	static const int SETTLE_MS = 30;
+
+	FileWatcher();
+	// stops the watching thread
+	~FileWatcher();
+
+	// reports changes of the file at path from now on. Watching a file twice has no effect.
+	void watch(const std::string &path);
+
+	// files changed since the last call, each once and spelled as they were given to watch
+	std::vector<std::string> poll();
+
+private:
+	FileWatcher(const FileWatcher&) = delete;
+	FileWatcher& operator=(const FileWatcher&) = delete;
+
+	// watched directory, defined per platform
+	struct Directory;
+
+	// waits for directory events and records the changes of watched files
+	void watchLoop();
+	// marks a file of a directory as changed if it is watched
+	void changed(const std::string &directory, const std::string &name);
+
+	std::mutex mutex;
+	std::unordered_map<std::string, std::string> files;		// canonical path -> path as watched
+	std::unordered_map<std::string, std::chrono::steady_clock::time_point> changes;	// canonical path -> last change
+	std::vector<Directory*> directories;
+	std::thread thread;
+	std::atomic<bool> stopping;
+	// inotify descriptor on linux, event waking the thread on windows
+	void* handle;
+};
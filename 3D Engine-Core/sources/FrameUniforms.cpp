@@ -0,0 +1,50 @@
+#include "FrameUniforms.h"
+#include "GLState.h"
+
+#include <cstddef>
+#include <cstring>
+
+const char* uniformBlockName(UniformBlockBinding binding)
+{
+	switch (binding)
+	{
+	case UNIFORM_BLOCK_CAMERA:
+		return "Camera";
+	case UNIFORM_BLOCK_LIGHTS:
+		return "Lights";
+	}
+	return "";
+}
+
+FrameUniforms::FrameUniforms()
+{
+	this->camera = CameraUniforms();
+	this->lights = LightUniforms();
+
+	GLint alignment = 256;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	this->offsetAlignment = static_cast<size_t>(alignment > 0 ? alignment : 256);
+}
+
+void FrameUniforms::update(StreamBuffer &stream)
+{
+	GLuint buffer;
+	size_t offset;
+	void *data = stream.allocate(sizeof(CameraUniforms), this->offsetAlignment, buffer, offset);
+	if (data)
+	{
+		std::memcpy(data, &this->camera, sizeof(CameraUniforms));
+		GLState::bindBufferRange(GL_UNIFORM_BUFFER, UNIFORM_BLOCK_CAMERA, buffer, offset, sizeof(CameraUniforms));
+	}
+
+	// only the lights in use, the count is at the end of the block
+	const int count = glm::clamp(this->lights.pointLightCount.x, 0, MAX_POINT_LIGHTS);
+	char *lightData = static_cast<char*>(stream.allocate(sizeof(LightUniforms), this->offsetAlignment, buffer, offset));
+	if (lightData)
+	{
+		if (count > 0)
+			std::memcpy(lightData, this->lights.pointLights, count * sizeof(PointLightUniforms));
+		std::memcpy(lightData + offsetof(LightUniforms, pointLightCount), &this->lights.pointLightCount, sizeof(glm::ivec4));
+		GLState::bindBufferRange(GL_UNIFORM_BUFFER, UNIFORM_BLOCK_LIGHTS, buffer, offset, sizeof(LightUniforms));
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "StreamBuffer.h"
+
+// Binding points of the uniform blocks every program shares. Shader binds the blocks it declares by name after
+// linking, GLSL 3.30 has no binding layout qualifier for them.
+enum UniformBlockBinding
+{
+	UNIFORM_BLOCK_CAMERA = 0,
+	UNIFORM_BLOCK_LIGHTS = 1
+};
+
+// block name of a binding point, as declared in the shaders
+const char* uniformBlockName(UniformBlockBinding binding);
+
+static const int MAX_POINT_LIGHTS = 8;
+
+// std140 layouts of the blocks in resources/shaders. vec3 members take a whole vec4 in std140, so they are
+// stored as vec4 here and the shaders read .xyz.
+struct CameraUniforms
+{
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::vec4 viewPosition;
+};
+
+struct PointLightUniforms
+{
+	glm::vec4 position;
+	glm::vec4 color;
+	glm::vec4 ambient;
+	glm::vec4 diffuse;
+	glm::vec4 specular;
+	// constant, linear and quadratic terms
+	glm::vec4 attenuation;
+};
+
+struct LightUniforms
+{
+	PointLightUniforms pointLights[MAX_POINT_LIGHTS];
+	glm::ivec4 pointLightCount;
+};
+
+static_assert(sizeof(CameraUniforms) == 144, "CameraUniforms must match the std140 Camera block");
+static_assert(sizeof(LightUniforms) == MAX_POINT_LIGHTS * 96 + 16, "LightUniforms must match the std140 Lights block");
+
+// Uniform blocks of the data that changes once per frame, shared by all programs: the camera matrices and
+// position and the point lights. They are written once per frame into the StreamBuffer and bound at their
+// binding points for the whole frame, so drawing with another program needs no uniform updates. GL thread only.
+class FrameUniforms
+{
+public:
+	FrameUniforms();
+
+	CameraUniforms camera;
+	LightUniforms lights;
+
+	// writes camera and lights to the frame's range of stream and binds the ranges
+	void update(StreamBuffer &stream);
+
+private:
+	FrameUniforms(const FrameUniforms&) = delete;
+	FrameUniforms& operator=(const FrameUniforms&) = delete;
+
+	// GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, the ranges bound to blocks start at multiples of it
+	size_t offsetAlignment;
+};
@@ -0,0 +1,40 @@
+#include "Frustum.h"
+
+Frustum::Frustum()
+{
+	for (int i = 0; i < 6; i++)
+		this->planes[i] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+Frustum::Frustum(const glm::mat4 &matrix)
+{
+	// rows of the matrix, glm is column major
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+		rows[i] = glm::vec4(matrix[0][i], matrix[1][i], matrix[2][i], matrix[3][i]);
+
+	// -w <= x, y, z <= w in clip space
+	this->planes[0] = rows[3] + rows[0];
+	this->planes[1] = rows[3] - rows[0];
+	this->planes[2] = rows[3] + rows[1];
+	this->planes[3] = rows[3] - rows[1];
+	this->planes[4] = rows[3] + rows[2];
+	this->planes[5] = rows[3] - rows[2];
+
+	for (int i = 0; i < 6; i++)
+	{
+		float length = glm::length(glm::vec3(this->planes[i]));
+		if (length > 0.0f)
+			this->planes[i] /= length;
+	}
+}
+
+bool Frustum::intersectsSphere(const glm::vec3 &center, float radius) const
+{
+	for (int i = 0; i < 6; i++)
+	{
+		if (glm::dot(glm::vec3(this->planes[i]), center) + this->planes[i].w < -radius)
+			return false;
+	}
+	return true;
+}
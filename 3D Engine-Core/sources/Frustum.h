@@ -0,0 +1,18 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// The six clip planes of a view projection matrix. Planes taken from projection * view * model are in the
+// object space of the model, so object space bounds are tested without transforming them.
+class Frustum
+{
+public:
+	// left, right, bottom, top, near, far. Normalized and pointing inside: dot(plane.xyz, p) + plane.w >= 0 inside
+	glm::vec4 planes[6];
+
+	Frustum();
+	explicit Frustum(const glm::mat4 &matrix);
+
+	// false if the sphere is completely outside one of the planes
+	bool intersectsSphere(const glm::vec3 &center, float radius) const;
+};
@@ -0,0 +1,113 @@
+#include "FrustumCuller.h"
+
+#if defined(__AVX__)
+#define FRUSTUM_CULLER_AVX
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRUSTUM_CULLER_SSE
+#include <emmintrin.h>
+#endif
+
+void FrustumCuller::clear()
+{
+	this->centerX.clear();
+	this->centerY.clear();
+	this->centerZ.clear();
+	this->radius.clear();
+	this->extentX.clear();
+	this->extentY.clear();
+	this->extentZ.clear();
+}
+
+void FrustumCuller::add(const Mesh &mesh, const glm::mat4 &transform)
+{
+	glm::vec3 center, extent;
+	float sphereRadius;
+	mesh.worldBounds(transform, center, extent, sphereRadius);
+
+	this->centerX.push_back(center.x);
+	this->centerY.push_back(center.y);
+	this->centerZ.push_back(center.z);
+	this->radius.push_back(sphereRadius);
+	this->extentX.push_back(extent.x);
+	this->extentY.push_back(extent.y);
+	this->extentZ.push_back(extent.z);
+}
+
+void FrustumCuller::cullRange(const Frustum &frustum, size_t first, size_t last)
+{
+	for (size_t i = first; i < last; i++)
+	{
+		bool inside = true;
+		for (int p = 0; p < 6 && inside; p++)
+		{
+			const glm::vec4 &plane = frustum.planes[p];
+			float distance = plane.x * this->centerX[i] + plane.y * this->centerY[i] + plane.z * this->centerZ[i] + plane.w;
+			// how far the box reaches towards the plane, the tighter of box and sphere decides
+			float boxReach = glm::abs(plane.x) * this->extentX[i] + glm::abs(plane.y) * this->extentY[i] + glm::abs(plane.z) * this->extentZ[i];
+			inside = distance + glm::min(boxReach, this->radius[i]) >= 0.0f;
+		}
+		this->visible[i] = inside;
+	}
+}
+
+unsigned int FrustumCuller::cull(const Frustum &frustum)
+{
+	const size_t count = this->radius.size();
+	this->visible.resize(count);
+	size_t i = 0;
+
+#if defined(FRUSTUM_CULLER_AVX)
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 cx = _mm256_loadu_ps(&this->centerX[i]), cy = _mm256_loadu_ps(&this->centerY[i]), cz = _mm256_loadu_ps(&this->centerZ[i]);
+		__m256 r = _mm256_loadu_ps(&this->radius[i]);
+		__m256 ex = _mm256_loadu_ps(&this->extentX[i]), ey = _mm256_loadu_ps(&this->extentY[i]), ez = _mm256_loadu_ps(&this->extentZ[i]);
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (int p = 0; p < 6; p++)
+		{
+			const glm::vec4 &plane = frustum.planes[p];
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.x), cx), _mm256_mul_ps(_mm256_set1_ps(plane.y), cy)),
+				_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.z), cz), _mm256_set1_ps(plane.w)));
+			__m256 boxReach = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(glm::abs(plane.x)), ex), _mm256_mul_ps(_mm256_set1_ps(glm::abs(plane.y)), ey)),
+				_mm256_mul_ps(_mm256_set1_ps(glm::abs(plane.z)), ez));
+			__m256 reach = _mm256_min_ps(boxReach, r);
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, reach), _mm256_setzero_ps(), _CMP_GE_OQ));
+		}
+		int mask = _mm256_movemask_ps(inside);
+		for (int j = 0; j < 8; j++)
+			this->visible[i + j] = (mask >> j) & 1;
+	}
+#elif defined(FRUSTUM_CULLER_SSE)
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 cx = _mm_loadu_ps(&this->centerX[i]), cy = _mm_loadu_ps(&this->centerY[i]), cz = _mm_loadu_ps(&this->centerZ[i]);
+		__m128 r = _mm_loadu_ps(&this->radius[i]);
+		__m128 ex = _mm_loadu_ps(&this->extentX[i]), ey = _mm_loadu_ps(&this->extentY[i]), ez = _mm_loadu_ps(&this->extentZ[i]);
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int p = 0; p < 6; p++)
+		{
+			const glm::vec4 &plane = frustum.planes[p];
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), cx), _mm_mul_ps(_mm_set1_ps(plane.y), cy)),
+				_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), cz), _mm_set1_ps(plane.w)));
+			__m128 boxReach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(glm::abs(plane.x)), ex), _mm_mul_ps(_mm_set1_ps(glm::abs(plane.y)), ey)),
+				_mm_mul_ps(_mm_set1_ps(glm::abs(plane.z)), ez));
+			__m128 reach = _mm_min_ps(boxReach, r);
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, reach), _mm_setzero_ps()));
+		}
+		int mask = _mm_movemask_ps(inside);
+		for (int j = 0; j < 4; j++)
+			this->visible[i + j] = (mask >> j) & 1;
+	}
+#endif
+	// the meshes left over from the last full batch
+	cullRange(frustum, i, count);
+
+	unsigned int culled = 0;
+	for (i = 0; i < count; i++)
+	{
+		if (!this->visible[i])
+			culled++;
+	}
+	return culled;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "Frustum.h"
+#include "Mesh.h"
+
+#include <vector>
+
+// Frustum culling of whole meshes over the bounds of a frame kept as a structure of arrays, one array per
+// component, so the planes are tested against 8 meshes at a time with AVX, 4 with SSE or one by one without either.
+// A mesh is culled when its bounding sphere or its bounding box is completely outside one of the planes.
+class FrustumCuller
+{
+public:
+	// forgets the meshes of the last frame
+	void clear();
+
+	// adds the bounds of a mesh moved by the model matrix transform, in world space
+	void add(const Mesh &mesh, const glm::mat4 &transform);
+
+	// tests all added meshes against the frustum. Returns the number culled.
+	unsigned int cull(const Frustum &frustum);
+
+	// result of cull for the mesh added index-th
+	bool isVisible(size_t index) const { return this->visible[index] != 0; }
+
+	size_t size() const { return this->radius.size(); }
+
+private:
+	// sets visible for the meshes first to last - 1, without SIMD
+	void cullRange(const Frustum &frustum, size_t first, size_t last);
+
+	// the sphere and the box share the center, the box is given by its half extents
+	std::vector<float> centerX, centerY, centerZ;
+	std::vector<float> radius;
+	std::vector<float> extentX, extentY, extentZ;
+	std::vector<unsigned char> visible;
+};
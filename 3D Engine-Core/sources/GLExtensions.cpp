@@ -0,0 +1,56 @@
+#include "GLExtensions.h"
+
+#include <cstring>
+#include <iostream>
+
+bool GLExtensions::textureCompressionS3TC = false;
+bool GLExtensions::textureCompressionBPTC = false;
+bool GLExtensions::multiDrawIndirect = false;
+MultiDrawElementsIndirectProc GLExtensions::glMultiDrawElementsIndirect = nullptr;
+bool GLExtensions::bufferStorage = false;
+BufferStorageProc GLExtensions::glBufferStorage = nullptr;
+
+bool GLExtensions::supported(const char *name)
+{
+	// core profiles only list extensions one by one
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; i++)
+	{
+		const char *extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+		if (extension && strcmp(extension, name) == 0)
+			return true;
+	}
+	return false;
+}
+
+void GLExtensions::load(GLADloadproc getProcAddress)
+{
+	GLint major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	const bool gl43 = major > 4 || (major == 4 && minor >= 3);
+	const bool gl44 = major > 4 || (major == 4 && minor >= 4);
+
+	textureCompressionS3TC = supported("GL_EXT_texture_compression_s3tc");
+	textureCompressionBPTC = supported("GL_ARB_texture_compression_bptc");
+
+	// the extensions are often exposed on 3.3 contexts too, the ARB entry points have the core names
+	multiDrawIndirect = gl43 || (supported("GL_ARB_multi_draw_indirect") && supported("GL_ARB_base_instance"));
+	if (multiDrawIndirect)
+	{
+		glMultiDrawElementsIndirect = reinterpret_cast<MultiDrawElementsIndirectProc>(getProcAddress("glMultiDrawElementsIndirect"));
+		multiDrawIndirect = glMultiDrawElementsIndirect != nullptr;
+	}
+	bufferStorage = gl44 || supported("GL_ARB_buffer_storage");
+	if (bufferStorage)
+	{
+		glBufferStorage = reinterpret_cast<BufferStorageProc>(getProcAddress("glBufferStorage"));
+		bufferStorage = glBufferStorage != nullptr;
+	}
+
+	std::cout << "GL_EXTENSIONS:: S3TC " << (textureCompressionS3TC ? "yes" : "no")
+		<< ", BPTC " << (textureCompressionBPTC ? "yes" : "no")
+		<< ", multi draw indirect " << (multiDrawIndirect ? "yes" : "no")
+		<< ", buffer storage " << (bufferStorage ? "yes" : "no") << std::endl;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <glad/glad.h>
+
+// enums of the extensions used on top of the GL 3.3 core loader
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+// entry points above GL 3.3, loaded by load() when the context offers them
+typedef void (APIENTRYP MultiDrawElementsIndirectProc)(GLenum mode, GLenum type, const void *indirect, GLsizei drawcount, GLsizei stride);
+typedef void (APIENTRYP BufferStorageProc)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+
+// Extensions queried once after GLAD is loaded. The flags are only written by load(), or set up front by a tool
+// cooking assets without a context, so worker threads may read them afterwards.
+class GLExtensions
+{
+public:
+	// GL_EXT_texture_compression_s3tc: BC1 and BC3
+	static bool textureCompressionS3TC;
+	// GL_ARB_texture_compression_bptc: BC7
+	static bool textureCompressionBPTC;
+	// GL 4.3, or GL_ARB_multi_draw_indirect with GL_ARB_base_instance: glMultiDrawElementsIndirect
+	// with the baseInstance of the commands offsetting the instanced attributes
+	static bool multiDrawIndirect;
+	static MultiDrawElementsIndirectProc glMultiDrawElementsIndirect;
+	// GL 4.4 or GL_ARB_buffer_storage: immutable buffers that stay mapped while the GPU reads them
+	static bool bufferStorage;
+	static BufferStorageProc glBufferStorage;
+
+	// reads the version and extension string of the current context and loads the entry points of the
+	// supported ones through getProcAddress, GL thread only
+	static void load(GLADloadproc getProcAddress);
+
+	// true if the current context lists name, GL thread only
+	static bool supported(const char *name);
+};
@@ -0,0 +1,269 @@
+#include "GLState.h"
+#include "GLExtensions.h"
+
+// value of every shadowed field while GL's is not known
+static const GLuint UNKNOWN = ~0u;
+
+GLuint GLState::program = UNKNOWN;
+GLuint GLState::vertexArray = UNKNOWN;
+GLuint GLState::buffers[5] = { UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN };
+GLuint GLState::uniformBuffers[MAX_UNIFORM_BUFFER_BINDINGS];
+GLintptr GLState::uniformOffsets[MAX_UNIFORM_BUFFER_BINDINGS];
+GLsizeiptr GLState::uniformSizes[MAX_UNIFORM_BUFFER_BINDINGS];
+unsigned int GLState::activeUnit = UNKNOWN;
+GLuint GLState::textures[MAX_TEXTURE_UNITS][2];
+GLuint GLState::capabilities[3] = { UNKNOWN, UNKNOWN, UNKNOWN };
+GLenum GLState::depthFunction = UNKNOWN;
+GLenum GLState::blendSource = UNKNOWN;
+GLenum GLState::blendDestination = UNKNOWN;
+
+unsigned int GLState::issued = 0;
+unsigned int GLState::saved = 0;
+unsigned int GLState::lastIssued = 0;
+unsigned int GLState::lastSaved = 0;
+
+// the tables above are sized for these
+int GLState::capabilityIndex(GLenum capability)
+{
+	switch (capability)
+	{
+	case GL_DEPTH_TEST: return 0;
+	case GL_BLEND: return 1;
+	case GL_CULL_FACE: return 2;
+	}
+	return -1;
+}
+
+int GLState::bufferIndex(GLenum target)
+{
+	switch (target)
+	{
+	case GL_ARRAY_BUFFER: return 0;
+	case GL_COPY_READ_BUFFER: return 1;
+	case GL_COPY_WRITE_BUFFER: return 2;
+	case GL_UNIFORM_BUFFER: return 3;
+	case GL_DRAW_INDIRECT_BUFFER: return 4;
+	}
+	return -1;
+}
+
+int GLState::textureIndex(GLenum target)
+{
+	switch (target)
+	{
+	case GL_TEXTURE_2D: return 0;
+	case GL_TEXTURE_CUBE_MAP: return 1;
+	}
+	return -1;
+}
+
+template <typename T>
+bool GLState::change(T &current, T value)
+{
+	if (current == value)
+	{
+		saved++;
+		return false;
+	}
+	current = value;
+	issued++;
+	return true;
+}
+
+void GLState::useProgram(GLuint program)
+{
+	if (change(GLState::program, program))
+		glUseProgram(program);
+}
+
+void GLState::bindVertexArray(GLuint vertexArray)
+{
+	if (change(GLState::vertexArray, vertexArray))
+		glBindVertexArray(vertexArray);
+}
+
+void GLState::bindBuffer(GLenum target, GLuint buffer)
+{
+	int index = bufferIndex(target);
+	if (index < 0)
+	{
+		issued++;
+		glBindBuffer(target, buffer);
+		return;
+	}
+	if (change(buffers[index], buffer))
+		glBindBuffer(target, buffer);
+}
+
+void GLState::bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	if (target == GL_UNIFORM_BUFFER && index < MAX_UNIFORM_BUFFER_BINDINGS
+		&& uniformBuffers[index] == buffer && uniformOffsets[index] == offset && uniformSizes[index] == size)
+	{
+		saved++;
+		return;
+	}
+	if (target == GL_UNIFORM_BUFFER && index < MAX_UNIFORM_BUFFER_BINDINGS)
+	{
+		uniformBuffers[index] = buffer;
+		uniformOffsets[index] = offset;
+		uniformSizes[index] = size;
+	}
+	// the generic binding of the target changes along
+	int generic = bufferIndex(target);
+	if (generic >= 0)
+		buffers[generic] = buffer;
+	issued++;
+	glBindBufferRange(target, index, buffer, offset, size);
+}
+
+void GLState::activeTexture(unsigned int unit)
+{
+	if (change(activeUnit, unit))
+		glActiveTexture(GL_TEXTURE0 + unit);
+}
+
+void GLState::bindTexture(GLenum target, GLuint texture)
+{
+	int index = textureIndex(target);
+	if (index < 0 || activeUnit >= MAX_TEXTURE_UNITS)
+	{
+		issued++;
+		glBindTexture(target, texture);
+		return;
+	}
+	if (change(textures[activeUnit][index], texture))
+		glBindTexture(target, texture);
+}
+
+void GLState::bindTexture(unsigned int unit, GLenum target, GLuint texture)
+{
+	int index = textureIndex(target);
+	if (index >= 0 && unit < MAX_TEXTURE_UNITS && textures[unit][index] == texture)
+	{
+		saved++;
+		return;
+	}
+	activeTexture(unit);
+	bindTexture(target, texture);
+}
+
+void GLState::enable(GLenum capability)
+{
+	int index = capabilityIndex(capability);
+	if (index < 0)
+	{
+		issued++;
+		glEnable(capability);
+	}
+	else if (change(capabilities[index], 1u))
+		glEnable(capability);
+}
+
+void GLState::disable(GLenum capability)
+{
+	int index = capabilityIndex(capability);
+	if (index < 0)
+	{
+		issued++;
+		glDisable(capability);
+	}
+	else if (change(capabilities[index], 0u))
+		glDisable(capability);
+}
+
+void GLState::depthFunc(GLenum function)
+{
+	if (change(depthFunction, function))
+		glDepthFunc(function);
+}
+
+void GLState::blendFunc(GLenum source, GLenum destination)
+{
+	if (blendSource == source && blendDestination == destination)
+	{
+		saved++;
+		return;
+	}
+	blendSource = source;
+	blendDestination = destination;
+	issued++;
+	glBlendFunc(source, destination);
+}
+
+void GLState::deleteProgram(GLuint program)
+{
+	if (GLState::program == program)
+		GLState::program = UNKNOWN;
+	glDeleteProgram(program);
+}
+
+void GLState::deleteVertexArrays(GLsizei count, const GLuint *vertexArrays)
+{
+	for (GLsizei i = 0; i < count; i++)
+	{
+		if (vertexArray == vertexArrays[i])
+			vertexArray = UNKNOWN;
+	}
+	glDeleteVertexArrays(count, vertexArrays);
+}
+
+void GLState::deleteBuffers(GLsizei count, const GLuint *names)
+{
+	for (GLsizei i = 0; i < count; i++)
+	{
+		for (unsigned int b = 0; b < sizeof(buffers) / sizeof(buffers[0]); b++)
+		{
+			if (buffers[b] == names[i])
+				buffers[b] = UNKNOWN;
+		}
+		for (unsigned int b = 0; b < MAX_UNIFORM_BUFFER_BINDINGS; b++)
+		{
+			if (uniformBuffers[b] == names[i])
+				uniformBuffers[b] = UNKNOWN;
+		}
+	}
+	glDeleteBuffers(count, names);
+}
+
+void GLState::deleteTextures(GLsizei count, const GLuint *names)
+{
+	for (GLsizei i = 0; i < count; i++)
+	{
+		for (unsigned int unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+		{
+			for (unsigned int t = 0; t < 2; t++)
+			{
+				if (textures[unit][t] == names[i])
+					textures[unit][t] = UNKNOWN;
+			}
+		}
+	}
+	glDeleteTextures(count, names);
+}
+
+void GLState::invalidate()
+{
+	program = UNKNOWN;
+	vertexArray = UNKNOWN;
+	for (unsigned int b = 0; b < sizeof(buffers) / sizeof(buffers[0]); b++)
+		buffers[b] = UNKNOWN;
+	for (unsigned int b = 0; b < MAX_UNIFORM_BUFFER_BINDINGS; b++)
+		uniformBuffers[b] = UNKNOWN;
+	activeUnit = UNKNOWN;
+	for (unsigned int unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+		textures[unit][0] = textures[unit][1] = UNKNOWN;
+	for (unsigned int c = 0; c < sizeof(capabilities) / sizeof(capabilities[0]); c++)
+		capabilities[c] = UNKNOWN;
+	depthFunction = UNKNOWN;
+	blendSource = UNKNOWN;
+	blendDestination = UNKNOWN;
+}
+
+void GLState::endFrame()
+{
+	lastIssued = issued;
+	lastSaved = saved;
+	issued = 0;
+	saved = 0;
+}
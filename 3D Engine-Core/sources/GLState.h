@@ -0,0 +1,74 @@
+#pragma once
+
+#include <glad/glad.h>
+
+// Shadow of the GL state the engine changes: program, vertex array, buffers per target, uniform buffer ranges,
+// textures per unit, the enabled capabilities, depth and blend functions. Every engine call changing that state
+// goes through here, and calls that would set what is already set are skipped and counted.
+// invalidate once the context is current makes the first call of each kind reach GL, and is called again
+// after code that changes the state behind its back. Objects have to be deleted through here as well, GL
+// unbinds them and their names get reused. GL thread only.
+class GLState
+{
+public:
+	static const unsigned int MAX_TEXTURE_UNITS = 16;
+	static const unsigned int MAX_UNIFORM_BUFFER_BINDINGS = 8;
+
+	static void useProgram(GLuint program);
+	static void bindVertexArray(GLuint vertexArray);
+	// GL_ELEMENT_ARRAY_BUFFER belongs to the bound vertex array and is always passed through
+	static void bindBuffer(GLenum target, GLuint buffer);
+	static void bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+
+	static void activeTexture(unsigned int unit);
+	// binds to the active unit
+	static void bindTexture(GLenum target, GLuint texture);
+	// binds to unit, only switching the active unit when the binding changes
+	static void bindTexture(unsigned int unit, GLenum target, GLuint texture);
+
+	static void enable(GLenum capability);
+	static void disable(GLenum capability);
+	static void depthFunc(GLenum function);
+	static void blendFunc(GLenum source, GLenum destination);
+
+	static void deleteProgram(GLuint program);
+	static void deleteVertexArrays(GLsizei count, const GLuint *vertexArrays);
+	static void deleteBuffers(GLsizei count, const GLuint *buffers);
+	static void deleteTextures(GLsizei count, const GLuint *textures);
+
+	// forgets the shadowed state, the next call of each kind reaches GL
+	static void invalidate();
+
+	// moves the counts of the frame to the ones shown, call once per frame
+	static void endFrame();
+	// calls of the last frame that reached GL and that were skipped
+	static unsigned int issuedCalls() { return lastIssued; }
+	static unsigned int savedCalls() { return lastSaved; }
+
+private:
+	// false and counted as saved when value already is current, else sets it and counts the call
+	template <typename T>
+	static bool change(T &current, T value);
+
+	static int capabilityIndex(GLenum capability);
+	static int bufferIndex(GLenum target);
+	static int textureIndex(GLenum target);
+
+	static GLuint program;
+	static GLuint vertexArray;
+	static GLuint buffers[5];
+	static GLuint uniformBuffers[MAX_UNIFORM_BUFFER_BINDINGS];
+	static GLintptr uniformOffsets[MAX_UNIFORM_BUFFER_BINDINGS];
+	static GLsizeiptr uniformSizes[MAX_UNIFORM_BUFFER_BINDINGS];
+	static unsigned int activeUnit;
+	static GLuint textures[MAX_TEXTURE_UNITS][2];
+	static GLuint capabilities[3];
+	static GLenum depthFunction;
+	static GLenum blendSource;
+	static GLenum blendDestination;
+
+	static unsigned int issued;
+	static unsigned int saved;
+	static unsigned int lastIssued;
+	static unsigned int lastSaved;
+};
@@ -0,0 +1,395 @@
+#include "GeometryHeap.h"
+#include "GLState.h"
+
+#include "Mesh.h"
+
+#include <algorithm>
+
+RangeAllocator::RangeAllocator(size_t capacity)
+	: total(0), allocated(0)
+{
+	reset(capacity, 0);
+}
+
+bool RangeAllocator::allocate(size_t size, size_t alignment, size_t &offset)
+{
+	if (size == 0)
+	{
+		offset = 0;
+		return true;
+	}
+
+	for (std::map<size_t, size_t>::iterator it = this->freeRanges.begin(); it != this->freeRanges.end(); ++it)
+	{
+		size_t rangeStart = it->first;
+		size_t rangeEnd = it->first + it->second;
+		size_t start = (rangeStart + alignment - 1) / alignment * alignment;
+		if (start + size > rangeEnd)
+			continue;
+
+		// keep what is left on both sides of the allocation
+		this->freeRanges.erase(it);
+		if (start > rangeStart)
+			this->freeRanges[rangeStart] = start - rangeStart;
+		if (start + size < rangeEnd)
+			this->freeRanges[start + size] = rangeEnd - start - size;
+
+		this->allocated += size;
+		offset = start;
+		return true;
+	}
+	return false;
+}
+
+void RangeAllocator::release(size_t offset, size_t size)
+{
+	if (size == 0)
+		return;
+
+	this->allocated -= size;
+
+	std::map<size_t, size_t>::iterator next = this->freeRanges.lower_bound(offset);
+	// merge with the following free range
+	if (next != this->freeRanges.end() && offset + size == next->first)
+	{
+		size += next->second;
+		next = this->freeRanges.erase(next);
+	}
+	// merge with the preceding free range
+	if (next != this->freeRanges.begin())
+	{
+		std::map<size_t, size_t>::iterator previous = next;
+		--previous;
+		if (previous->first + previous->second == offset)
+		{
+			previous->second += size;
+			return;
+		}
+	}
+	this->freeRanges[offset] = size;
+}
+
+void RangeAllocator::grow(size_t capacity)
+{
+	if (capacity <= this->total)
+		return;
+
+	size_t added = capacity - this->total;
+	size_t offset = this->total;
+	this->total = capacity;
+	// the new space is handed in like a released range, so it joins a free range at the old end
+	this->allocated += added;
+	release(offset, added);
+}
+
+void RangeAllocator::reset(size_t capacity, size_t used)
+{
+	this->freeRanges.clear();
+	if (used < capacity)
+		this->freeRanges[used] = capacity - used;
+	this->total = capacity;
+	this->allocated = used;
+}
+
+size_t RangeAllocator::highWater() const
+{
+	if (this->freeRanges.empty())
+		return this->total;
+
+	std::map<size_t, size_t>::const_reverse_iterator last = this->freeRanges.rbegin();
+	if (last->first + last->second == this->total)
+		return last->first;
+	return this->total;
+}
+
+static GeometryHeap* heaps[VERTEX_FORMAT_COUNT] = {};
+
+GeometryHeap& GeometryHeap::shared(VertexFormat format)
+{
+	if (heaps[format] == nullptr)
+		heaps[format] = new GeometryHeap(format);
+	return *heaps[format];
+}
+
+void GeometryHeap::destroyAll()
+{
+	for (int i = 0; i < VERTEX_FORMAT_COUNT; i++)
+	{
+		if (heaps[i] == nullptr)
+			continue;
+		heaps[i]->destroy();
+		delete heaps[i];
+		heaps[i] = nullptr;
+	}
+}
+
+void GeometryHeap::compactAll(float threshold)
+{
+	for (int i = 0; i < VERTEX_FORMAT_COUNT; i++)
+	{
+		if (heaps[i] != nullptr && heaps[i]->fragmentation() > threshold)
+			heaps[i]->defragment();
+	}
+}
+
+GeometryHeap::GeometryHeap(VertexFormat format)
+	: format(format), VAO(0), VBO(0), EBO(0)
+{
+	this->stride = format == VERTEX_FORMAT_PACKED ? sizeof(PackedVertex) : sizeof(Vertex);
+	create(INITIAL_VERTICES, INITIAL_INDEX_BYTES);
+}
+
+void GeometryHeap::create(size_t vertexCapacity, size_t indexCapacity)
+{
+	glGenVertexArrays(1, &this->VAO);
+	glGenBuffers(1, &this->VBO);
+	glGenBuffers(1, &this->EBO);
+
+	GLState::bindVertexArray(this->VAO);
+
+	GLState::bindBuffer(GL_ARRAY_BUFFER, this->VBO);
+	glBufferData(GL_ARRAY_BUFFER, vertexCapacity * this->stride, NULL, GL_STATIC_DRAW);
+	setupAttributes();
+
+	GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCapacity, NULL, GL_STATIC_DRAW);
+
+	GLState::bindVertexArray(0);
+
+	this->vertexRanges.reset(vertexCapacity, 0);
+	this->indexRanges.reset(indexCapacity, 0);
+}
+
+void GeometryHeap::destroy()
+{
+	GLState::deleteVertexArrays(1, &this->VAO);
+	GLState::deleteBuffers(1, &this->VBO);
+	GLState::deleteBuffers(1, &this->EBO);
+	this->VAO = this->VBO = this->EBO = 0;
+}
+
+void GeometryHeap::setupAttributes()
+{
+	// expects the VAO and the vertex buffer to be bound
+	if (this->format == VERTEX_FORMAT_PACKED)
+	{
+		// Vertex positions and bitangent sign
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 4, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Position));
+
+		// Vertex normals
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Normal));
+
+		// Vertex texture coords
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, TexCoords));
+
+		// Vertex tangent
+		glEnableVertexAttribArray(3);
+		glVertexAttribPointer(3, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Tangent));
+		return;
+	}
+
+	// Vertex Positions
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+
+	// Vertex normals
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+
+	// Vertex texture coords
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+
+	// Vertex tangent
+	glEnableVertexAttribArray(3);
+	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+
+	// Vertex bitangent
+	glEnableVertexAttribArray(4);
+	glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+}
+
+// creates a buffer of newBytes holding the first copyBytes of buffer, and deletes buffer
+static unsigned int copyToNewBuffer(unsigned int buffer, size_t copyBytes, size_t newBytes)
+{
+	unsigned int grown;
+	glGenBuffers(1, &grown);
+	GLState::bindBuffer(GL_COPY_WRITE_BUFFER, grown);
+	glBufferData(GL_COPY_WRITE_BUFFER, newBytes, NULL, GL_STATIC_DRAW);
+
+	if (copyBytes > 0)
+	{
+		GLState::bindBuffer(GL_COPY_READ_BUFFER, buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, copyBytes);
+	}
+
+	GLState::deleteBuffers(1, &buffer);
+	return grown;
+}
+
+void GeometryHeap::growVertices(size_t vertexCapacity)
+{
+	this->VBO = copyToNewBuffer(this->VBO, this->vertexRanges.highWater() * this->stride, vertexCapacity * this->stride);
+	this->vertexRanges.grow(vertexCapacity);
+
+	// the VAO still points at the deleted buffer
+	GLState::bindVertexArray(this->VAO);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, this->VBO);
+	setupAttributes();
+	GLState::bindVertexArray(0);
+}
+
+void GeometryHeap::growIndices(size_t indexCapacity)
+{
+	this->EBO = copyToNewBuffer(this->EBO, this->indexRanges.highWater(), indexCapacity);
+	this->indexRanges.grow(indexCapacity);
+
+	GLState::bindVertexArray(this->VAO);
+	GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+	GLState::bindVertexArray(0);
+}
+
+unsigned int GeometryHeap::allocate(const void *vertices, size_t vertexCount, const void *indices, size_t indexBytes)
+{
+	Allocation allocation;
+	allocation.vertexCount = vertexCount;
+	// index ranges are whole multiples of the alignment, so released ranges merge without gaps
+	allocation.indexBytes = (indexBytes + INDEX_ALIGNMENT - 1) / INDEX_ALIGNMENT * INDEX_ALIGNMENT;
+
+	if (!this->vertexRanges.allocate(vertexCount, 1, allocation.firstVertex))
+	{
+		size_t capacity = this->vertexRanges.capacity();
+		growVertices(std::max(capacity * 2, capacity + vertexCount));
+		this->vertexRanges.allocate(vertexCount, 1, allocation.firstVertex);
+	}
+	if (!this->indexRanges.allocate(allocation.indexBytes, INDEX_ALIGNMENT, allocation.indexOffset))
+	{
+		size_t capacity = this->indexRanges.capacity();
+		growIndices(std::max(capacity * 2, capacity + allocation.indexBytes));
+		this->indexRanges.allocate(allocation.indexBytes, INDEX_ALIGNMENT, allocation.indexOffset);
+	}
+
+	// upload through the copy targets, so the element buffer binding of whatever VAO is bound stays untouched
+	if (vertexCount > 0)
+	{
+		GLState::bindBuffer(GL_COPY_WRITE_BUFFER, this->VBO);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.firstVertex * this->stride, vertexCount * this->stride, vertices);
+	}
+	if (indexBytes > 0)
+	{
+		GLState::bindBuffer(GL_COPY_WRITE_BUFFER, this->EBO);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.indexOffset, indexBytes, indices);
+	}
+
+	unsigned int handle;
+	if (!this->freeHandles.empty())
+	{
+		handle = this->freeHandles.back();
+		this->freeHandles.pop_back();
+		this->allocations[handle] = allocation;
+		this->live[handle] = true;
+	}
+	else
+	{
+		handle = static_cast<unsigned int>(this->allocations.size());
+		this->allocations.push_back(allocation);
+		this->live.push_back(true);
+	}
+	return handle;
+}
+
+void GeometryHeap::release(unsigned int handle)
+{
+	if (handle >= this->allocations.size() || !this->live[handle])
+		return;
+
+	const Allocation &allocation = this->allocations[handle];
+	this->vertexRanges.release(allocation.firstVertex, allocation.vertexCount);
+	this->indexRanges.release(allocation.indexOffset, allocation.indexBytes);
+
+	this->live[handle] = false;
+	this->freeHandles.push_back(handle);
+}
+
+void GeometryHeap::bind() const
+{
+	GLState::bindVertexArray(this->VAO);
+}
+
+void GeometryHeap::defragment()
+{
+	const size_t vertexCapacity = this->vertexRanges.capacity();
+	const size_t indexCapacity = this->indexRanges.capacity();
+
+	unsigned int vertexBuffer, indexBuffer;
+	glGenBuffers(1, &vertexBuffer);
+	GLState::bindBuffer(GL_COPY_WRITE_BUFFER, vertexBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, vertexCapacity * this->stride, NULL, GL_STATIC_DRAW);
+	glGenBuffers(1, &indexBuffer);
+
+	// copy the vertices of every live allocation to the front of the new buffer
+	size_t vertexEnd = 0;
+	GLState::bindBuffer(GL_COPY_READ_BUFFER, this->VBO);
+	for (size_t i = 0; i < this->allocations.size(); i++)
+	{
+		Allocation &allocation = this->allocations[i];
+		if (!this->live[i] || allocation.vertexCount == 0)
+			continue;
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, allocation.firstVertex * this->stride, vertexEnd * this->stride, allocation.vertexCount * this->stride);
+		allocation.firstVertex = vertexEnd;
+		vertexEnd += allocation.vertexCount;
+	}
+
+	// then the indices, every range is a multiple of the alignment
+	size_t indexEnd = 0;
+	GLState::bindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, indexCapacity, NULL, GL_STATIC_DRAW);
+	GLState::bindBuffer(GL_COPY_READ_BUFFER, this->EBO);
+	for (size_t i = 0; i < this->allocations.size(); i++)
+	{
+		Allocation &allocation = this->allocations[i];
+		if (!this->live[i] || allocation.indexBytes == 0)
+			continue;
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, allocation.indexOffset, indexEnd, allocation.indexBytes);
+		allocation.indexOffset = indexEnd;
+		indexEnd += allocation.indexBytes;
+	}
+
+	GLState::deleteBuffers(1, &this->VBO);
+	GLState::deleteBuffers(1, &this->EBO);
+	this->VBO = vertexBuffer;
+	this->EBO = indexBuffer;
+
+	GLState::bindVertexArray(this->VAO);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, this->VBO);
+	setupAttributes();
+	GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+	GLState::bindVertexArray(0);
+
+	this->vertexRanges.reset(vertexCapacity, vertexEnd);
+	this->indexRanges.reset(indexCapacity, indexEnd);
+}
+
+float GeometryHeap::fragmentation() const
+{
+	size_t used = usedBytes();
+	if (used == 0)
+		return 0.0f;
+
+	size_t holes = (this->vertexRanges.highWater() - this->vertexRanges.used()) * this->stride
+		+ (this->indexRanges.highWater() - this->indexRanges.used());
+	return float(holes) / float(used);
+}
+
+size_t GeometryHeap::usedBytes() const
+{
+	return this->vertexRanges.used() * this->stride + this->indexRanges.used();
+}
+
+size_t GeometryHeap::capacityBytes() const
+{
+	return this->vertexRanges.capacity() * this->stride + this->indexRanges.capacity();
+}
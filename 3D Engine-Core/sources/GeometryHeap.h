@@ -0,0 +1,118 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <map>
+#include <vector>
+
+// Sub-allocates ranges of a fixed capacity. Free ranges are kept sorted by offset, handed out first fit
+// and merged with their neighbours when released.
+class RangeAllocator
+{
+public:
+	explicit RangeAllocator(size_t capacity = 0);
+
+	// finds a free range of size units starting at a multiple of alignment, returns false if none is large enough
+	bool allocate(size_t size, size_t alignment, size_t &offset);
+
+	// returns a range handed out by allocate
+	void release(size_t offset, size_t size);
+
+	// appends free space at the end
+	void grow(size_t capacity);
+
+	// everything below used is allocated, the rest is one free range
+	void reset(size_t capacity, size_t used);
+
+	size_t capacity() const { return this->total; }
+	size_t used() const { return this->allocated; }
+	// end of the last allocated range, free space below it is fragmentation
+	size_t highWater() const;
+
+private:
+	std::map<size_t, size_t> freeRanges; // offset -> size
+	size_t total;
+	size_t allocated;
+};
+
+// layouts of the vertex buffers, see Vertex and PackedVertex in Mesh.h
+enum VertexFormat
+{
+	VERTEX_FORMAT_FULL,
+	VERTEX_FORMAT_PACKED,
+	VERTEX_FORMAT_COUNT
+};
+
+// Shared vertex and index buffers of one vertex format. Meshes own ranges of the buffers and are drawn with
+// glDrawElementsBaseVertex from the single VAO of the heap, instead of creating their own VAO, VBO and EBO.
+// The buffers grow by copying when full and are compacted when released ranges leave too many holes.
+class GeometryHeap
+{
+public:
+	// the part of the buffers owned by a mesh
+	struct Allocation
+	{
+		size_t firstVertex;		// base vertex of the mesh indices
+		size_t vertexCount;
+		size_t indexOffset;		// byte offset into the index buffer
+		size_t indexBytes;		// size of the index range, rounded up to INDEX_ALIGNMENT
+	};
+
+	static GeometryHeap& shared(VertexFormat format);
+
+	// deletes the GL objects of all heaps, call before the context is destroyed
+	static void destroyAll();
+
+	// compacts every heap whose holes exceed threshold of its used space
+	static void compactAll(float threshold = 0.25f);
+
+	// copies the vertices (in the heap format) and indices into the buffers, returns the handle of the allocation
+	unsigned int allocate(const void *vertices, size_t vertexCount, const void *indices, size_t indexBytes);
+
+	// frees the ranges of an allocation, the handle becomes invalid
+	void release(unsigned int handle);
+
+	const Allocation& get(unsigned int handle) const { return this->allocations[handle]; }
+
+	// binds the VAO, which holds the vertex format and both buffers
+	void bind() const;
+
+	// moves all allocations to the front of new buffers, handles stay valid
+	void defragment();
+
+	// free space between allocations relative to the used space
+	float fragmentation() const;
+
+	size_t usedBytes() const;
+	size_t capacityBytes() const;
+
+private:
+	explicit GeometryHeap(VertexFormat format);
+	GeometryHeap(const GeometryHeap&) = delete;
+	GeometryHeap& operator=(const GeometryHeap&) = delete;
+
+	static const size_t INITIAL_VERTICES = 1 << 16;
+	static const size_t INITIAL_INDEX_BYTES = 1 << 20;
+	// index ranges start at multiples of the largest index type
+	static const size_t INDEX_ALIGNMENT = sizeof(unsigned int);
+
+	// creates the buffers and the VAO with the attribute formats
+	void create(size_t vertexCapacity, size_t indexCapacity);
+	void destroy();
+	// replaces the buffers by larger ones holding the same data
+	void growVertices(size_t vertexCapacity);
+	void growIndices(size_t indexCapacity);
+	void setupAttributes();
+
+	VertexFormat format;
+	size_t stride;
+	unsigned int VAO, VBO, EBO;
+
+	RangeAllocator vertexRanges;	// in vertices
+	RangeAllocator indexRanges;		// in bytes
+
+	std::vector<Allocation> allocations;
+	std::vector<bool> live;
+	std::vector<unsigned int> freeHandles;
+};
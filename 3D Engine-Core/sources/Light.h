@@ -7,6 +7,7 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "FrameUniforms.h"
 #include "Shader.h"
 #include "Camera.h"
 #include "Model.h"
@@ -30,9 +31,6 @@ public:
 	{
 
 	}
-
-	//Functions
-	virtual void sendToShader(Shader& program) = 0;
 };
 
 class PointLight : public Light
@@ -83,17 +81,14 @@ public:
 		this->viewPos = viewpos;
 	}
 
-	void sendToShader(Shader& program)
+	// fills the std140 entry of the light in the Lights block
+	void writeUniforms(PointLightUniforms &uniforms) const
 	{
-		program.setUniformVec3("light.position", this->position);
-		program.setUniformVec3("viewPos", this->viewPos);
-		program.setUniformVec3("light.color", this->color);
-		program.setUniformVec3("light.ambient", this->ambient);
-		program.setUniformVec3("light.diffuse", this->diffuse);
-		program.setUniformVec3("light.specular", this->specular);
-		program.setUniform1f("light.constant", this->constant);
-		program.setUniform1f("light.linear", this->linear);
-		program.setUniform1f("light.quadratic", this->quadratic);
-		program.setUniform1f("material.shininess", 30.4f);
+		uniforms.position = glm::vec4(this->position, 1.0f);
+		uniforms.color = glm::vec4(this->color, 1.0f);
+		uniforms.ambient = glm::vec4(this->ambient, 0.0f);
+		uniforms.diffuse = glm::vec4(this->diffuse, 0.0f);
+		uniforms.specular = glm::vec4(this->specular, 0.0f);
+		uniforms.attenuation = glm::vec4(this->constant, this->linear, this->quadratic, 0.0f);
 	}
 }; 
\ No newline at end of file
@@ -1,101 +1,299 @@
 #include "Mesh.h"
+#include "GLState.h"
 
-Mesh::Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+#include <glm/gtc/packing.hpp>
+
+#include <cstring>
+
+bool Mesh::compactVertices = false;
+
+Mesh::Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, const vector<MeshLod> &lods,
+	const vector<MeshCluster> &clusters)
 {
 	this->vertices = vertices;
 	this->indices = indices;
 	this->textures = textures;
+	this->clusters = clusters;
+	this->clustersCulled = false;
 
 	// now that we have all the required data, set the vertex buffers and its attribute pointers.
-	setupMesh();
+	setupMesh(lods);
 }
 
-// render the mesh
-void Mesh::Draw(Shader shader)
+bool Mesh::hasVisibleGeometry() const
 {
-	// bind appropriate textures
-	unsigned int diffuseNr = 1;
-	unsigned int specularNr = 1;
-	unsigned int normalNr = 1;
-	unsigned int heightNr = 1;
+	// every cluster was culled
+	return !(clustersCulled && currentLod == 0 && visibleCounts.empty());
+}
 
+void Mesh::bindTextures() const
+{
+	// the samplers of the shaders are numbered in the order of the textures
 	for(unsigned int i = 0; i < textures.size(); i++)
+		GLState::bindTexture(i, GL_TEXTURE_2D, textures[i].id);
+}
+
+void Mesh::drawGeometry(unsigned int instanceCount)
+{
+	const bool drawClusters = clustersCulled && currentLod == 0 && instanceCount == 1;
+	clustersCulled = false;
+	if(drawClusters && visibleCounts.empty())
+		return;
+
+	// Draw mesh from the shared buffers of its vertex format
+	const GeometryHeap::Allocation &range = GeometryHeap::shared(format).get(geometry);
+	if(drawClusters)
+	{
+		// only the index ranges of the clusters that survived culling, in one call
+		vector<const void*> offsets(visibleOffsets.size());
+		for(unsigned int i = 0; i < visibleOffsets.size(); i++)
+			offsets[i] = (const void*)(range.indexOffset + visibleOffsets[i]);
+		vector<GLint> baseVertices(visibleOffsets.size(), static_cast<GLint>(range.firstVertex));
+		glMultiDrawElementsBaseVertex(GL_TRIANGLES, visibleCounts.data(), indexType, offsets.data(), static_cast<GLsizei>(offsets.size()), baseVertices.data());
+	}
+	else if(instanceCount == 1)
+	{
+		const LodRange &lod = lods[currentLod];
+		glDrawElementsBaseVertex(GL_TRIANGLES, lod.indexCount, indexType, (void*)(range.indexOffset + lod.firstIndex * indexSize()), static_cast<GLint>(range.firstVertex));
+	}
+	else
+	{
+		const LodRange &lod = lods[currentLod];
+		glDrawElementsInstancedBaseVertex(GL_TRIANGLES, lod.indexCount, indexType, (void*)(range.indexOffset + lod.firstIndex * indexSize()),
+			instanceCount, static_cast<GLint>(range.firstVertex));
+	}
+}
+
+void Mesh::appendCommands(unsigned int instanceCount, unsigned int baseInstance, vector<DrawElementsIndirectCommand> &commands)
+{
+	const bool drawClusters = clustersCulled && currentLod == 0 && instanceCount == 1;
+	clustersCulled = false;
+
+	// commands count in indices, not bytes; index ranges in the heap are aligned to whole indices
+	const GeometryHeap::Allocation &range = GeometryHeap::shared(format).get(geometry);
+	const GLuint firstIndex = static_cast<GLuint>(range.indexOffset / indexSize());
+	DrawElementsIndirectCommand command;
+	command.instanceCount = instanceCount;
+	command.baseVertex = static_cast<GLint>(range.firstVertex);
+	command.baseInstance = baseInstance;
+	if(drawClusters)
+	{
+		for(unsigned int i = 0; i < visibleOffsets.size(); i++)
+		{
+			command.count = static_cast<GLuint>(visibleCounts[i]);
+			command.firstIndex = firstIndex + static_cast<GLuint>(visibleOffsets[i] / indexSize());
+			commands.push_back(command);
+		}
+	}
+	else
+	{
+		const LodRange &lod = lods[currentLod];
+		command.count = static_cast<GLuint>(lod.indexCount);
+		command.firstIndex = firstIndex + static_cast<GLuint>(lod.firstIndex);
+		commands.push_back(command);
+	}
+}
+
+void Mesh::worldBounds(const glm::mat4 &transform, glm::vec3 &center, glm::vec3 &extent, float &radius) const
+{
+	center = glm::vec3(transform * glm::vec4(boundsCenter, 1.0f));
+
+	// box of the rotated box: every world axis gets the absolute contributions of the three local axes
+	glm::vec3 local = (boundsMax - boundsMin) * 0.5f;
+	glm::mat3 axes(transform);
+	extent = glm::abs(axes[0]) * local.x + glm::abs(axes[1]) * local.y + glm::abs(axes[2]) * local.z;
+	radius = boundsRadius * glm::max(glm::length(axes[0]), glm::max(glm::length(axes[1]), glm::length(axes[2])));
+}
+
+void Mesh::setupMesh(const vector<MeshLod> &lodLevels)
+{
+	compact = compactVertices;
+	format = compact ? VERTEX_FORMAT_PACKED : VERTEX_FORMAT_FULL;
+	positionOffset = glm::vec3(0.0f);
+	positionScale = glm::vec3(1.0f);
+
+	// bounding sphere around the center of the bounding box
+	glm::vec3 minimum(0.0f), maximum(0.0f);
+	if(!vertices.empty())
+		minimum = maximum = vertices[0].Position;
+	for(unsigned int i = 1; i < vertices.size(); i++)
+	{
+		minimum = glm::min(minimum, vertices[i].Position);
+		maximum = glm::max(maximum, vertices[i].Position);
+	}
+	boundsMin = minimum;
+	boundsMax = maximum;
+	boundsCenter = (minimum + maximum) * 0.5f;
+	boundsRadius = 0.0f;
+	for(unsigned int i = 0; i < vertices.size(); i++)
+		boundsRadius = glm::max(boundsRadius, glm::length(vertices[i].Position - boundsCenter));
+
+	// texture stretch from the areas the triangles cover in object and in texture space, for the texture streaming
+	float surfaceArea = 0.0f, uvArea = 0.0f;
+	for(size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		const Vertex &a = vertices[indices[i]], &b = vertices[indices[i + 1]], &c = vertices[indices[i + 2]];
+		surfaceArea += glm::length(glm::cross(b.Position - a.Position, c.Position - a.Position));
+		glm::vec2 u = b.TexCoords - a.TexCoords, v = c.TexCoords - a.TexCoords;
+		uvArea += glm::abs(u.x * v.y - u.y * v.x);
+	}
+	uvDensity = surfaceArea > 0.0f ? glm::sqrt(uvArea / surfaceArea) : 0.0f;
+
+	// the levels of detail follow the base indices in one index range
+	vector<unsigned int> allIndices(indices);
+	LodRange base = { 0, indices.size(), 0.0f };
+	lods.assign(1, base);
+	for(unsigned int i = 0; i < lodLevels.size(); i++)
+	{
+		LodRange range = { allIndices.size(), lodLevels[i].indices.size(), lodLevels[i].error };
+		lods.push_back(range);
+		allIndices.insert(allIndices.end(), lodLevels[i].indices.begin(), lodLevels[i].indices.end());
+	}
+	currentLod = 0;
+
+	// indices in the smallest type that addresses all vertices. They are relative to the base vertex of the
+	// mesh in the heap, so the mesh size alone decides.
+	// The importer splits meshes to fit 16 bit indices, so 32 bit ones are only left for meshes built elsewhere.
+	// 8 bit indices are not used, most GPUs do not fetch them natively.
+	vector<unsigned short> shortIndices;
+	const void *indexData = allIndices.data();
+	size_t indexBytes = allIndices.size() * sizeof(unsigned int);
+	indexType = GL_UNSIGNED_INT;
+	if(vertices.size() <= 65536)
+	{
+		indexType = GL_UNSIGNED_SHORT;
+		shortIndices.assign(allIndices.begin(), allIndices.end());
+		indexData = shortIndices.data();
+		indexBytes = shortIndices.size() * sizeof(unsigned short);
+	}
+
+	// copy the vertices and indices into the shared buffers of the vertex format
+	GeometryHeap &heap = GeometryHeap::shared(format);
+	if(compact)
+	{
+		vector<PackedVertex> packed;
+		packVertices(packed);
+		geometry = heap.allocate(packed.data(), packed.size(), indexData, indexBytes);
+	}
+	else
+		geometry = heap.allocate(vertices.data(), vertices.size(), indexData, indexBytes);
+}
+
+void Mesh::selectLod(float pixelsPerUnit, float maxPixelError, float hysteresis)
+{
+	unsigned int selected = 0;
+	for(unsigned int i = 1; i < lods.size(); i++)
+	{
+		if(lods[i].error * pixelsPerUnit > maxPixelError)
+			break;
+		selected = i;
+	}
+
+	// switching to a coarser level needs some margin, a finer one is taken right away
+	while(selected > currentLod && lods[selected].error * pixelsPerUnit > maxPixelError * hysteresis)
+		selected--;
+
+	currentLod = selected;
+}
+
+unsigned int Mesh::cullClusters(const Frustum &frustum, const glm::vec3 &cameraPosition, unsigned int &clusterCount, unsigned int &culledCount)
+{
+	clustersCulled = false;
+	if(currentLod != 0 || clusters.empty())
+		return triangleCount(currentLod);
+
+	clustersCulled = true;
+	visibleCounts.clear();
+	visibleOffsets.clear();
+	clusterCount += static_cast<unsigned int>(clusters.size());
+
+	// the whole mesh is off screen
+	if(!frustum.intersectsSphere(boundsCenter, boundsRadius))
 	{
-		glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-										  // retrieve texture number (the N in diffuse_textureN)
-		stringstream ss;
-		string number;
-		string name = textures[i].type;
-
-		if(name == "texture_diffuse")
-			ss << diffuseNr++; // transfer unsigned int to stream
-		else if(name == "texture_specular")
-			ss << specularNr++; // transfer unsigned int to stream
-		else if(name == "texture_normal")
-			ss << normalNr++; // transfer unsigned int to stream
-		else if(name == "texture_height")
-			ss << heightNr++; // transfer unsigned int to stream
-
-		number = ss.str();
-		// Now set the sampler to the correct texture unit
-		//glUniform1i(glGetUniformLocation(shader.Program, (name + number).c_str()), i);
-		// And finally bind the texture
-		glBindTexture(GL_TEXTURE_2D, textures[i].id);
-	}
-
-	// Draw mesh
-	glBindVertexArray(VAO);
-	glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-	glBindVertexArray(0);
-
-	// Always good practice to set everything back to defaults once configured.
-	glActiveTexture(GL_TEXTURE0);
+		culledCount += static_cast<unsigned int>(clusters.size());
+		return 0;
+	}
+
+	unsigned int triangles = 0;
+	for(unsigned int i = 0; i < clusters.size(); i++)
+	{
+		const MeshCluster &cluster = clusters[i];
+		bool offScreen = !frustum.intersectsSphere(cluster.center, cluster.radius);
+		bool backFacing = cluster.coneCutoff < 1.0f && glm::dot(glm::normalize(cluster.coneApex - cameraPosition), cluster.coneAxis) >= cluster.coneCutoff;
+		if(offScreen || backFacing)
+		{
+			culledCount++;
+			continue;
+		}
+
+		// clusters are consecutive in the index buffer, so neighbouring survivors share one range
+		GLintptr offset = cluster.firstIndex * indexSize();
+		if(!visibleCounts.empty() && visibleOffsets.back() + visibleCounts.back() * static_cast<GLintptr>(indexSize()) == offset)
+			visibleCounts.back() += cluster.indexCount;
+		else
+		{
+			visibleCounts.push_back(cluster.indexCount);
+			visibleOffsets.push_back(offset);
+		}
+		triangles += cluster.indexCount / 3;
+	}
+	return triangles;
 }
 
-void Mesh::setupMesh()
+void Mesh::release()
 {
-	// create buffers/arrays
-	glGenVertexArrays(1, &VAO);
-	glGenBuffers(1, &VBO);
-	glGenBuffers(1, &EBO);
-
-	// Everything we do will bind to this VAO buffer
-	glBindVertexArray(VAO);
-
-	// load data into vertex buffers
-	// A great thing about structs is that their memory layout is sequential for all its items.
-	// The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-	// again translates to 3/2 floats which translates to a byte array.
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-	// Bind index data to buffer
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-	// Set the vertex attribute pointers
-	// Vertex Positions
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-
-	// Vertex normals
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-
-	// Vertex texture coords
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-
-	// Vertex tangent
-	glEnableVertexAttribArray(3);
-	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-
-	// Vertex bitangent
-	glEnableVertexAttribArray(4);
-	glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-
-	// Unbind buffer
-	glBindVertexArray(0);
+	GeometryHeap::shared(format).release(geometry);
 }
 
+// maps a unit vector onto the octahedron and unfolds it to [-1, 1]^2
+static glm::vec2 octahedralEncode(glm::vec3 n)
+{
+	float length = glm::abs(n.x) + glm::abs(n.y) + glm::abs(n.z);
+	if(length == 0.0f)
+		return glm::vec2(0.0f);
+
+	n /= length;
+	glm::vec2 e(n.x, n.y);
+	if(n.z < 0.0f)
+	{
+		e.x = (1.0f - glm::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+		e.y = (1.0f - glm::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+	}
+	return e;
+}
 
+void Mesh::packVertices(vector<PackedVertex> &packed)
+{
+	// quantization range is the bounding box of the mesh
+	glm::vec3 minimum(0.0f), maximum(0.0f);
+	if(!vertices.empty())
+		minimum = maximum = vertices[0].Position;
+	for(unsigned int i = 1; i < vertices.size(); i++)
+	{
+		minimum = glm::min(minimum, vertices[i].Position);
+		maximum = glm::max(maximum, vertices[i].Position);
+	}
+	positionOffset = minimum;
+	positionScale = glm::max(maximum - minimum, glm::vec3(1e-6f));
+
+	packed.resize(vertices.size());
+	for(unsigned int i = 0; i < vertices.size(); i++)
+	{
+		const Vertex &v = vertices[i];
+		PackedVertex &p = packed[i];
+
+		glm::vec3 q = glm::clamp((v.Position - positionOffset) / positionScale, 0.0f, 1.0f) * 65535.0f + 0.5f;
+		p.Position[0] = static_cast<unsigned short>(q.x);
+		p.Position[1] = static_cast<unsigned short>(q.y);
+		p.Position[2] = static_cast<unsigned short>(q.z);
+		// handedness of the tangent frame, so the bitangent can be rebuilt from normal and tangent
+		p.Position[3] = glm::dot(glm::cross(v.Normal, v.Tangent), v.Bitangent) < 0.0f ? 0 : 65535;
+
+		glm::uint normal = glm::packSnorm2x16(octahedralEncode(v.Normal));
+		glm::uint tangent = glm::packSnorm2x16(octahedralEncode(v.Tangent));
+		glm::uint texCoords = glm::packHalf2x16(v.TexCoords);
+		memcpy(p.Normal, &normal, sizeof(p.Normal));
+		memcpy(p.Tangent, &tangent, sizeof(p.Tangent));
+		memcpy(p.TexCoords, &texCoords, sizeof(p.TexCoords));
+	}
+}
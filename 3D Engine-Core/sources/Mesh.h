@@ -8,6 +8,8 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "Shader.h"
+#include "GeometryHeap.h"
+#include "Frustum.h"
 
 #include <string>
 #include <fstream>
@@ -30,6 +32,19 @@ struct Vertex
 	glm::vec3 Bitangent;
 };
 
+// compact vertex layout of 20 bytes, used when Mesh::compactVertices is set
+struct PackedVertex
+{
+	// position quantized to 16 bit in the mesh bounds, w holds the bitangent sign (0 = -1, 65535 = +1)
+	unsigned short Position[4];
+	// octahedral encoded normal, snorm16
+	short Normal[2];
+	// half float texture coordinates
+	unsigned short TexCoords[2];
+	// octahedral encoded tangent, snorm16. The bitangent is cross(normal, tangent) * sign
+	short Tangent[2];
+};
+
 struct Texture
 {
 	unsigned int id;
@@ -37,6 +52,58 @@ struct Texture
 	aiString path;
 };
 
+// texture reference of a material, resolved to a Texture once it is loaded
+struct TextureRef
+{
+	string type;
+	string path;
+};
+
+// simplified level of detail of a mesh, indexing the vertices of the base mesh
+struct MeshLod
+{
+	vector<unsigned int> indices;
+	// geometric error against the base mesh, in the units of the vertex positions
+	float error;
+};
+
+// range of about a hundred spatially close triangles of the base index buffer, culled as a whole
+struct MeshCluster
+{
+	unsigned int firstIndex;
+	unsigned int indexCount;
+	// bounding sphere
+	glm::vec3 center;
+	float radius;
+	// normal cone: the cluster faces away from every camera position inside the cone at apex opening along -axis.
+	// cutoff is the sine of the cone angle, 1 for clusters whose normals spread too far to ever be culled this way
+	glm::vec3 coneApex;
+	glm::vec3 coneAxis;
+	float coneCutoff;
+};
+
+// layout of a command in GL_DRAW_INDIRECT_BUFFER for glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+// CPU side mesh data produced by the importer, before any GL object exists
+struct MeshData
+{
+	vector<Vertex> vertices;
+	vector<unsigned int> indices;
+	vector<TextureRef> textures;
+	// coarser levels, from fine to coarse
+	vector<MeshLod> lods;
+	// clusters covering the base indices in order, empty for small meshes
+	vector<MeshCluster> clusters;
+};
+
 class Mesh
 {
 public:
@@ -44,22 +111,93 @@ public:
 	vector<Vertex> vertices;
 	vector<unsigned int> indices;
 	vector<Texture> textures;
-	unsigned int VAO;
+
+	// upload vertices as PackedVertex instead of Vertex, the vertex shader has to decode them
+	static bool compactVertices;
+	bool compact;
+	// dequantization of packed positions: position = offset + quantized * scale
+	glm::vec3 positionOffset;
+	glm::vec3 positionScale;
+	// GL_UNSIGNED_SHORT when all vertices can be addressed with 16 bits, else GL_UNSIGNED_INT
+	GLenum indexType;
+	// vertices and indices live in the GeometryHeap of the vertex format
+	VertexFormat format;
+	unsigned int geometry;
+
+	// index ranges of the levels of detail in the geometry, level 0 is the base mesh
+	struct LodRange
+	{
+		size_t firstIndex;
+		size_t indexCount;
+		float error;
+	};
+	vector<LodRange> lods;
+	// level drawn by Draw, chosen by selectLod
+	unsigned int currentLod;
+
+	// bounding box of the vertices and the bounding sphere around its center
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+	glm::vec3 boundsCenter;
+	float boundsRadius;
+	// instances of the model whose copy of the mesh is on screen this frame, filled by the frustum culling
+	vector<unsigned int> visibleInstances;
+	// texture coordinate units per object space unit, averaged over the surface. 0 without texture coordinates.
+	float uvDensity;
+
+	// clusters of the base level and the index ranges of the ones cullClusters kept for the next Draw
+	vector<MeshCluster> clusters;
+	vector<GLsizei> visibleCounts;
+	vector<GLintptr> visibleOffsets;
+	bool clustersCulled;
 
 	/*  Functions  */
 	// constructor
-	Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures);
+	Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, const vector<MeshLod> &lods = vector<MeshLod>(),
+		const vector<MeshCluster> &clusters = vector<MeshCluster>());
 
-	// render the mesh
-	void Draw(Shader shader);
+	// false when cluster culling left nothing of the mesh to draw this frame
+	bool hasVisibleGeometry() const;
 
-private:
-	/*  Render data  */
-	unsigned int VBO, EBO;
+	// binds the textures to the units 0 to n - 1
+	void bindTextures() const;
+
+	// issues the draw of the selected level or of the visible clusters, with the textures, the VAO of the
+	// GeometryHeap and the instance attributes already bound. Several instances always draw the whole level.
+	void drawGeometry(unsigned int instanceCount);
 
+	// the same draw as indirect commands for glMultiDrawElementsIndirect, one per index range, appended to commands.
+	// The instances are read from baseInstance on.
+	void appendCommands(unsigned int instanceCount, unsigned int baseInstance, vector<DrawElementsIndirectCommand> &commands);
+
+	// picks the coarsest level whose error covers at most maxPixelError pixels, given how many pixels one unit of
+	// the mesh covers at its distance. Coarser levels are only taken once they are below hysteresis times the limit,
+	// so a mesh near a switching distance does not pop back and forth.
+	void selectLod(float pixelsPerUnit, float maxPixelError, float hysteresis = 0.75f);
+
+	// culls the clusters of the base level against a frustum and camera position in the object space of the mesh,
+	// so the next Draw only submits the surviving index ranges. Returns the triangles left.
+	// Without clusters, or with a coarser level selected, the whole level stays.
+	unsigned int cullClusters(const Frustum &frustum, const glm::vec3 &cameraPosition, unsigned int &clusterCount, unsigned int &culledCount);
+
+	// center and half extents of the world space box around the bounding box moved by the model matrix transform,
+	// and the radius of the bounding sphere scaled with it
+	void worldBounds(const glm::mat4 &transform, glm::vec3 &center, glm::vec3 &extent, float &radius) const;
+
+	size_t indexSize() const { return indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int); }
+
+	unsigned int triangleCount(unsigned int lod) const { return static_cast<unsigned int>(lods[lod].indexCount / 3); }
+
+	// frees the geometry in the heap. Meshes are copied around, so this is not done by a destructor.
+	void release();
+
+private:
 	/*  Functions    */
 	// initializes all the buffer objects/arrays
-	void setupMesh();
+	void setupMesh(const vector<MeshLod> &lodLevels);
+
+	// quantizes the vertices to the compact layout
+	void packVertices(vector<PackedVertex> &packed);
 };
 
 
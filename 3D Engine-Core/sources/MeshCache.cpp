@@ -0,0 +1,202 @@
+#include "MeshCache.h"
+#include "FileUtils.h"
+#include "ObjLoader.h"
+
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+
+// layout of a cache file:
+//   header  : magic, version, source hash, import flags, mesh count
+//   per mesh: vertex count, index count, texture count, vertices, indices,
+//             for every texture reference its type and path as (length, bytes),
+//             lod count, and per lod its error, index count and indices,
+//             cluster count and clusters
+struct MeshCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t sourceHash;
+	uint32_t importFlags;
+	uint32_t meshCount;
+};
+
+// bounds checked reader over the mapped cache file
+struct CacheReader
+{
+	const unsigned char* cursor;
+	const unsigned char* end;
+
+	bool read(void* out, size_t size)
+	{
+		if (static_cast<size_t>(end - cursor) < size)
+			return false;
+		std::memcpy(out, cursor, size);
+		cursor += size;
+		return true;
+	}
+
+	bool readString(string& out)
+	{
+		uint32_t length;
+		if (!read(&length, sizeof(length)) || static_cast<size_t>(end - cursor) < length)
+			return false;
+		out.assign(reinterpret_cast<const char*>(cursor), length);
+		cursor += length;
+		return true;
+	}
+};
+
+static void writeString(ofstream& out, const string& value)
+{
+	uint32_t length = static_cast<uint32_t>(value.size());
+	out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+	out.write(value.data(), length);
+}
+
+string MeshCache::cachePath(const string& sourcePath)
+{
+	return sourcePath + ".meshcache";
+}
+
+bool MeshCache::sourceHash(const string& sourcePath, uint64_t& hash)
+{
+	if (!hashFile(sourcePath, hash))
+		return false;
+
+	string extension = sourcePath.size() >= 4 ? sourcePath.substr(sourcePath.size() - 4) : string();
+	for (char& c : extension)
+		c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+	if (extension != ".obj")
+		return true;
+
+	// a missing library still changes the hash, so creating it later invalidates the cache
+	vector<string> libraries = ObjLoader::materialLibraries(sourcePath);
+	for (const string& library : libraries)
+	{
+		uint64_t libraryHash = 0;
+		hashFile(library, libraryHash);
+		hash = hashBytes(&libraryHash, sizeof(libraryHash), hash);
+	}
+	return true;
+}
+
+bool MeshCache::load(const string& sourcePath, unsigned int importFlags, vector<MeshData>& meshes)
+{
+	MappedFile file;
+	if (!file.open(cachePath(sourcePath)))
+		return false;
+
+	CacheReader reader = { file.data(), file.data() + file.size() };
+	MeshCacheHeader header;
+	if (!reader.read(&header, sizeof(header)) || header.magic != MAGIC || header.version != VERSION || header.importFlags != importFlags)
+		return false;
+
+	// the cache is only valid for the exact source content it was cooked from
+	uint64_t contentHash;
+	if (!sourceHash(sourcePath, contentHash) || contentHash != header.sourceHash)
+		return false;
+
+	vector<MeshData> result(header.meshCount);
+	for (MeshData& mesh : result)
+	{
+		uint32_t counts[3];
+		if (!reader.read(counts, sizeof(counts)))
+			return false;
+
+		mesh.vertices.resize(counts[0]);
+		mesh.indices.resize(counts[1]);
+		mesh.textures.resize(counts[2]);
+		if (!reader.read(mesh.vertices.data(), counts[0] * sizeof(Vertex)) ||
+			!reader.read(mesh.indices.data(), counts[1] * sizeof(unsigned int)))
+			return false;
+
+		for (TextureRef& texture : mesh.textures)
+		{
+			if (!reader.readString(texture.type) || !reader.readString(texture.path))
+				return false;
+		}
+
+		uint32_t lodCount;
+		if (!reader.read(&lodCount, sizeof(lodCount)))
+			return false;
+		mesh.lods.resize(lodCount);
+		for (MeshLod& lod : mesh.lods)
+		{
+			uint32_t indexCount;
+			if (!reader.read(&lod.error, sizeof(lod.error)) || !reader.read(&indexCount, sizeof(indexCount)))
+				return false;
+			lod.indices.resize(indexCount);
+			if (!reader.read(lod.indices.data(), indexCount * sizeof(unsigned int)))
+				return false;
+		}
+
+		uint32_t clusterCount;
+		if (!reader.read(&clusterCount, sizeof(clusterCount)))
+			return false;
+		mesh.clusters.resize(clusterCount);
+		if (!reader.read(mesh.clusters.data(), clusterCount * sizeof(MeshCluster)))
+			return false;
+	}
+
+	meshes.swap(result);
+	return true;
+}
+
+bool MeshCache::store(const string& sourcePath, unsigned int importFlags, const vector<MeshData>& meshes)
+{
+	MeshCacheHeader header;
+	header.magic = MAGIC;
+	header.version = VERSION;
+	header.importFlags = importFlags;
+	header.meshCount = static_cast<uint32_t>(meshes.size());
+	if (!sourceHash(sourcePath, header.sourceHash))
+		return false;
+
+	// write to a temporary file first so a crash never leaves a truncated cache behind
+	string path = cachePath(sourcePath);
+	string tempPath = path + ".tmp";
+	{
+		ofstream out(tempPath.c_str(), ios::binary | ios::trunc);
+		if (!out)
+			return false;
+
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		for (const MeshData& mesh : meshes)
+		{
+			uint32_t counts[3] = {
+				static_cast<uint32_t>(mesh.vertices.size()),
+				static_cast<uint32_t>(mesh.indices.size()),
+				static_cast<uint32_t>(mesh.textures.size())
+			};
+			out.write(reinterpret_cast<const char*>(counts), sizeof(counts));
+			out.write(reinterpret_cast<const char*>(mesh.vertices.data()), mesh.vertices.size() * sizeof(Vertex));
+			out.write(reinterpret_cast<const char*>(mesh.indices.data()), mesh.indices.size() * sizeof(unsigned int));
+			for (const TextureRef& texture : mesh.textures)
+			{
+				writeString(out, texture.type);
+				writeString(out, texture.path);
+			}
+
+			uint32_t lodCount = static_cast<uint32_t>(mesh.lods.size());
+			out.write(reinterpret_cast<const char*>(&lodCount), sizeof(lodCount));
+			for (const MeshLod& lod : mesh.lods)
+			{
+				uint32_t indexCount = static_cast<uint32_t>(lod.indices.size());
+				out.write(reinterpret_cast<const char*>(&lod.error), sizeof(lod.error));
+				out.write(reinterpret_cast<const char*>(&indexCount), sizeof(indexCount));
+				out.write(reinterpret_cast<const char*>(lod.indices.data()), lod.indices.size() * sizeof(unsigned int));
+			}
+
+			uint32_t clusterCount = static_cast<uint32_t>(mesh.clusters.size());
+			out.write(reinterpret_cast<const char*>(&clusterCount), sizeof(clusterCount));
+			out.write(reinterpret_cast<const char*>(mesh.clusters.data()), mesh.clusters.size() * sizeof(MeshCluster));
+		}
+
+		if (!out)
+			return false;
+	}
+
+	std::remove(path.c_str());
+	return std::rename(tempPath.c_str(), path.c_str()) == 0;
+}
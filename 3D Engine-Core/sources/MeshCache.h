@@ -0,0 +1,31 @@
+#pragma once
+
+#include "Mesh.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Cooked binary copy of an imported model (vertices, indices and material texture references).
+// The cache file lives next to the source file and is keyed by the source content hash and the
+// import flags, so a warm load is a memory map and a copy instead of a full Assimp parse.
+class MeshCache
+{
+public:
+	// fills meshes from the cache of sourcePath, returns false on a miss or a stale cache
+	static bool load(const string& sourcePath, unsigned int importFlags, vector<MeshData>& meshes);
+
+	// writes the cache of sourcePath, returns false if the file cannot be written
+	static bool store(const string& sourcePath, unsigned int importFlags, const vector<MeshData>& meshes);
+
+	static string cachePath(const string& sourcePath);
+
+	// content hash of a model file and of the files it reads along, the material libraries of an OBJ file,
+	// so editing a material invalidates the cache too
+	static bool sourceHash(const string& sourcePath, uint64_t& hash);
+
+	static const uint32_t VERSION = 5;
+
+private:
+	static const uint32_t MAGIC = 0x4843534d; // "MSCH"
+};
@@ -0,0 +1,512 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+void MeshOptimizer::optimize(MeshData &mesh)
+{
+	weldVertices(mesh);
+	optimizeVertexCache(mesh.indices, mesh.vertices.size());
+	optimizeOverdraw(mesh.indices, mesh.vertices);
+	optimizeVertexFetch(mesh);
+}
+
+// hashes and compares vertices by their bytes, Vertex is all floats without padding
+struct VertexBytesHash
+{
+	size_t operator()(const Vertex *v) const
+	{
+		const unsigned int *words = reinterpret_cast<const unsigned int*>(v);
+		size_t h = 2166136261u;
+		for (size_t i = 0; i < sizeof(Vertex) / sizeof(unsigned int); i++)
+			h = (h ^ words[i]) * 16777619u;
+		return h;
+	}
+};
+
+struct VertexBytesEqual
+{
+	bool operator()(const Vertex *a, const Vertex *b) const
+	{
+		return std::memcmp(a, b, sizeof(Vertex)) == 0;
+	}
+};
+
+void MeshOptimizer::weldVertices(MeshData &mesh)
+{
+	vector<unsigned int> remap(mesh.vertices.size());
+	vector<Vertex> unique;
+	unique.reserve(mesh.vertices.size());
+
+	std::unordered_map<const Vertex*, unsigned int, VertexBytesHash, VertexBytesEqual> seen(mesh.vertices.size() * 2);
+	for (size_t i = 0; i < mesh.vertices.size(); i++)
+	{
+		std::pair<std::unordered_map<const Vertex*, unsigned int, VertexBytesHash, VertexBytesEqual>::iterator, bool> inserted =
+			seen.insert(std::make_pair(&mesh.vertices[i], static_cast<unsigned int>(unique.size())));
+		if (inserted.second)
+			unique.push_back(mesh.vertices[i]);
+		remap[i] = inserted.first->second;
+	}
+
+	for (size_t i = 0; i < mesh.indices.size(); i++)
+		mesh.indices[i] = remap[mesh.indices[i]];
+
+	mesh.vertices.swap(unique);
+}
+
+// Forsyth scoring: recently used vertices and vertices with few remaining triangles are preferred
+static const int FORSYTH_CACHE_SIZE = 32;
+
+static float forsythVertexScore(int cachePosition, unsigned int remainingTriangles)
+{
+	if (remainingTriangles == 0)
+		return -1.0f;
+
+	float score = 0.0f;
+	if (cachePosition >= 0)
+	{
+		// the last triangle's vertices get a fixed score so that it does not matter in which order they were used
+		if (cachePosition < 3)
+			score = 0.75f;
+		else
+			score = std::pow(1.0f - (cachePosition - 3) / float(FORSYTH_CACHE_SIZE - 3), 1.5f);
+	}
+
+	return score + 2.0f / std::sqrt(float(remainingTriangles));
+}
+
+void MeshOptimizer::optimizeVertexCache(vector<unsigned int> &indices, size_t vertexCount)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount < 2)
+		return;
+
+	// triangles adjacent to every vertex, the live ones are kept at the front of each range
+	vector<unsigned int> remaining(vertexCount, 0);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+		remaining[indices[i]]++;
+
+	vector<unsigned int> offsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+		offsets[v + 1] = offsets[v] + remaining[v];
+
+	vector<unsigned int> adjacency(triangleCount * 3);
+	vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t t = 0; t < triangleCount; t++)
+		for (int k = 0; k < 3; k++)
+			adjacency[fill[indices[t * 3 + k]]++] = static_cast<unsigned int>(t);
+
+	vector<int> cachePosition(vertexCount, -1);
+	vector<float> vertexScore(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+		vertexScore[v] = forsythVertexScore(-1, remaining[v]);
+
+	vector<float> triangleScore(triangleCount);
+	vector<char> emitted(triangleCount, 0);
+	int best = 0;
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+		if (triangleScore[t] > triangleScore[best])
+			best = static_cast<int>(t);
+	}
+
+	vector<unsigned int> result;
+	result.reserve(triangleCount * 3);
+
+	unsigned int cache[FORSYTH_CACHE_SIZE + 3];
+	unsigned int cacheCount = 0;
+	size_t scanCursor = 0;
+
+	while (result.size() < triangleCount * 3)
+	{
+		// nothing in the cache has triangles left: continue with the next unemitted triangle
+		if (best < 0)
+		{
+			while (emitted[scanCursor])
+				scanCursor++;
+			best = static_cast<int>(scanCursor);
+		}
+
+		const unsigned int *tri = &indices[best * 3];
+		emitted[best] = 1;
+		result.insert(result.end(), tri, tri + 3);
+
+		// detach the triangle from its vertices
+		for (int k = 0; k < 3; k++)
+		{
+			unsigned int v = tri[k];
+			unsigned int *begin = &adjacency[offsets[v]];
+			unsigned int *end = begin + remaining[v];
+			unsigned int *it = std::find(begin, end, static_cast<unsigned int>(best));
+			std::swap(*it, *(end - 1));
+			remaining[v]--;
+		}
+
+		// the triangle's vertices move to the front of the cache, older entries are pushed back
+		unsigned int newCache[FORSYTH_CACHE_SIZE + 3];
+		unsigned int newCount = 0;
+		for (int k = 0; k < 3; k++)
+			newCache[newCount++] = tri[k];
+		for (unsigned int i = 0; i < cacheCount; i++)
+		{
+			unsigned int v = cache[i];
+			if (v != tri[0] && v != tri[1] && v != tri[2])
+				newCache[newCount++] = v;
+		}
+
+		// entries past the cache size fall out, but are rescored once more below
+		for (unsigned int i = 0; i < newCount; i++)
+		{
+			unsigned int v = newCache[i];
+			cachePosition[v] = i < FORSYTH_CACHE_SIZE ? static_cast<int>(i) : -1;
+			vertexScore[v] = forsythVertexScore(cachePosition[v], remaining[v]);
+		}
+
+		best = -1;
+		float bestScore = -1.0f;
+		for (unsigned int i = 0; i < newCount; i++)
+		{
+			unsigned int v = newCache[i];
+			for (unsigned int a = 0; a < remaining[v]; a++)
+			{
+				unsigned int t = adjacency[offsets[v] + a];
+				const unsigned int *other = &indices[t * 3];
+				triangleScore[t] = vertexScore[other[0]] + vertexScore[other[1]] + vertexScore[other[2]];
+				if (triangleScore[t] > bestScore)
+				{
+					bestScore = triangleScore[t];
+					best = static_cast<int>(t);
+				}
+			}
+		}
+
+		cacheCount = std::min<unsigned int>(newCount, FORSYTH_CACHE_SIZE);
+		std::memcpy(cache, newCache, cacheCount * sizeof(unsigned int));
+	}
+
+	indices.swap(result);
+}
+
+// FIFO cache used by the overdraw pass and the statistics
+struct FifoCache
+{
+	vector<unsigned int> timestamps;
+	unsigned int time;
+	unsigned int size;
+
+	FifoCache(size_t vertexCount, unsigned int size) : timestamps(vertexCount, 0), time(size + 1), size(size) {}
+
+	// returns true on a miss
+	bool access(unsigned int v)
+	{
+		if (time - timestamps[v] > size)
+		{
+			timestamps[v] = time++;
+			return true;
+		}
+		return false;
+	}
+
+	void reset()
+	{
+		time += size + 1;
+	}
+};
+
+VertexCacheStats MeshOptimizer::analyzeVertexCache(const vector<unsigned int> &indices, size_t vertexCount, unsigned int cacheSize)
+{
+	VertexCacheStats stats;
+	stats.triangles = static_cast<unsigned int>(indices.size() / 3);
+	stats.misses = 0;
+
+	FifoCache cache(vertexCount, cacheSize);
+	vector<char> used(vertexCount, 0);
+	stats.vertices = 0;
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		stats.misses += cache.access(indices[i]);
+		if (!used[indices[i]])
+		{
+			used[indices[i]] = 1;
+			stats.vertices++;
+		}
+	}
+
+	stats.acmr = stats.triangles ? float(stats.misses) / stats.triangles : 0.0f;
+	stats.atvr = stats.vertices ? float(stats.misses) / stats.vertices : 0.0f;
+	return stats;
+}
+
+void MeshOptimizer::optimizeOverdraw(vector<unsigned int> &indices, const vector<Vertex> &vertices, float threshold)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount < 2)
+		return;
+
+	// 1. hard boundaries: triangles where all three vertices miss the cache start a new cluster anyway
+	FifoCache cache(vertices.size(), CACHE_SIZE);
+	vector<size_t> hard;
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		unsigned int misses = cache.access(indices[t * 3]) + cache.access(indices[t * 3 + 1]) + cache.access(indices[t * 3 + 2]);
+		if (t == 0 || misses == 3)
+			hard.push_back(t);
+	}
+	hard.push_back(triangleCount);
+
+	// 2. soft boundaries: split a cluster wherever restarting the cache keeps its miss ratio within the threshold
+	vector<size_t> clusters;
+	for (size_t c = 0; c + 1 < hard.size(); c++)
+	{
+		size_t start = hard[c], end = hard[c + 1];
+
+		cache.reset();
+		unsigned int clusterMisses = 0;
+		for (size_t t = start; t < end; t++)
+			clusterMisses += cache.access(indices[t * 3]) + cache.access(indices[t * 3 + 1]) + cache.access(indices[t * 3 + 2]);
+		float clusterAcmr = float(clusterMisses) / (end - start);
+
+		cache.reset();
+		size_t subStart = start;
+		unsigned int subMisses = 0;
+		clusters.push_back(start);
+		for (size_t t = start; t < end; t++)
+		{
+			subMisses += cache.access(indices[t * 3]) + cache.access(indices[t * 3 + 1]) + cache.access(indices[t * 3 + 2]);
+
+			size_t subSize = t + 1 - subStart;
+			if (t + 1 < end && subSize >= 8 && float(subMisses) / subSize <= clusterAcmr * threshold)
+			{
+				clusters.push_back(t + 1);
+				cache.reset();
+				subStart = t + 1;
+				subMisses = 0;
+			}
+		}
+	}
+	clusters.push_back(triangleCount);
+
+	// 3. sort clusters so the ones facing away from the mesh center, the likely occluders, are drawn first
+	glm::vec3 meshCenter(0.0f);
+	float meshArea = 0.0f;
+	vector<float> sortKey(clusters.size() - 1);
+	vector<glm::vec3> clusterCenter(clusters.size() - 1);
+	vector<glm::vec3> clusterNormal(clusters.size() - 1);
+	for (size_t c = 0; c + 1 < clusters.size(); c++)
+	{
+		glm::vec3 center(0.0f), normal(0.0f);
+		float area = 0.0f;
+		for (size_t t = clusters[c]; t < clusters[c + 1]; t++)
+		{
+			const glm::vec3 &p0 = vertices[indices[t * 3]].Position;
+			const glm::vec3 &p1 = vertices[indices[t * 3 + 1]].Position;
+			const glm::vec3 &p2 = vertices[indices[t * 3 + 2]].Position;
+			glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+			float a = glm::length(n);
+
+			center += (p0 + p1 + p2) * (a / 3.0f);
+			normal += n;
+			area += a;
+		}
+
+		meshCenter += center;
+		meshArea += area;
+		clusterCenter[c] = area > 0.0f ? center / area : vertices[indices[clusters[c] * 3]].Position;
+		float normalLength = glm::length(normal);
+		clusterNormal[c] = normalLength > 0.0f ? normal / normalLength : glm::vec3(0.0f);
+	}
+	if (meshArea > 0.0f)
+		meshCenter /= meshArea;
+
+	vector<unsigned int> order(clusters.size() - 1);
+	for (size_t c = 0; c < order.size(); c++)
+	{
+		order[c] = static_cast<unsigned int>(c);
+		sortKey[c] = glm::dot(clusterCenter[c] - meshCenter, clusterNormal[c]);
+	}
+	std::stable_sort(order.begin(), order.end(), [&sortKey](unsigned int a, unsigned int b) { return sortKey[a] > sortKey[b]; });
+
+	vector<unsigned int> result;
+	result.reserve(indices.size());
+	for (size_t i = 0; i < order.size(); i++)
+		result.insert(result.end(), indices.begin() + clusters[order[i]] * 3, indices.begin() + clusters[order[i] + 1] * 3);
+
+	// keep the input order if the cache efficiency suffers more than allowed
+	float before = analyzeVertexCache(indices, vertices.size()).acmr;
+	float after = analyzeVertexCache(result, vertices.size()).acmr;
+	if (after <= before * threshold)
+		indices.swap(result);
+}
+
+void MeshOptimizer::optimizeVertexFetch(MeshData &mesh)
+{
+	const unsigned int unused = ~0u;
+	vector<unsigned int> remap(mesh.vertices.size(), unused);
+	vector<Vertex> ordered;
+	ordered.reserve(mesh.vertices.size());
+
+	for (size_t i = 0; i < mesh.indices.size(); i++)
+	{
+		unsigned int &target = remap[mesh.indices[i]];
+		if (target == unused)
+		{
+			target = static_cast<unsigned int>(ordered.size());
+			ordered.push_back(mesh.vertices[mesh.indices[i]]);
+		}
+		mesh.indices[i] = target;
+	}
+
+	// vertices no triangle references are dropped
+	mesh.vertices.swap(ordered);
+}
+
+void MeshOptimizer::splitMesh(const MeshData &mesh, vector<MeshData> &parts, size_t maxVertices)
+{
+	if (mesh.vertices.size() <= maxVertices)
+	{
+		parts.push_back(mesh);
+		return;
+	}
+
+	// new index of each source vertex in the current part, or ~0u if it is not in the part yet
+	const unsigned int unused = ~0u;
+	vector<unsigned int> remap(mesh.vertices.size(), unused);
+	vector<unsigned int> partVertices;
+
+	MeshData part;
+	part.textures = mesh.textures;
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+	{
+		unsigned int missing = 0;
+		for (int k = 0; k < 3; k++)
+			missing += remap[mesh.indices[i + k]] == unused ? 1 : 0;
+
+		// close the part before the triangle would not fit anymore
+		if (part.vertices.size() + missing > maxVertices)
+		{
+			for (unsigned int v : partVertices)
+				remap[v] = unused;
+			partVertices.clear();
+			parts.push_back(part);
+			part.vertices.clear();
+			part.indices.clear();
+		}
+
+		for (int k = 0; k < 3; k++)
+		{
+			unsigned int v = mesh.indices[i + k];
+			if (remap[v] == unused)
+			{
+				remap[v] = static_cast<unsigned int>(part.vertices.size());
+				partVertices.push_back(v);
+				part.vertices.push_back(mesh.vertices[v]);
+			}
+			part.indices.push_back(remap[v]);
+		}
+	}
+
+	if (!part.indices.empty())
+		parts.push_back(part);
+}
+
+// bounding sphere and normal cone of the triangles indices[first, first + count)
+static MeshCluster clusterBounds(const MeshData &mesh, unsigned int first, unsigned int count)
+{
+	MeshCluster cluster;
+	cluster.firstIndex = first;
+	cluster.indexCount = count;
+
+	glm::vec3 minimum = mesh.vertices[mesh.indices[first]].Position, maximum = minimum;
+	for (unsigned int i = first; i < first + count; i++)
+	{
+		minimum = glm::min(minimum, mesh.vertices[mesh.indices[i]].Position);
+		maximum = glm::max(maximum, mesh.vertices[mesh.indices[i]].Position);
+	}
+	cluster.center = (minimum + maximum) * 0.5f;
+	cluster.radius = 0.0f;
+	for (unsigned int i = first; i < first + count; i++)
+		cluster.radius = glm::max(cluster.radius, glm::length(mesh.vertices[mesh.indices[i]].Position - cluster.center));
+
+	// the cone axis is the average triangle normal, its angle covers the normal furthest from it
+	vector<glm::vec3> normals;
+	normals.reserve(count / 3);
+	glm::vec3 axis(0.0f);
+	for (unsigned int i = first; i < first + count; i += 3)
+	{
+		const glm::vec3 &p0 = mesh.vertices[mesh.indices[i]].Position;
+		glm::vec3 normal = glm::cross(mesh.vertices[mesh.indices[i + 1]].Position - p0, mesh.vertices[mesh.indices[i + 2]].Position - p0);
+		float length = glm::length(normal);
+		normals.push_back(length > 0.0f ? normal / length : glm::vec3(0.0f));
+		axis += normals.back();
+	}
+
+	cluster.coneAxis = glm::length(axis) > 0.0f ? glm::normalize(axis) : glm::vec3(0.0f, 0.0f, 1.0f);
+	cluster.coneApex = cluster.center;
+	cluster.coneCutoff = 1.0f;
+
+	float minDot = 1.0f;
+	for (size_t i = 0; i < normals.size(); i++)
+	{
+		if (normals[i] != glm::vec3(0.0f))
+			minDot = glm::min(minDot, glm::dot(cluster.coneAxis, normals[i]));
+	}
+	// normals spread over more than about 84 degrees, some triangle always faces the camera
+	if (minDot <= 0.1f)
+		return cluster;
+
+	// move the apex back along the axis until it lies behind every triangle plane
+	float maxT = 0.0f;
+	for (unsigned int i = first, t = 0; i < first + count; i += 3, t++)
+	{
+		if (normals[t] == glm::vec3(0.0f))
+			continue;
+		const glm::vec3 &p0 = mesh.vertices[mesh.indices[i]].Position;
+		maxT = glm::max(maxT, glm::dot(cluster.center - p0, normals[t]) / glm::dot(cluster.coneAxis, normals[t]));
+	}
+	cluster.coneApex = cluster.center - cluster.coneAxis * maxT;
+	cluster.coneCutoff = sqrtf(1.0f - minDot * minDot);
+	return cluster;
+}
+
+void MeshOptimizer::buildClusters(MeshData &mesh)
+{
+	mesh.clusters.clear();
+	if (mesh.indices.size() / 3 < MIN_CLUSTERED_TRIANGLES)
+		return;
+
+	// vertices of the current cluster, marked with the cluster number
+	vector<unsigned int> usedBy(mesh.vertices.size(), ~0u);
+	unsigned int clusterNumber = 0, vertexCount = 0, first = 0;
+
+	for (unsigned int i = 0; i + 2 < mesh.indices.size(); i += 3)
+	{
+		unsigned int added = 0;
+		for (int k = 0; k < 3; k++)
+			added += usedBy[mesh.indices[i + k]] != clusterNumber ? 1 : 0;
+
+		// close the cluster when the triangle does not fit anymore
+		if (vertexCount + added > MAX_CLUSTER_VERTICES || (i - first) / 3 >= MAX_CLUSTER_TRIANGLES)
+		{
+			mesh.clusters.push_back(clusterBounds(mesh, first, i - first));
+			first = i;
+			vertexCount = 0;
+			clusterNumber++;
+		}
+
+		for (int k = 0; k < 3; k++)
+		{
+			unsigned int &mark = usedBy[mesh.indices[i + k]];
+			if (mark != clusterNumber)
+			{
+				mark = clusterNumber;
+				vertexCount++;
+			}
+		}
+	}
+
+	if (first < mesh.indices.size())
+		mesh.clusters.push_back(clusterBounds(mesh, first, static_cast<unsigned int>(mesh.indices.size()) - first));
+}
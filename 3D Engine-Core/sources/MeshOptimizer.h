@@ -0,0 +1,59 @@
+#pragma once
+
+#include "Mesh.h"
+
+// post-transform vertex cache efficiency of an index buffer
+struct VertexCacheStats
+{
+	unsigned int triangles;
+	unsigned int vertices;
+	unsigned int misses;
+	// average cache miss ratio: transformed vertices per triangle (0.5 is ideal, 3 is worst)
+	float acmr;
+	// average transform to vertex ratio: transformed vertices per unique vertex (1 is ideal)
+	float atvr;
+};
+
+// Import time optimizations of mesh data. All functions are CPU only and work on one mesh, so meshes are optimized in parallel.
+class MeshOptimizer
+{
+public:
+	// size of the simulated post-transform cache, a FIFO like on most GPUs
+	static const unsigned int CACHE_SIZE = 16;
+
+	// vertices addressable with GL_UNSIGNED_SHORT indices
+	static const size_t MAX_SHORT_INDEXED_VERTICES = 65536;
+
+	// cluster limits, about the size of a mesh shader meshlet
+	static const unsigned int MAX_CLUSTER_VERTICES = 64;
+	static const unsigned int MAX_CLUSTER_TRIANGLES = 124;
+	static const unsigned int MIN_CLUSTERED_TRIANGLES = 2 * MAX_CLUSTER_TRIANGLES;
+
+	// runs all stages in order: weld, vertex cache, overdraw, vertex fetch
+	static void optimize(MeshData &mesh);
+
+	// merges bitwise identical vertices and rewrites the indices to the unique ones
+	static void weldVertices(MeshData &mesh);
+
+	// reorders triangles for post-transform cache locality (Forsyth's linear-speed algorithm)
+	static void optimizeVertexCache(vector<unsigned int> &indices, size_t vertexCount);
+
+	// reorders clusters of triangles front to back from the mesh center to reduce overdraw, keeping
+	// the cache miss ratio within threshold times the one of the input order
+	static void optimizeOverdraw(vector<unsigned int> &indices, const vector<Vertex> &vertices, float threshold = 1.05f);
+
+	// reorders the vertices in the order the index buffer first uses them
+	static void optimizeVertexFetch(MeshData &mesh);
+
+	// splits a mesh into parts of at most maxVertices vertices each, in triangle order, so every part can be drawn
+	// with 16 bit indices. Meshes that already fit are passed through unchanged.
+	static void splitMesh(const MeshData &mesh, vector<MeshData> &parts, size_t maxVertices = MAX_SHORT_INDEXED_VERTICES);
+
+	// groups the triangles of the base indices in their current order into clusters of at most MAX_CLUSTER_VERTICES
+	// vertices and MAX_CLUSTER_TRIANGLES triangles, with bounding spheres and normal cones for culling.
+	// Meshes with fewer than MIN_CLUSTERED_TRIANGLES triangles get no clusters.
+	static void buildClusters(MeshData &mesh);
+
+	// simulates the FIFO cache over the index buffer
+	static VertexCacheStats analyzeVertexCache(const vector<unsigned int> &indices, size_t vertexCount, unsigned int cacheSize = CACHE_SIZE);
+};
@@ -0,0 +1,510 @@
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+
+const float MeshSimplifier::MAX_LOD_ERROR = 0.05f;
+
+// weights of the attribute change against the squared position error, positions are normalized to the unit cube
+static const double NORMAL_WEIGHT = 0.001;
+static const double TEXCOORD_WEIGHT = 0.001;
+// open borders are held in place by planes perpendicular to their triangles
+static const double BORDER_WEIGHT = 10.0;
+
+// symmetric 4x4 quadric of the squared distance to a set of planes, with the summed plane weight
+struct Quadric
+{
+	double a00, a01, a02, a11, a12, a22;
+	double b0, b1, b2;
+	double c;
+	double w;
+};
+
+static void quadricFromPlane(Quadric &q, const glm::dvec3 &n, double d, double weight)
+{
+	q.a00 = weight * n.x * n.x; q.a01 = weight * n.x * n.y; q.a02 = weight * n.x * n.z;
+	q.a11 = weight * n.y * n.y; q.a12 = weight * n.y * n.z; q.a22 = weight * n.z * n.z;
+	q.b0 = weight * n.x * d; q.b1 = weight * n.y * d; q.b2 = weight * n.z * d;
+	q.c = weight * d * d;
+	q.w = weight;
+}
+
+static void quadricAdd(Quadric &q, const Quadric &r)
+{
+	q.a00 += r.a00; q.a01 += r.a01; q.a02 += r.a02;
+	q.a11 += r.a11; q.a12 += r.a12; q.a22 += r.a22;
+	q.b0 += r.b0; q.b1 += r.b1; q.b2 += r.b2;
+	q.c += r.c;
+	q.w += r.w;
+}
+
+// mean squared distance of p to the planes of q
+static double quadricError(const Quadric &q, const glm::dvec3 &p)
+{
+	double rx = q.a00 * p.x + q.a01 * p.y + q.a02 * p.z + 2.0 * q.b0;
+	double ry = q.a01 * p.x + q.a11 * p.y + q.a12 * p.z + 2.0 * q.b1;
+	double rz = q.a02 * p.x + q.a12 * p.y + q.a22 * p.z + 2.0 * q.b2;
+	double e = p.x * rx + p.y * ry + p.z * rz + q.c;
+	return q.w > 0.0 ? std::max(e, 0.0) / q.w : 0.0;
+}
+
+// how a position may move, decided once from the topology of the input
+enum VertexKind
+{
+	KIND_MANIFOLD,	// one set of attributes, inside the surface: collapses anywhere
+	KIND_BORDER,	// on an open border: collapses along the border
+	KIND_SEAM,		// two sets of attributes: collapses along the seam, both sides at once
+	KIND_LOCKED		// corners and anything more complex stay
+};
+
+struct PositionHash
+{
+	size_t operator()(const glm::vec3 &p) const
+	{
+		unsigned int words[3];
+		std::memcpy(words, &p, sizeof(words));
+		return (words[0] * 73856093u) ^ (words[1] * 19349663u) ^ (words[2] * 83492791u);
+	}
+};
+
+static inline unsigned long long edgeKey(unsigned int a, unsigned int b)
+{
+	return (static_cast<unsigned long long>(a) << 32) | b;
+}
+
+struct Collapse
+{
+	unsigned int from;	// vertex whose position goes away
+	unsigned int to;	// vertex of the remaining position at the other end of the edge
+	double cost;
+};
+
+struct CollapseCheaper
+{
+	bool operator()(const Collapse &a, const Collapse &b) const { return a.cost < b.cost; }
+};
+
+class Simplification
+{
+public:
+	Simplification(const vector<unsigned int> &indices, const vector<Vertex> &vertices)
+		: vertices(vertices), vertexCount(vertices.size())
+	{
+		normalizePositions();
+		buildPositionRemap();
+		classifyVertices(indices);
+		buildQuadrics(indices);
+	}
+
+	float run(vector<unsigned int> &indices, size_t targetIndexCount, float targetError)
+	{
+		const double errorLimit = double(targetError) * targetError;
+		double maxError = 0.0;
+
+		while (indices.size() > targetIndexCount)
+		{
+			buildAdjacency(indices);
+
+			vector<Collapse> collapses;
+			pickCollapses(indices, collapses);
+			std::sort(collapses.begin(), collapses.end(), CollapseCheaper());
+
+			// every position takes part in at most one collapse per pass, and the neighbourhood of a collapse
+			// is left alone so the flip test against the current positions stays valid
+			vector<char> touched(this->vertexCount, 0);
+			vector<unsigned int> collapseRemap(this->vertexCount);
+			for (size_t i = 0; i < this->vertexCount; i++)
+				collapseRemap[i] = static_cast<unsigned int>(i);
+
+			size_t removable = (indices.size() - targetIndexCount) / 3;
+			size_t removed = 0;
+			bool collapsed = false;
+			for (size_t i = 0; i < collapses.size() && removed < removable; i++)
+			{
+				const Collapse &c = collapses[i];
+				if (c.cost > errorLimit)
+					break;
+
+				unsigned int from = this->remap[c.from], to = this->remap[c.to];
+				if (touched[from] || touched[to] || flips(indices, from, to))
+					continue;
+
+				applyCollapse(c, collapseRemap);
+				quadricAdd(this->quadrics[to], this->quadrics[from]);
+				maxError = std::max(maxError, c.cost);
+				collapsed = true;
+
+				for (unsigned int t = this->firstTriangle[from]; t < this->firstTriangle[from + 1]; t++)
+				{
+					unsigned int triangle = this->triangles[t];
+					bool shared = false;
+					for (int k = 0; k < 3; k++)
+					{
+						unsigned int p = this->remap[indices[triangle * 3 + k]];
+						touched[p] = 1;
+						shared = shared || p == to;
+					}
+					removed += shared ? 1 : 0;
+				}
+			}
+
+			if (!collapsed)
+				break;
+
+			// rewrite the triangles, dropping the ones that lost an edge
+			size_t write = 0;
+			for (size_t i = 0; i < indices.size(); i += 3)
+			{
+				unsigned int a = collapseRemap[indices[i]], b = collapseRemap[indices[i + 1]], c = collapseRemap[indices[i + 2]];
+				unsigned int pa = this->remap[a], pb = this->remap[b], pc = this->remap[c];
+				if (pa == pb || pb == pc || pc == pa)
+					continue;
+				indices[write++] = a;
+				indices[write++] = b;
+				indices[write++] = c;
+			}
+			indices.resize(write);
+		}
+
+		return static_cast<float>(std::sqrt(maxError) * this->scale);
+	}
+
+private:
+	const vector<Vertex> &vertices;
+	size_t vertexCount;
+
+	vector<glm::dvec3> positions;	// in the unit cube of the mesh bounds
+	double scale;
+
+	vector<unsigned int> remap;		// vertex -> first vertex with the same position
+	vector<unsigned int> wedges;	// vertex -> next vertex with the same position, circular
+	vector<unsigned char> kinds;	// per position
+	std::unordered_set<unsigned long long> borderEdges;	// directed position edges without a twin
+	std::unordered_set<unsigned long long> openEdges;	// directed vertex edges without a twin: borders and seams
+
+	vector<Quadric> quadrics;		// per position
+
+	// position -> triangles using it, rebuilt every pass
+	vector<unsigned int> firstTriangle;
+	vector<unsigned int> triangles;
+
+	void normalizePositions()
+	{
+		glm::vec3 minimum(0.0f), maximum(0.0f);
+		if (this->vertexCount > 0)
+			minimum = maximum = this->vertices[0].Position;
+		for (size_t i = 1; i < this->vertexCount; i++)
+		{
+			minimum = glm::min(minimum, this->vertices[i].Position);
+			maximum = glm::max(maximum, this->vertices[i].Position);
+		}
+
+		glm::vec3 extent = maximum - minimum;
+		this->scale = std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-6f));
+
+		this->positions.resize(this->vertexCount);
+		for (size_t i = 0; i < this->vertexCount; i++)
+			this->positions[i] = glm::dvec3(this->vertices[i].Position - minimum) / this->scale;
+	}
+
+	void buildPositionRemap()
+	{
+		this->remap.resize(this->vertexCount);
+		this->wedges.resize(this->vertexCount);
+
+		std::unordered_map<glm::vec3, unsigned int, PositionHash> first(this->vertexCount * 2);
+		for (size_t i = 0; i < this->vertexCount; i++)
+		{
+			unsigned int index = static_cast<unsigned int>(i);
+			std::pair<std::unordered_map<glm::vec3, unsigned int, PositionHash>::iterator, bool> inserted =
+				first.insert(std::make_pair(this->vertices[i].Position, index));
+			unsigned int representative = inserted.first->second;
+			this->remap[i] = representative;
+
+			// link into the wedge ring of the position
+			if (representative == index)
+				this->wedges[i] = index;
+			else
+			{
+				this->wedges[i] = this->wedges[representative];
+				this->wedges[representative] = index;
+			}
+		}
+	}
+
+	void classifyVertices(const vector<unsigned int> &indices)
+	{
+		std::unordered_set<unsigned long long> positionEdges, vertexEdges;
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int a = indices[i + k], b = indices[i + (k + 1) % 3];
+				vertexEdges.insert(edgeKey(a, b));
+				positionEdges.insert(edgeKey(this->remap[a], this->remap[b]));
+			}
+		}
+
+		vector<unsigned int> borderIn(this->vertexCount, 0), borderOut(this->vertexCount, 0);
+		vector<unsigned int> openIn(this->vertexCount, 0), openOut(this->vertexCount, 0);
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int a = indices[i + k], b = indices[i + (k + 1) % 3];
+				unsigned int pa = this->remap[a], pb = this->remap[b];
+				if (positionEdges.count(edgeKey(pb, pa)) == 0 && this->borderEdges.insert(edgeKey(pa, pb)).second)
+				{
+					borderOut[pa]++;
+					borderIn[pb]++;
+				}
+				if (vertexEdges.count(edgeKey(b, a)) == 0 && this->openEdges.insert(edgeKey(a, b)).second)
+				{
+					openOut[a]++;
+					openIn[b]++;
+				}
+			}
+		}
+
+		this->kinds.assign(this->vertexCount, KIND_LOCKED);
+		for (size_t i = 0; i < this->vertexCount; i++)
+		{
+			if (this->remap[i] != i)
+				continue;
+
+			unsigned int wedgeCount = 0;
+			bool cleanSeam = true;
+			unsigned int w = static_cast<unsigned int>(i);
+			do
+			{
+				wedgeCount++;
+				cleanSeam = cleanSeam && openIn[w] == 1 && openOut[w] == 1;
+				w = this->wedges[w];
+			} while (w != i);
+
+			bool border = borderIn[i] > 0 || borderOut[i] > 0;
+			if (wedgeCount == 1 && !border)
+				this->kinds[i] = KIND_MANIFOLD;
+			else if (wedgeCount == 1 && borderIn[i] == 1 && borderOut[i] == 1)
+				this->kinds[i] = KIND_BORDER;
+			else if (wedgeCount == 2 && !border && cleanSeam)
+				this->kinds[i] = KIND_SEAM;
+		}
+	}
+
+	void buildQuadrics(const vector<unsigned int> &indices)
+	{
+		Quadric zero;
+		std::memset(&zero, 0, sizeof(zero));
+		this->quadrics.assign(this->vertexCount, zero);
+
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			unsigned int p[3] = { this->remap[indices[i]], this->remap[indices[i + 1]], this->remap[indices[i + 2]] };
+			glm::dvec3 p0 = this->positions[p[0]], p1 = this->positions[p[1]], p2 = this->positions[p[2]];
+
+			glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+			double area = glm::length(normal);
+			if (area == 0.0)
+				continue;
+			normal /= area;
+
+			Quadric q;
+			quadricFromPlane(q, normal, -glm::dot(normal, p0), area * 0.5);
+			for (int k = 0; k < 3; k++)
+				quadricAdd(this->quadrics[p[k]], q);
+
+			// border edges get a plane through the edge standing on the triangle
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int a = p[k], b = p[(k + 1) % 3];
+				if (this->borderEdges.count(edgeKey(a, b)) == 0)
+					continue;
+
+				glm::dvec3 edge = this->positions[b] - this->positions[a];
+				double length = glm::length(edge);
+				if (length == 0.0)
+					continue;
+				glm::dvec3 side = glm::normalize(glm::cross(edge, normal));
+
+				Quadric border;
+				quadricFromPlane(border, side, -glm::dot(side, this->positions[a]), length * length * BORDER_WEIGHT);
+				quadricAdd(this->quadrics[a], border);
+				quadricAdd(this->quadrics[b], border);
+			}
+		}
+	}
+
+	void buildAdjacency(const vector<unsigned int> &indices)
+	{
+		this->firstTriangle.assign(this->vertexCount + 1, 0);
+		for (size_t i = 0; i < indices.size(); i++)
+			this->firstTriangle[this->remap[indices[i]] + 1]++;
+		for (size_t i = 0; i < this->vertexCount; i++)
+			this->firstTriangle[i + 1] += this->firstTriangle[i];
+
+		vector<unsigned int> fill(this->firstTriangle.begin(), this->firstTriangle.end() - 1);
+		this->triangles.resize(indices.size());
+		for (size_t i = 0; i < indices.size(); i++)
+			this->triangles[fill[this->remap[indices[i]]]++] = static_cast<unsigned int>(i / 3);
+	}
+
+	bool isOpen(unsigned int a, unsigned int b) const
+	{
+		return this->openEdges.count(edgeKey(a, b)) != 0 || this->openEdges.count(edgeKey(b, a)) != 0;
+	}
+
+	// wedge of the target position on the same side of the seam as wedge from, or ~0u
+	unsigned int seamPartner(unsigned int from, unsigned int to) const
+	{
+		unsigned int w = to;
+		do
+		{
+			if (isOpen(from, w))
+				return w;
+			w = this->wedges[w];
+		} while (w != to);
+		return ~0u;
+	}
+
+	double attributeError(unsigned int from, unsigned int to) const
+	{
+		const Vertex &a = this->vertices[from], &b = this->vertices[to];
+		glm::vec3 dn = a.Normal - b.Normal;
+		glm::vec2 dt = a.TexCoords - b.TexCoords;
+		return NORMAL_WEIGHT * glm::dot(dn, dn) + TEXCOORD_WEIGHT * glm::dot(dt, dt);
+	}
+
+	// cost of moving vertex from onto vertex to, negative if the collapse would damage a border or seam
+	double collapseCost(unsigned int from, unsigned int to) const
+	{
+		unsigned int pf = this->remap[from], pt = this->remap[to];
+		unsigned char kind = this->kinds[pf], target = this->kinds[pt];
+
+		double cost = quadricError(this->quadrics[pf], this->positions[pt]);
+		switch (kind)
+		{
+		case KIND_MANIFOLD:
+			return cost + attributeError(from, to);
+
+		case KIND_BORDER:
+			if ((target != KIND_BORDER && target != KIND_LOCKED) ||
+				(this->borderEdges.count(edgeKey(pf, pt)) == 0 && this->borderEdges.count(edgeKey(pt, pf)) == 0))
+				return -1.0;
+			return cost + attributeError(from, to);
+
+		case KIND_SEAM:
+		{
+			if ((target != KIND_SEAM && target != KIND_LOCKED) || !isOpen(from, to))
+				return -1.0;
+			// the other side of the seam has to follow along its own seam edge
+			unsigned int other = this->wedges[from];
+			unsigned int otherTo = seamPartner(other, to);
+			if (otherTo == ~0u)
+				return -1.0;
+			return cost + attributeError(from, to) + attributeError(other, otherTo);
+		}
+
+		default:
+			return -1.0;
+		}
+	}
+
+	void pickCollapses(const vector<unsigned int> &indices, vector<Collapse> &collapses) const
+	{
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int a = indices[i + k], b = indices[i + (k + 1) % 3];
+				unsigned int pa = this->remap[a], pb = this->remap[b];
+				// each edge once per triangle in one direction, both collapse directions are evaluated
+				if (pa >= pb)
+					continue;
+
+				double ab = collapseCost(a, b), ba = collapseCost(b, a);
+				if (ab < 0.0 && ba < 0.0)
+					continue;
+
+				Collapse c;
+				bool forward = ba < 0.0 || (ab >= 0.0 && ab <= ba);
+				c.from = forward ? a : b;
+				c.to = forward ? b : a;
+				c.cost = forward ? ab : ba;
+				collapses.push_back(c);
+			}
+		}
+	}
+
+	// true if moving position from onto position to turns a remaining triangle around
+	bool flips(const vector<unsigned int> &indices, unsigned int from, unsigned int to) const
+	{
+		const glm::dvec3 &target = this->positions[to];
+		for (unsigned int t = this->firstTriangle[from]; t < this->firstTriangle[from + 1]; t++)
+		{
+			unsigned int triangle = this->triangles[t];
+			unsigned int p[3] = { this->remap[indices[triangle * 3]], this->remap[indices[triangle * 3 + 1]], this->remap[indices[triangle * 3 + 2]] };
+			if (p[0] == to || p[1] == to || p[2] == to)
+				continue; // collapses to nothing
+
+			glm::dvec3 before[3] = { this->positions[p[0]], this->positions[p[1]], this->positions[p[2]] };
+			glm::dvec3 after[3] = { before[0], before[1], before[2] };
+			for (int k = 0; k < 3; k++)
+				if (p[k] == from)
+					after[k] = target;
+
+			glm::dvec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+			glm::dvec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+			if (glm::dot(n0, n1) <= 0.0)
+				return true;
+		}
+		return false;
+	}
+
+	void applyCollapse(const Collapse &c, vector<unsigned int> &collapseRemap) const
+	{
+		collapseRemap[c.from] = c.to;
+		if (this->kinds[this->remap[c.from]] == KIND_SEAM)
+		{
+			unsigned int other = this->wedges[c.from];
+			collapseRemap[other] = seamPartner(other, c.to);
+		}
+	}
+};
+
+float MeshSimplifier::simplify(const vector<unsigned int> &indices, const vector<Vertex> &vertices, size_t targetIndexCount, float targetError, vector<unsigned int> &result)
+{
+	result = indices;
+	if (indices.size() <= targetIndexCount)
+		return 0.0f;
+
+	Simplification simplification(indices, vertices);
+	return simplification.run(result, targetIndexCount, targetError);
+}
+
+void MeshSimplifier::generateLods(MeshData &mesh)
+{
+	mesh.lods.clear();
+
+	size_t previousCount = mesh.indices.size();
+	for (unsigned int level = 1; level <= LOD_LEVELS; level++)
+	{
+		// every level starts from the base mesh, so its error is measured against the full detail
+		size_t target = (mesh.indices.size() >> level) / 3 * 3;
+
+		MeshLod lod;
+		lod.error = simplify(mesh.indices, mesh.vertices, target, MAX_LOD_ERROR, lod.indices);
+
+		// a level that barely removes anything is not worth its memory, and the next would not get further
+		if (lod.indices.empty() || lod.indices.size() > previousCount * 9 / 10)
+			break;
+
+		MeshOptimizer::optimizeVertexCache(lod.indices, mesh.vertices.size());
+		previousCount = lod.indices.size();
+		mesh.lods.push_back(lod);
+	}
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "Mesh.h"
+
+// Import time mesh simplification for LOD chains. Edges are collapsed into one of their vertices in order of
+// the quadric error, so a simplified level is only a new index buffer over the vertices of the base mesh.
+// Texture and normal seams and open borders are kept: their vertices only collapse along the seam or border,
+// and the error includes how much the normals and texture coordinates of the collapsed vertex change.
+class MeshSimplifier
+{
+public:
+	// LOD levels below the base mesh, each halving the triangle count of the previous one
+	static const unsigned int LOD_LEVELS = 3;
+
+	// largest error a level may have, relative to the size of the mesh
+	static const float MAX_LOD_ERROR;
+
+	// reduces indices to about targetIndexCount indices without exceeding targetError (relative to the mesh size).
+	// Returns the error of the result in the units of the vertex positions.
+	static float simplify(const vector<unsigned int> &indices, const vector<Vertex> &vertices, size_t targetIndexCount, float targetError, vector<unsigned int> &result);
+
+	// fills mesh.lods with up to LOD_LEVELS levels, stopping when a level barely reduces the previous one
+	static void generateLods(MeshData &mesh);
+};
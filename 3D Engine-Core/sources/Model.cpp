@@ -1,109 +1,459 @@
 #include "Model.h"
-#include <stb_image.h>
+#include "GLState.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "ObjLoader.h"
+#include "ThreadPool.h"
+#include "TextureLoader.h"
+#include "TextureRegistry.h"
+#include "TextureStreamer.h"
 
+#include <assimp/ProgressHandler.hpp>
 
-Model::Model(string const &path, bool gamma) : gammaCorrection(gamma)
+#include <cctype>
+#include <cfloat>
+#include <set>
+
+bool Model::optimizeMeshes = true;
+bool Model::generateLods = true;
+bool Model::buildClusters = true;
+bool Model::useObjLoader = true;
+
+Model::Model(string const &path, bool gamma) : gammaCorrection(gamma), instanceRevision(0)
 {
 	loadModel(path);
 	this->position = glm::vec3(0.0f, 0.0f, 0.0f);
 	this->scale = glm::vec3(1.0f, 1.0f, 1.0f);
 	this->rotation = glm::vec3(0.0f, 0.0f, 0.0f);
+	clearInstances();
+}
+
+Model::Model() : gammaCorrection(false), instanceRevision(0)
+{
+	this->position = glm::vec3(0.0f, 0.0f, 0.0f);
+	this->scale = glm::vec3(1.0f, 1.0f, 1.0f);
+	this->rotation = glm::vec3(0.0f, 0.0f, 0.0f);
+	clearInstances();
+}
+
+Model::~Model()
+{
+	for(unsigned int i = 0; i < meshes.size(); i++)
+		meshes[i].release();
+
+	for(unordered_map<string, Texture>::iterator it = textures_loaded.begin(); it != textures_loaded.end(); ++it)
+		TextureRegistry::shared().release(it->second.id);
+}
+
+unsigned int Model::addInstance(const glm::mat4 &transform, const glm::vec4 &tint)
+{
+	ModelInstance instance = { transform, tint };
+	instances.push_back(instance);
+	instanceRevision++;
+	return static_cast<unsigned int>(instances.size() - 1);
+}
+
+void Model::clearInstances()
+{
+	ModelInstance self = { glm::mat4(1.0f), glm::vec4(1.0f) };
+	instances.assign(1, self);
+	instanceRevision++;
+}
+
+void Model::placeCopies(unsigned int count)
+{
+	clearInstances();
+
+	glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+	for(unsigned int i = 0; i < meshes.size(); i++)
+	{
+		boundsMin = glm::min(boundsMin, meshes[i].boundsMin);
+		boundsMax = glm::max(boundsMax, meshes[i].boundsMax);
+	}
+	const float spacing = meshes.empty() ? 1.0f : glm::max(boundsMax.x - boundsMin.x, boundsMax.z - boundsMin.z) * 1.25f;
+	const unsigned int columns = static_cast<unsigned int>(glm::ceil(glm::sqrt(static_cast<float>(count))));
+
+	// the first cell is the model itself
+	for(unsigned int i = 1; i < count; i++)
+	{
+		glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3((i % columns) * spacing, 0.0f, (i / columns) * spacing));
+		float shade = static_cast<float>(i * 7 % 16) / 15.0f;
+		addInstance(transform, glm::vec4(glm::mix(glm::vec3(1.0f), glm::vec3(0.7f, 0.8f, 1.0f), shade), 1.0f));
+	}
+}
+
+// errors and densities are in mesh units, the largest axis scale of the model converts them to world units
+static float unitScaleOf(const glm::mat4 &transform)
+{
+	return glm::max(glm::length(glm::vec3(transform[0])), glm::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+}
+
+// distance to the nearest point of the bounding sphere of a mesh, so a camera inside it gets full detail
+static float meshDistance(const Mesh &mesh, const glm::mat4 &transform, float unitScale, const glm::vec3 &cameraPosition)
+{
+	glm::vec3 center = glm::vec3(transform * glm::vec4(mesh.boundsCenter, 1.0f));
+	return glm::max(glm::length(center - cameraPosition) - mesh.boundsRadius * unitScale, 1e-4f);
+}
+
+// screen pixels one mesh unit covers at the nearest visible instance, or the nearest of all when none is visible,
+// for a projectionScale of 1. Also gives the distance to that instance.
+static float pixelsPerUnit(const Mesh &mesh, const vector<ModelInstance> &instances, const glm::mat4 &transform,
+	const glm::vec3 &cameraPosition, float &distance)
+{
+	const unsigned int count = static_cast<unsigned int>(mesh.visibleInstances.empty() ? instances.size() : mesh.visibleInstances.size());
+	float best = 0.0f;
+	distance = FLT_MAX;
+	for(unsigned int i = 0; i < count; i++)
+	{
+		unsigned int instance = mesh.visibleInstances.empty() ? i : mesh.visibleInstances[i];
+		glm::mat4 instanceTransform = transform * instances[instance].transform;
+		float unitScale = unitScaleOf(instanceTransform);
+		float instanceDistance = meshDistance(mesh, instanceTransform, unitScale, cameraPosition);
+		if(unitScale / instanceDistance > best)
+		{
+			best = unitScale / instanceDistance;
+			distance = instanceDistance;
+		}
+	}
+	return best;
+}
+
+void Model::submit(RenderQueue &queue, Shader &shader, const glm::mat4 &transform, const glm::vec3 &cameraPosition)
+{
+	for(unsigned int i = 0; i < meshes.size(); i++)
+	{
+		Mesh &mesh = meshes[i];
+		if(mesh.visibleInstances.empty() || !mesh.hasVisibleGeometry())
+		{
+			mesh.clustersCulled = false;
+			continue;
+		}
+
+		float distance;
+		pixelsPerUnit(mesh, instances, transform, cameraPosition, distance);
+		DrawInstance *drawInstances = queue.submit(shader, mesh, static_cast<unsigned int>(mesh.visibleInstances.size()), distance);
+		for(unsigned int j = 0; j < mesh.visibleInstances.size(); j++)
+		{
+			const ModelInstance &instance = instances[mesh.visibleInstances[j]];
+			drawInstances[j].transform = transform * instance.transform;
+			drawInstances[j].tint = instance.tint;
+			drawInstances[j].positionOffset = mesh.positionOffset;
+			drawInstances[j].positionScale = mesh.positionScale;
+		}
+	}
+}
+
+void Model::selectLods(const glm::mat4 &transform, const glm::vec3 &cameraPosition, float projectionScale, float maxPixelError, RenderStats &stats)
+{
+	const size_t copies = instances.size();
+
+	for(unsigned int i = 0; i < meshes.size(); i++)
+	{
+		Mesh &mesh = meshes[i];
+		float distance;
+		mesh.selectLod(pixelsPerUnit(mesh, instances, transform, cameraPosition, distance) * projectionScale, maxPixelError);
+
+		stats.fullTriangles += mesh.triangleCount(0) * copies;
+		stats.lodTriangles += mesh.triangleCount(mesh.currentLod) * copies;
+		stats.frustumCulledTriangles += mesh.triangleCount(mesh.currentLod) * (copies - mesh.visibleInstances.size());
+	}
 }
 
-void Model::Draw(Shader shader)
+void Model::requestTextures(const glm::mat4 &transform, const glm::vec3 &cameraPosition, float projectionScale)
 {
 	for(unsigned int i = 0; i < meshes.size(); i++)
-		meshes[i].Draw(shader);
+	{
+		const Mesh &mesh = meshes[i];
+		if(mesh.uvDensity <= 0.0f || mesh.visibleInstances.empty())
+			continue;
+
+		// screen pixels per texture coordinate unit at the nearest point of the mesh
+		float distance;
+		float pixelsPerUv = pixelsPerUnit(mesh, instances, transform, cameraPosition, distance) * projectionScale / mesh.uvDensity;
+		for(unsigned int j = 0; j < mesh.textures.size(); j++)
+			TextureStreamer::shared().request(mesh.textures[j].id, pixelsPerUv);
+	}
 }
 
+void Model::cullClusters(const glm::mat4 &viewProjection, const glm::mat4 &transform, const glm::vec3 &cameraPosition, RenderStats &stats)
+{
+	// the clusters visible differ between instances, copies draw whole levels
+	if(instances.size() > 1)
+	{
+		for(unsigned int i = 0; i < meshes.size(); i++)
+			stats.drawnTriangles += meshes[i].triangleCount(meshes[i].currentLod) * meshes[i].visibleInstances.size();
+		return;
+	}
+
+	// cull in object space: planes of the full matrix and the camera moved into the model
+	glm::mat4 instanceTransform = this->instanceTransform(transform, 0);
+	Frustum frustum(viewProjection * instanceTransform);
+	glm::vec3 localCamera = glm::vec3(glm::inverse(instanceTransform) * glm::vec4(cameraPosition, 1.0f));
+
+	for(unsigned int i = 0; i < meshes.size(); i++)
+	{
+		if(!meshes[i].visibleInstances.empty())
+			stats.drawnTriangles += meshes[i].cullClusters(frustum, localCamera, stats.clusters, stats.culledClusters);
+	}
+}
+
+// lets an import running on a worker thread be aborted from the outside
+class CancelProgressHandler : public Assimp::ProgressHandler
+{
+public:
+	CancelProgressHandler(const std::atomic<bool> *cancel) : cancel(cancel) {}
+
+	bool Update(float)
+	{
+		return !cancel->load();
+	}
+
+private:
+	const std::atomic<bool> *cancel;
+};
+
 void Model::loadModel(string const &path)
+{
+	// retrieve the directory path of the filepath
+	this->path = path;
+	directory = path.substr(0, path.find_last_of('/'));
+
+	vector<MeshData> meshData;
+	if(!importMeshData(path, meshData))
+		return;
+
+	// decode every texture of the model that is not resident yet in parallel, then upload them here while creating the meshes
+	map<string, DecodedImage> decoded = TextureLoader::decodeAll(directory, referencedTextures(meshData, directory, true));
+
+	meshes.reserve(meshData.size());
+	for(unsigned int i = 0; i < meshData.size(); i++)
+		addMesh(meshData[i], &decoded);
+}
+
+map<string, TextureUsage> Model::referencedTextures(const vector<MeshData> &meshData, const string &directory, bool skipResident)
+{
+	map<string, TextureUsage> usages;
+	for(unsigned int i = 0; i < meshData.size(); i++)
+	{
+		for(unsigned int j = 0; j < meshData[i].textures.size(); j++)
+		{
+			const TextureRef &ref = meshData[i].textures[j];
+			TextureUsage usage = TextureLoader::usageOf(ref.type);
+			map<string, TextureUsage>::iterator found = usages.find(ref.path);
+			if(found == usages.end())
+				usages[ref.path] = usage;
+			else if(found->second != usage)
+				found->second = TEXTURE_USAGE_COLOR;
+		}
+	}
+
+	map<string, TextureUsage> result;
+	for(map<string, TextureUsage>::const_iterator it = usages.begin(); it != usages.end(); ++it)
+	{
+		if(!skipResident || !TextureRegistry::shared().contains(directory + '/' + it->first, it->second))
+			result.insert(*it);
+	}
+	return result;
+}
+
+bool Model::readsWithObjLoader(string const &path)
+{
+	if(!useObjLoader || path.size() < 4)
+		return false;
+	string extension = path.substr(path.size() - 4);
+	for(unsigned int i = 0; i < extension.size(); i++)
+		extension[i] = (char)tolower((unsigned char)extension[i]);
+	return extension == ".obj";
+}
+
+unsigned int Model::importKey(string const &path)
+{
+	return IMPORT_FLAGS | (optimizeMeshes ? OPTIMIZED_FLAG : 0u) | (generateLods ? LOD_FLAG : 0u) | (buildClusters ? CLUSTER_FLAG : 0u)
+		| (readsWithObjLoader(path) ? OBJ_LOADER_FLAG : 0u);
+}
+
+bool Model::importWithAssimp(string const &path, vector<MeshData> &meshData, const std::atomic<bool> *cancel)
 {
 	// read file via ASSIMP
 	Assimp::Importer importer;
-	const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+	if(cancel)
+		importer.SetProgressHandler(new CancelProgressHandler(cancel)); // owned by the importer
+	const aiScene* scene = importer.ReadFile(path, IMPORT_FLAGS);
 	// check for errors
 	if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
 	{
-		cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
-		return;
+		if(!cancel || !cancel->load())
+			cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+		return false;
 	}
-	// retrieve the directory path of the filepath
-	directory = path.substr(0, path.find_last_of('/'));
 
-	// process ASSIMP's root node recursively
-	processNode(scene->mRootNode, scene);
+	// process ASSIMP's root node recursively, then convert all collected meshes on the worker pool.
+	// Only the GL upload in addMesh has to happen on the context thread.
+	vector<aiMesh*> sceneMeshes;
+	processNode(scene->mRootNode, scene, sceneMeshes);
+
+	meshData.resize(sceneMeshes.size());
+	ThreadPool::shared().parallelFor(sceneMeshes.size(), [&](size_t i)
+	{
+		meshData[i] = processMesh(sceneMeshes[i], scene);
+	});
+	return true;
 }
 
-void Model::processNode(aiNode *node, const aiScene *scene)
+bool Model::importMeshData(string const &path, vector<MeshData> &meshData, const std::atomic<bool> *cancel)
+{
+	// a warm cache skips parsing entirely
+	const unsigned int key = importKey(path);
+	if(MeshCache::load(path, key, meshData))
+		return true;
+
+	// .obj files have a native parser, everything else goes through ASSIMP
+	bool imported = readsWithObjLoader(path) ? ObjLoader::load(path, meshData, cancel) : importWithAssimp(path, meshData, cancel);
+	if(!imported)
+		return false;
+
+	vector<VertexCacheStats> before(meshData.size()), after(meshData.size());
+	const bool optimize = optimizeMeshes;
+	if(optimize)
+	{
+		ThreadPool::shared().parallelFor(meshData.size(), [&](size_t i)
+		{
+			before[i] = MeshOptimizer::analyzeVertexCache(meshData[i].indices, meshData[i].vertices.size());
+			MeshOptimizer::optimize(meshData[i]);
+			after[i] = MeshOptimizer::analyzeVertexCache(meshData[i].indices, meshData[i].vertices.size());
+		});
+		reportOptimization(path, before, after);
+	}
+
+	// split meshes with more vertices than 16 bit indices can address
+	vector<MeshData> parts;
+	parts.reserve(meshData.size());
+	for(unsigned int i = 0; i < meshData.size(); i++)
+		MeshOptimizer::splitMesh(meshData[i], parts, MeshOptimizer::MAX_SHORT_INDEXED_VERTICES);
+	if(parts.size() != meshData.size())
+		cout << "MESH_OPTIMIZER:: " << path << ": split " << meshData.size() << " meshes into " << parts.size() << " for 16 bit indices" << endl;
+	meshData.swap(parts);
+
+	// clusters and levels of detail of the final meshes, so they index the same vertices
+	const bool clusters = buildClusters, lods = generateLods;
+	ThreadPool::shared().parallelFor(meshData.size(), [&](size_t i)
+	{
+		if(clusters)
+			MeshOptimizer::buildClusters(meshData[i]);
+		if(lods)
+			MeshSimplifier::generateLods(meshData[i]);
+	});
+
+	if(lods)
+	{
+		// triangles per level over all meshes, meshes without a level count at their previous one
+		vector<size_t> triangles(MeshSimplifier::LOD_LEVELS + 1, 0);
+		for(unsigned int i = 0; i < meshData.size(); i++)
+		{
+			size_t count = meshData[i].indices.size() / 3;
+			for(unsigned int level = 0; level < triangles.size(); level++)
+			{
+				if(level > 0 && level <= meshData[i].lods.size())
+					count = meshData[i].lods[level - 1].indices.size() / 3;
+				triangles[level] += count;
+			}
+		}
+		cout << "MESH_SIMPLIFIER:: " << path << ": triangles per level";
+		for(unsigned int level = 0; level < triangles.size(); level++)
+			cout << (level ? " -> " : " ") << triangles[level];
+		cout << endl;
+	}
+
+	if(!MeshCache::store(path, key, meshData))
+		cout << "WARNING::MESH_CACHE:: could not write " << MeshCache::cachePath(path) << endl;
+	return true;
+}
+
+void Model::reportOptimization(string const &path, const vector<VertexCacheStats> &before, const vector<VertexCacheStats> &after)
+{
+	// totals over all meshes of the model, ACMR is per triangle and ATVR per unique vertex
+	unsigned int triangles = 0, verticesBefore = 0, verticesAfter = 0, missesBefore = 0, missesAfter = 0;
+	for(unsigned int i = 0; i < before.size(); i++)
+	{
+		triangles += before[i].triangles;
+		verticesBefore += before[i].vertices;
+		verticesAfter += after[i].vertices;
+		missesBefore += before[i].misses;
+		missesAfter += after[i].misses;
+	}
+	if(triangles == 0)
+		return;
+
+	cout << "MESH_OPTIMIZER:: " << path << ": " << triangles << " triangles, vertices " << verticesBefore << " -> " << verticesAfter
+		<< ", ACMR " << float(missesBefore) / triangles << " -> " << float(missesAfter) / triangles
+		<< ", ATVR " << float(missesBefore) / verticesBefore << " -> " << float(missesAfter) / verticesAfter << endl;
+}
+
+void Model::processNode(aiNode *node, const aiScene *scene, vector<aiMesh*> &sceneMeshes)
 {
 	// process each mesh located at the current node
 	for(unsigned int i = 0; i < node->mNumMeshes; i++)
 	{
 		// the node object only contains indices to index the actual objects in the scene. 
 		// the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
-		aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-		meshes.push_back(processMesh(mesh, scene));
+		sceneMeshes.push_back(scene->mMeshes[node->mMeshes[i]]);
 	}
 	// after we've processed all of the meshes (if any) we then recursively process each of the children nodes
 	for(unsigned int i = 0; i < node->mNumChildren; i++)
 	{
-		processNode(node->mChildren[i], scene);
+		processNode(node->mChildren[i], scene, sceneMeshes);
 	}
 
 }
 
-Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene)
+MeshData Model::processMesh(aiMesh *mesh, const aiScene *scene)
 {
 	// data to fill
-	vector<Vertex> vertices;
-	vector<unsigned int> indices;
-	vector<Texture> textures;
+	MeshData data;
+	vector<Vertex> &vertices = data.vertices;
+	vector<unsigned int> &indices = data.indices;
+	vector<TextureRef> &textures = data.textures;
 
-	// Walk through each of the mesh's vertices
+	// Walk through each of the mesh's vertices, writing straight into the sized array
+	vertices.resize(mesh->mNumVertices);
 	for(unsigned int i = 0; i < mesh->mNumVertices; i++)
 	{
-		Vertex vertex;
-		glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
-						  // positions
-		vector.x = mesh->mVertices[i].x;
-		vector.y = mesh->mVertices[i].y;
-		vector.z = mesh->mVertices[i].z;
-		vertex.Position = vector;
+		Vertex &vertex = vertices[i];
+		// positions
+		vertex.Position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
 		// normals
-		vector.x = mesh->mNormals[i].x;
-		vector.y = mesh->mNormals[i].y;
-		vector.z = mesh->mNormals[i].z;
-		vertex.Normal = vector;
+		if(mesh->mNormals)
+			vertex.Normal = glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
+		else
+			vertex.Normal = glm::vec3(0.0f, 0.0f, 0.0f);
 		// texture coordinates
 		if(mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
 		{
-			glm::vec2 vec;
 			// a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't 
 			// use models where a vertex can have multiple texture coordinates so we always take the first set (0).
-			vec.x = mesh->mTextureCoords[0][i].x;
-			vec.y = mesh->mTextureCoords[0][i].y;
-			vertex.TexCoords = vec;
+			vertex.TexCoords = glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
 		} else
 			vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-		// tangent
-		vector.x = mesh->mTangents[i].x;
-		vector.y = mesh->mTangents[i].y;
-		vector.z = mesh->mTangents[i].z;
-		vertex.Tangent = vector;
-		// bitangent
-		vector.x = mesh->mBitangents[i].x;
-		vector.y = mesh->mBitangents[i].y;
-		vector.z = mesh->mBitangents[i].z;
-		vertex.Bitangent = vector;
-		vertices.push_back(vertex);
+		// tangent and bitangent, only generated when the mesh has normals and texture coordinates
+		if(mesh->mTangents && mesh->mBitangents)
+		{
+			vertex.Tangent = glm::vec3(mesh->mTangents[i].x, mesh->mTangents[i].y, mesh->mTangents[i].z);
+			vertex.Bitangent = glm::vec3(mesh->mBitangents[i].x, mesh->mBitangents[i].y, mesh->mBitangents[i].z);
+		} else
+		{
+			vertex.Tangent = glm::vec3(0.0f, 0.0f, 0.0f);
+			vertex.Bitangent = glm::vec3(0.0f, 0.0f, 0.0f);
+		}
 	}
 	// now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
+	// faces are triangulated, so three indices per face is the right reservation
+	indices.reserve(mesh->mNumFaces * 3);
 	for(unsigned int i = 0; i < mesh->mNumFaces; i++)
 	{
-		aiFace face = mesh->mFaces[i];
+		const aiFace &face = mesh->mFaces[i];
 		// retrieve all indices of the face and store them in the indices vector
-		for(unsigned int j = 0; j < face.mNumIndices; j++)
-			indices.push_back(face.mIndices[j]);
+		indices.insert(indices.end(), face.mIndices, face.mIndices + face.mNumIndices);
 	}
 	// process materials
 	aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
@@ -115,112 +465,119 @@ Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene)
 	// normal: texture_normalN
 
 	// 1. diffuse maps
-	vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-	textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+	collectMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", textures);
 	// 2. specular maps
-	vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-	textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+	collectMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", textures);
 	// 3. normal maps
-	std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-	textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+	collectMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal", textures);
 	// 4. height maps
-	std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-	textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+	collectMaterialTextures(material, aiTextureType_AMBIENT, "texture_height", textures);
 
-	// return a mesh object created from the extracted mesh data
-	return Mesh(vertices, indices, textures);
+	// return the extracted mesh data, the GL mesh is created from it by addMesh
+	return data;
 }
 
-vector<Texture> Model::loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
+void Model::addMesh(const MeshData &data, const map<string, DecodedImage> *decoded)
+{
+	meshes.push_back(Mesh(data.vertices, data.indices, loadMaterialTextures(data.textures, decoded), data.lods, data.clusters));
+}
+
+void Model::collectMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName, vector<TextureRef> &refs)
 {
-	vector<Texture> textures;
 	for(unsigned int i = 0; i < mat->GetTextureCount(type); i++)
 	{
 		aiString str;
 		mat->GetTexture(type, i, &str);
-		// check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-		bool skip = false;
-		for(unsigned int j = 0; j < textures_loaded.size(); j++)
+
+		TextureRef ref;
+		ref.type = typeName;
+		ref.path = str.C_Str();
+		refs.push_back(ref);
+	}
+}
+
+vector<Texture> Model::loadMaterialTextures(const vector<TextureRef> &refs, const map<string, DecodedImage> *decoded)
+{
+	vector<Texture> textures;
+	for(unsigned int i = 0; i < refs.size(); i++)
+	{
+		// check if texture was loaded before and if so, reuse it: skip loading a new texture
+		unordered_map<string, Texture>::const_iterator loaded = textures_loaded.find(refs[i].path);
+		if(loaded != textures_loaded.end())
+		{
+			Texture texture = loaded->second;
+			texture.type = refs[i].type;
+			textures.push_back(texture);
+			continue;
+		}
+
+		// otherwise take it from the registry, which shares it with every other model using the same image
+		const DecodedImage *image = nullptr;
+		TextureUsage usage = TextureLoader::usageOf(refs[i].type);
+		if(decoded)
 		{
-			if(std::strcmp(textures_loaded[j].path.C_Str(), str.C_Str()) == 0)
+			map<string, DecodedImage>::const_iterator found = decoded->find(refs[i].path);
+			if(found != decoded->end())
 			{
-				textures.push_back(textures_loaded[j]);
-				skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-				break;
+				image = &found->second;
+				usage = image->usage;
 			}
 		}
-		if(!skip)
-		{   // if texture hasn't been loaded already, load it
-			Texture texture;
-			texture.id = TextureFromFile(str.C_Str(), this->directory);
-			texture.type = typeName;
-			texture.path = str;
-			textures.push_back(texture);
-			textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-		}
+
+		Texture texture;
+		texture.id = TextureRegistry::shared().acquire(this->directory + '/' + refs[i].path, usage, image);
+		texture.type = refs[i].type;
+		texture.path = aiString(refs[i].path);
+		textures.push_back(texture);
+		textures_loaded[refs[i].path] = texture;  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+		textures_usage[refs[i].path] = usage;
 	}
 	return textures;
 }
 
-static unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
+map<string, TextureUsage> Model::textureFiles() const
 {
-	string filename = string(path);
-	filename = directory + '/' + filename;
-
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
+	map<string, TextureUsage> files;
+	for(unordered_map<string, TextureUsage>::const_iterator it = textures_usage.begin(); it != textures_usage.end(); ++it)
+		files[this->directory + '/' + it->first] = it->second;
+	return files;
+}
 
-	int width, height, nrComponents;
-	unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-	if(data)
-	{
-		GLenum format;
-		if(nrComponents == 1)
-			format = GL_RED;
-		else if(nrComponents == 3)
-			format = GL_RGB;
-		else if(nrComponents == 4)
-			format = GL_RGBA;
-
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		stbi_image_free(data);
-	} else
+bool Model::replaceTexture(const string &filename, TextureUsage usage, const DecodedImage &image)
+{
+	bool replaced = false;
+	for(unordered_map<string, Texture>::iterator loaded = textures_loaded.begin(); loaded != textures_loaded.end(); ++loaded)
 	{
-		std::cout << "Texture failed to load at path: " << path << std::endl;
-		stbi_image_free(data);
-	}
+		if(this->directory + '/' + loaded->first != filename || textures_usage[loaded->first] != usage)
+			continue;
 
-	return textureID;
+		// the new texture is complete before any mesh points at it, the old one goes with its last user
+		unsigned int oldId = loaded->second.id;
+		unsigned int newId = TextureRegistry::shared().acquire(filename, usage, &image);
+		for(unsigned int i = 0; i < meshes.size(); i++)
+			for(unsigned int j = 0; j < meshes[i].textures.size(); j++)
+				if(meshes[i].textures[j].id == oldId && loaded->first == meshes[i].textures[j].path.C_Str())
+					meshes[i].textures[j].id = newId;
+		loaded->second.id = newId;
+		TextureRegistry::shared().release(oldId);
+		replaced = true;
+	}
+	return replaced;
 }
 
 unsigned int Model::LoadCubemap(vector<std::string> faces)
 {
 	unsigned int textureID;
 	glGenTextures(1, &textureID);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+	GLState::bindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 
-	int width, height, nrComponents;
 	for (unsigned int i = 0; i < faces.size(); i++)
 	{
-		unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrComponents, 0);
-		if (data)
-		{
-			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-			stbi_image_free(data);
-		}
+		DecodedImage image = TextureLoader::prepare(faces[i], TEXTURE_USAGE_COLOR);
+		if (image.valid())
+			TextureLoader::uploadCubeFace(i, image);
 		else
-		{
 			std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-			stbi_image_free(data);
-		}
 	}
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -235,39 +592,11 @@ unsigned int Model::LoadCubemap(vector<std::string> faces)
 // ---------------------------------------------------
 unsigned int Model::loadTexture(char const* path)
 {
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
-
-	int width, height, nrComponents;
-	unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
-	if (data)
-	{
-		GLenum format;
-		if (nrComponents == 1)
-			format = GL_RED;
-		else if (nrComponents == 3)
-			format = GL_RGB;
-		else if (nrComponents == 4)
-			format = GL_RGBA;
-
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		stbi_image_free(data);
-	}
-	else
-	{
+	DecodedImage image = TextureLoader::prepare(path, TEXTURE_USAGE_COLOR);
+	if (!image.valid())
 		std::cout << "Texture failed to load at path: " << path << std::endl;
-		stbi_image_free(data);
-	}
 
-	return textureID;
+	return TextureLoader::upload(image);
 }
 
 // loads a cubemap texture from 6 individual texture faces
@@ -283,22 +612,15 @@ unsigned int Model::loadCubemap(vector<std::string> faces)
 {
 	unsigned int textureID;
 	glGenTextures(1, &textureID);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+	GLState::bindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 
-	int width, height, nrComponents;
 	for (unsigned int i = 0; i < faces.size(); i++)
 	{
-		unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrComponents, 0);
-		if (data)
-		{
-			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-			stbi_image_free(data);
-		}
+		DecodedImage image = TextureLoader::prepare(faces[i], TEXTURE_USAGE_COLOR);
+		if (image.valid())
+			TextureLoader::uploadCubeFace(i, image);
 		else
-		{
 			std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-			stbi_image_free(data);
-		}
 	}
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
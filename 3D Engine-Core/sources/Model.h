@@ -8,36 +8,91 @@
 #include <assimp/postprocess.h>
 
 #include "Mesh.h"
+#include "MeshOptimizer.h"
+#include "RenderQueue.h"
+#include "RenderStats.h"
 #include "Shader.h"
+#include "TextureLoader.h"
  
+#include <atomic>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <unordered_map>
 #include <vector>
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
+// a copy of a model, placed relative to the model transform, with a color its diffuse texture is multiplied with
+struct ModelInstance
+{
+	glm::mat4 transform;
+	glm::vec4 tint;
+};
 
 class Model
 {
 public:
 	/*  Model Data */
-	vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
+	unordered_map<string, Texture> textures_loaded;	// textures of this model by material path, each holding one reference in the TextureRegistry.
+	unordered_map<string, TextureUsage> textures_usage;	// usage each of textures_loaded was acquired with
 	vector<Mesh> meshes;
+	string path;	// file the model was loaded from
 	string directory;
 	bool gammaCorrection;
 	glm::vec3 position;
 	glm::vec3 scale;
 	glm::vec3 rotation;
 	unsigned int shader_id;
+	// copies drawn with one instanced draw per mesh. The first is the model itself at identity.
+	vector<ModelInstance> instances;
+	// incremented when instances change, so the SceneBVH knows to rebuild
+	unsigned int instanceRevision;
+
+	// run the MeshOptimizer stage (weld, vertex cache, overdraw and vertex fetch order) on imported meshes
+	static bool optimizeMeshes;
+	// build simplified levels of detail of imported meshes with the MeshSimplifier
+	static bool generateLods;
+	// split imported meshes into clusters that are culled separately
+	static bool buildClusters;
+	// read .obj files with the ObjLoader instead of ASSIMP
+	static bool useObjLoader;
 
 	/*  Functions   */
 	// constructor, expects a filepath to a 3D model.
 	Model(string const &path, bool gamma = false);
 
-	// draws the model, and thus all its meshes
-	void Draw(Shader shader);
+	// releases the model's textures from the registry
+	~Model();
+
+	// places another copy of the model, returns its index in instances
+	unsigned int addInstance(const glm::mat4 &transform, const glm::vec4 &tint = glm::vec4(1.0f));
+
+	// removes the copies added by addInstance
+	void clearInstances();
+
+	// replaces the instances with count copies on a square grid in the xz plane, spaced by the size of the model,
+	// each with a slightly different tint
+	void placeCopies(unsigned int count);
+
+	// model matrix of an instance for the model matrix transform
+	glm::mat4 instanceTransform(const glm::mat4 &transform, unsigned int instance) const { return transform * instances[instance].transform; }
+
+	// queues the visible instances of the meshes with clusters left after culling for drawing with shader,
+	// sorted by their distance to the camera
+	void submit(RenderQueue &queue, Shader &shader, const glm::mat4 &transform, const glm::vec3 &cameraPosition);
+
+	// picks the level of detail of every mesh for the given model matrix and camera, from its nearest visible instance.
+	// Adds the triangles of the full and of the selected levels of all instances to the stats, and those the frustum
+	// culling left out. projectionScale is the viewport height in pixels over 2 * tan(fovy / 2).
+	void selectLods(const glm::mat4 &transform, const glm::vec3 &cameraPosition, float projectionScale, float maxPixelError, RenderStats &stats);
+
+	// culls the clusters of the visible meshes drawn at full detail against the view, after selectLods.
+	// Only models with a single instance are culled by clusters. Adds the triangles left to the stats.
+	void cullClusters(const glm::mat4 &viewProjection, const glm::mat4 &transform, const glm::vec3 &cameraPosition, RenderStats &stats);
+
+	// asks the TextureStreamer for the mip levels the textures of the visible meshes need at their distance
+	void requestTextures(const glm::mat4 &transform, const glm::vec3 &cameraPosition, float projectionScale);
 
 	static GLuint LoadCubemap(vector<std::string> faces);
 
@@ -45,18 +100,70 @@ public:
 	
 	unsigned int loadCubemap(vector<std::string> faces);
 
+	// reads the mesh data of a model from its mesh cache, or with the ObjLoader or ASSIMP. Touches no GL state, so it runs on worker threads.
+	// Setting *cancel aborts an import in progress.
+	static bool importMeshData(string const &path, vector<MeshData> &meshData, const std::atomic<bool> *cancel = nullptr);
+
+	// true if path is read by the ObjLoader with the current settings
+	static bool readsWithObjLoader(string const &path);
+
+	// mesh cache key of the current import settings for path
+	static unsigned int importKey(string const &path);
+
+	// converts the meshes of a file read by ASSIMP, without any of the optimization stages
+	static bool importWithAssimp(string const &path, vector<MeshData> &meshData, const std::atomic<bool> *cancel = nullptr);
+
+	// unique texture paths referenced by the meshes, relative to the model directory, with their usage.
+	// A path is only a normal map if every reference samples it as one.
+	// With skipResident, textures the registry already holds are left out since they need no decoding.
+	static map<string, TextureUsage> referencedTextures(const vector<MeshData> &meshData, const string &directory, bool skipResident);
+
+	// creates the GL mesh of imported mesh data and loads its textures, using already decoded images when given
+	void addMesh(const MeshData &data, const map<string, DecodedImage> *decoded = nullptr);
+
+	// files of the textures this model holds, as passed to the TextureRegistry, with their usage
+	map<string, TextureUsage> textureFiles() const;
+
+	// swaps the texture of a file that changed on disk for one created from its new image. GL thread only.
+	// Returns false if the model does not use the file with that usage.
+	bool replaceTexture(const string &filename, TextureUsage usage, const DecodedImage &image);
+
 private:
+	friend class ModelImport;
+
+	// empty model, filled mesh by mesh by a ModelImport
+	Model();
+
+	// post-processing steps requested from ASSIMP, part of the mesh cache key
+	static const unsigned int IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+	// bit above all aiProcess flags marking optimized meshes in the mesh cache key
+	static const unsigned int OPTIMIZED_FLAG = 0x80000000u;
+	// and meshes with levels of detail
+	static const unsigned int LOD_FLAG = 0x40000000u;
+	// and meshes with clusters
+	static const unsigned int CLUSTER_FLAG = 0x20000000u;
+	// and meshes read by the ObjLoader
+	static const unsigned int OBJ_LOADER_FLAG = 0x10000000u;
+
+
 	/*  Functions   */
-	// loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+	// loads a model from its mesh cache, or with supported ASSIMP extensions from file, and stores the resulting meshes in the meshes vector.
 	void loadModel(string const &path);
 
-	// processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-	void processNode(aiNode *node, const aiScene *scene);
+	// processes a node in a recursive fashion. Collects each individual mesh located at the node and repeats this process on its children nodes (if any).
+	static void processNode(aiNode *node, const aiScene *scene, vector<aiMesh*> &sceneMeshes);
+
+	// prints the vertex cache statistics of the optimization stage
+	static void reportOptimization(string const &path, const vector<VertexCacheStats> &before, const vector<VertexCacheStats> &after);
+
+	// converts one mesh to vertex/index data. Only reads the scene, so meshes are converted in parallel.
+	static MeshData processMesh(aiMesh *mesh, const aiScene *scene);
 
-	Mesh processMesh(aiMesh *mesh, const aiScene *scene);
+	// collects the texture paths of a given type of a material
+	static void collectMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName, vector<TextureRef> &refs);
 
-	// checks all material textures of a given type and loads the textures if they're not loaded yet.
+	// checks all referenced textures and acquires them from the TextureRegistry if this model does not hold them yet.
 	// the required info is returned as a Texture struct.
-	vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName);
+	vector<Texture> loadMaterialTextures(const vector<TextureRef> &refs, const map<string, DecodedImage> *decoded);
 };
 
@@ -0,0 +1,123 @@
+#include "ModelImport.h"
+#include "ThreadPool.h"
+
+#include <chrono>
+
+ModelImport::ModelImport(const string &path, bool gamma)
+	: path(path), gamma(gamma), state(PARSING), cancelRequested(false),
+	texturesDecoded(0), texturesTotal(0), model(nullptr), meshesUploaded(0)
+{
+	this->directory = path.substr(0, path.find_last_of('/'));
+	this->worker = ThreadPool::shared().submit([this]() { this->importOnWorker(); });
+}
+
+ModelImport::~ModelImport()
+{
+	this->cancelRequested = true;
+	if (this->worker.valid())
+		this->worker.wait();
+
+	delete this->model;
+}
+
+void ModelImport::cancel()
+{
+	this->cancelRequested = true;
+}
+
+bool ModelImport::isDone() const
+{
+	State current = this->state.load();
+	return current == FINISHED || current == FAILED || current == CANCELLED;
+}
+
+void ModelImport::importOnWorker()
+{
+	if (!Model::importMeshData(this->path, this->meshData, &this->cancelRequested))
+	{
+		this->state = this->cancelRequested ? CANCELLED : FAILED;
+		return;
+	}
+
+	// every texture referenced by the model and not resident yet, decoded once and all in parallel
+	map<string, TextureUsage> textures = Model::referencedTextures(this->meshData, this->directory, true);
+	this->texturesTotal = static_cast<unsigned int>(textures.size());
+	this->state = DECODING;
+
+	this->decoded = TextureLoader::decodeAll(this->directory, textures, &this->texturesDecoded, &this->cancelRequested);
+	if (this->cancelRequested)
+	{
+		this->state = CANCELLED;
+		return;
+	}
+
+	this->state = UPLOADING;
+}
+
+Model* ModelImport::update(double budgetSeconds)
+{
+	if (this->state.load() != UPLOADING)
+		return nullptr;
+
+	if (this->cancelRequested)
+	{
+		delete this->model;
+		this->model = nullptr;
+		this->state = CANCELLED;
+		return nullptr;
+	}
+
+	if (!this->model)
+	{
+		this->model = new Model();
+		this->model->path = this->path;
+		this->model->directory = this->directory;
+		this->model->gammaCorrection = this->gamma;
+		this->model->meshes.reserve(this->meshData.size());
+	}
+
+	// upload whole meshes (and the textures they reference first) until the frame budget is spent
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	while (this->meshesUploaded < this->meshData.size())
+	{
+		this->model->addMesh(this->meshData[this->meshesUploaded], &this->decoded);
+		this->meshesUploaded++;
+
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		if (elapsed.count() >= budgetSeconds)
+			break;
+	}
+
+	if (this->meshesUploaded < this->meshData.size())
+		return nullptr;
+
+	// release the CPU copies, the model is complete
+	vector<MeshData>().swap(this->meshData);
+	this->decoded.clear();
+	this->state = FINISHED;
+
+	Model *finished = this->model;
+	this->model = nullptr;
+	return finished;
+}
+
+float ModelImport::getProgress() const
+{
+	// parsing has no reliable estimate, decoding and uploading are counted per texture and per mesh
+	const float parseShare = 0.4f, decodeShare = 0.3f, uploadShare = 0.3f;
+
+	switch (this->state.load())
+	{
+	case PARSING:
+		return 0.0f;
+	case DECODING:
+	{
+		unsigned int total = this->texturesTotal.load();
+		return parseShare + (total ? decodeShare * this->texturesDecoded.load() / total : decodeShare);
+	}
+	case UPLOADING:
+		return parseShare + decodeShare + (this->meshData.empty() ? uploadShare : uploadShare * this->meshesUploaded / this->meshData.size());
+	default:
+		return 1.0f;
+	}
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "Model.h"
+#include "TextureLoader.h"
+
+#include <atomic>
+#include <future>
+#include <map>
+#include <string>
+#include <vector>
+
+// Background import of a model. Parsing and texture decoding run on the worker pool, the GL upload is
+// time-sliced on the render thread through update(), so the frame loop keeps running during an import.
+class ModelImport
+{
+public:
+	enum State
+	{
+		PARSING,
+		DECODING,
+		UPLOADING,
+		FINISHED,
+		FAILED,
+		CANCELLED
+	};
+
+	ModelImport(const string &path, bool gamma = false);
+	// cancels the import and waits for the worker stage to stop
+	~ModelImport();
+
+	// requests the import to stop, it becomes CANCELLED on the next update()
+	void cancel();
+
+	// uploads meshes and textures on the GL thread until budgetSeconds is used up.
+	// Returns the finished model once, the caller owns it from then on.
+	Model* update(double budgetSeconds);
+
+	State getState() const { return this->state.load(); }
+	// overall progress in [0, 1] over parsing, decoding and uploading
+	float getProgress() const;
+	const string &getPath() const { return this->path; }
+	bool isDone() const;
+
+private:
+	ModelImport(const ModelImport&) = delete;
+	ModelImport& operator=(const ModelImport&) = delete;
+
+	// worker stage: mesh data and decoded textures
+	void importOnWorker();
+
+	string path;
+	string directory;
+	bool gamma;
+
+	std::atomic<State> state;
+	std::atomic<bool> cancelRequested;
+	std::future<void> worker;
+
+	vector<MeshData> meshData;
+	map<string, DecodedImage> decoded;
+	std::atomic<unsigned int> texturesDecoded;
+	std::atomic<unsigned int> texturesTotal;
+
+	// GL stage
+	Model *model;
+	unsigned int meshesUploaded;
+};
@@ -0,0 +1,89 @@
+#include "ObjBenchmark.h"
+#include "Model.h"
+#include "ObjLoader.h"
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+// totals of one parse of a model
+struct ObjBenchmarkResult
+{
+	bool loaded;
+	double seconds;
+	size_t meshes;
+	size_t vertices;
+	size_t triangles;
+};
+
+static ObjBenchmarkResult benchmarkParser(const std::string &path, int runs, bool objLoader)
+{
+	ObjBenchmarkResult result = { false, 0.0, 0, 0, 0 };
+	for (int run = 0; run < runs; run++)
+	{
+		vector<MeshData> meshData;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		bool loaded = objLoader ? ObjLoader::load(path, meshData) : Model::importWithAssimp(path, meshData);
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		if (!loaded)
+			return result;
+
+		if (!result.loaded || elapsed.count() < result.seconds)
+			result.seconds = elapsed.count();
+		result.loaded = true;
+		result.meshes = meshData.size();
+		result.vertices = 0;
+		result.triangles = 0;
+		for (size_t i = 0; i < meshData.size(); i++)
+		{
+			result.vertices += meshData[i].vertices.size();
+			result.triangles += meshData[i].indices.size() / 3;
+		}
+	}
+	return result;
+}
+
+static void printResult(const char *parser, const ObjBenchmarkResult &result)
+{
+	printf("  %-10s %10.2f ms %6u meshes %10u vertices %10u triangles\n", parser, result.seconds * 1000.0,
+		unsigned(result.meshes), unsigned(result.vertices), unsigned(result.triangles));
+}
+
+int runObjBenchmark(int runs)
+{
+	const char *models[] = {
+		"resources/objects/nanosuit/nanosuit.obj",
+		"resources/objects/backpack/backpack.obj",
+		"resources/objects/bed_room/Bedroom 11.obj",
+		"resources/objects/FarmhouseMaya/farmhouse_obj.obj"
+	};
+
+	cout << "OBJ_BENCHMARK:: best of " << runs << " runs" << endl;
+	int failed = 0;
+	for (unsigned int i = 0; i < sizeof(models) / sizeof(models[0]); i++)
+	{
+		FILE *file = fopen(models[i], "rb");
+		if (!file)
+		{
+			cout << models[i] << ": not found, skipped" << endl;
+			continue;
+		}
+		fclose(file);
+
+		cout << models[i] << endl;
+		ObjBenchmarkResult assimp = benchmarkParser(models[i], runs, false);
+		ObjBenchmarkResult native = benchmarkParser(models[i], runs, true);
+		if (!assimp.loaded || !native.loaded)
+		{
+			cout << "ERROR::OBJ_BENCHMARK:: " << models[i] << " failed to load with " << (assimp.loaded ? "the ObjLoader" : "ASSIMP") << endl;
+			failed++;
+			continue;
+		}
+
+		printResult("ASSIMP", assimp);
+		printResult("ObjLoader", native);
+		if (native.seconds > 0.0)
+			printf("  speedup    %10.2fx\n", assimp.seconds / native.seconds);
+	}
+	return failed;
+}
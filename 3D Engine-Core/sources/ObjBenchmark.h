@@ -0,0 +1,6 @@
+#pragma once
+
+// Compares the ObjLoader with the ASSIMP import on the bundled .obj models: best wall time of runs parses of each,
+// and the meshes, vertices and triangles they produce. Neither path touches GL or the mesh cache, so it runs
+// without a window. Returns the number of models that failed to load with either parser.
+int runObjBenchmark(int runs);
@@ -0,0 +1,642 @@
+#include "ObjLoader.h"
+#include "FileUtils.h"
+#include "ThreadPool.h"
+
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+
+// std::min takes it by reference
+const size_t ObjLoader::CHUNK_SIZE;
+
+// one corner of a face as 0 based indices into the attribute arrays, -1 when the attribute is missing
+struct ObjCorner
+{
+	int position;
+	int texCoord;
+	int normal;
+};
+
+// corners with negative (relative) indices only know their position within the chunk until all chunks are parsed
+enum ObjRelativeFlags
+{
+	RELATIVE_POSITION = 1,
+	RELATIVE_TEXCOORD = 2,
+	RELATIVE_NORMAL = 4
+};
+
+// material in effect from a triangle of a chunk on
+struct ObjMaterialSwitch
+{
+	size_t triangle;
+	std::string name;
+};
+
+// everything parsed from one chunk of the file
+struct ObjChunk
+{
+	const char *begin;
+	const char *end;
+
+	vector<glm::vec3> positions;
+	vector<glm::vec3> normals;
+	vector<glm::vec2> texCoords;
+
+	vector<ObjCorner> corners;				// three per triangle
+	vector<unsigned char> relativeFlags;	// per corner, ObjRelativeFlags
+	vector<ObjMaterialSwitch> materialSwitches;
+	vector<std::string> libraries;
+
+	// offsets of the chunk attributes in the whole file
+	size_t positionBase;
+	size_t normalBase;
+	size_t texCoordBase;
+};
+
+// triangles [first, end) of a chunk using one material
+struct ObjTriangleRange
+{
+	size_t chunk;
+	size_t first;
+	size_t end;
+};
+
+static const double POWERS_OF_TEN[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static inline bool isBlank(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline void skipBlanks(const char *&p, const char *end)
+{
+	while (p < end && isBlank(*p))
+		p++;
+}
+
+static inline void skipLine(const char *&p, const char *end)
+{
+	while (p < end && *p != '\n')
+		p++;
+	if (p < end)
+		p++;
+}
+
+// rest of the line without surrounding blanks
+static std::string restOfLine(const char *&p, const char *end)
+{
+	skipBlanks(p, end);
+	const char *start = p;
+	while (p < end && *p != '\n')
+		p++;
+	const char *stop = p;
+	while (stop > start && isBlank(stop[-1]))
+		stop--;
+	return std::string(start, stop);
+}
+
+// true if the line at p starts with keyword followed by a blank, moves p behind the keyword
+static inline bool keyword(const char *&p, const char *end, const char *word)
+{
+	const char *q = p;
+	while (*word)
+	{
+		if (q >= end || *q != *word)
+			return false;
+		q++;
+		word++;
+	}
+	if (q < end && !isBlank(*q))
+		return false;
+	p = q;
+	return true;
+}
+
+float ObjLoader::parseFloat(const char *&p, const char *end)
+{
+	skipBlanks(p, end);
+
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+
+	// up to 19 digits fit the mantissa, further ones only shift the exponent
+	uint64_t mantissa = 0;
+	int digits = 0, exponent = 0;
+	while (p < end && *p >= '0' && *p <= '9')
+	{
+		if (digits < 19)
+		{
+			mantissa = mantissa * 10 + (*p - '0');
+			digits += mantissa != 0 ? 1 : 0;
+		}
+		else
+			exponent++;
+		p++;
+	}
+	if (p < end && *p == '.')
+	{
+		p++;
+		while (p < end && *p >= '0' && *p <= '9')
+		{
+			if (digits < 19)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				digits += mantissa != 0 ? 1 : 0;
+				exponent--;
+			}
+			p++;
+		}
+	}
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		const char *q = p + 1;
+		bool negativeExponent = false;
+		if (q < end && (*q == '-' || *q == '+'))
+			negativeExponent = *q++ == '-';
+		if (q < end && *q >= '0' && *q <= '9')
+		{
+			int value = 0;
+			while (q < end && *q >= '0' && *q <= '9')
+			{
+				value = value < 10000 ? value * 10 + (*q - '0') : value;
+				q++;
+			}
+			exponent += negativeExponent ? -value : value;
+			p = q;
+		}
+	}
+
+	// exact double arithmetic while the mantissa has at most 53 bits and the power of ten is exact
+	double value = static_cast<double>(mantissa);
+	if (exponent >= 0 && exponent <= 22)
+		value *= POWERS_OF_TEN[exponent];
+	else if (exponent < 0 && exponent >= -22)
+		value /= POWERS_OF_TEN[-exponent];
+	else
+		value *= std::pow(10.0, exponent);
+
+	return static_cast<float>(negative ? -value : value);
+}
+
+static inline bool parseIndex(const char *&p, const char *end, int &value)
+{
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+	if (p >= end || *p < '0' || *p > '9')
+		return false;
+
+	int result = 0;
+	while (p < end && *p >= '0' && *p <= '9')
+		result = result * 10 + (*p++ - '0');
+	value = negative ? -result : result;
+	return true;
+}
+
+// turns a 1 based or negative OBJ index into a 0 based one, relative ones counted from the chunk start
+static inline int resolveIndex(int index, size_t localCount, unsigned char flag, unsigned char &flags)
+{
+	if (index > 0)
+		return index - 1;
+	flags |= flag;
+	return static_cast<int>(localCount) + index;
+}
+
+static void parseChunk(ObjChunk &chunk)
+{
+	const char *p = chunk.begin;
+	const char *end = chunk.end;
+	vector<ObjCorner> polygon;
+	vector<unsigned char> polygonFlags;
+
+	while (p < end)
+	{
+		skipBlanks(p, end);
+		if (p >= end)
+			break;
+
+		if (p[0] == 'v' && p + 1 < end)
+		{
+			if (isBlank(p[1]))
+			{
+				p++;
+				float x = ObjLoader::parseFloat(p, end);
+				float y = ObjLoader::parseFloat(p, end);
+				float z = ObjLoader::parseFloat(p, end);
+				chunk.positions.push_back(glm::vec3(x, y, z));
+			}
+			else if (p[1] == 'n' && p + 2 < end && isBlank(p[2]))
+			{
+				p += 2;
+				float x = ObjLoader::parseFloat(p, end);
+				float y = ObjLoader::parseFloat(p, end);
+				float z = ObjLoader::parseFloat(p, end);
+				chunk.normals.push_back(glm::vec3(x, y, z));
+			}
+			else if (p[1] == 't' && p + 2 < end && isBlank(p[2]))
+			{
+				p += 2;
+				float u = ObjLoader::parseFloat(p, end);
+				float v = ObjLoader::parseFloat(p, end);
+				chunk.texCoords.push_back(glm::vec2(u, v));
+			}
+		}
+		else if (p[0] == 'f' && p + 1 < end && isBlank(p[1]))
+		{
+			p++;
+			polygon.clear();
+			polygonFlags.clear();
+			for (;;)
+			{
+				skipBlanks(p, end);
+				ObjCorner corner = { -1, -1, -1 };
+				unsigned char flags = 0;
+				int index;
+				if (!parseIndex(p, end, index))
+					break;
+				corner.position = resolveIndex(index, chunk.positions.size(), RELATIVE_POSITION, flags);
+				if (p < end && *p == '/')
+				{
+					p++;
+					if (parseIndex(p, end, index))
+						corner.texCoord = resolveIndex(index, chunk.texCoords.size(), RELATIVE_TEXCOORD, flags);
+					if (p < end && *p == '/')
+					{
+						p++;
+						if (parseIndex(p, end, index))
+							corner.normal = resolveIndex(index, chunk.normals.size(), RELATIVE_NORMAL, flags);
+					}
+				}
+				polygon.push_back(corner);
+				polygonFlags.push_back(flags);
+			}
+
+			// triangulate as a fan, like ASSIMP does for convex polygons
+			for (size_t i = 2; i < polygon.size(); i++)
+			{
+				size_t fan[3] = { 0, i - 1, i };
+				for (int k = 0; k < 3; k++)
+				{
+					chunk.corners.push_back(polygon[fan[k]]);
+					chunk.relativeFlags.push_back(polygonFlags[fan[k]]);
+				}
+			}
+		}
+		else if (keyword(p, end, "usemtl"))
+		{
+			ObjMaterialSwitch material;
+			material.triangle = chunk.corners.size() / 3;
+			material.name = restOfLine(p, end);
+			chunk.materialSwitches.push_back(material);
+		}
+		else if (keyword(p, end, "mtllib"))
+			chunk.libraries.push_back(restOfLine(p, end));
+
+		skipLine(p, end);
+	}
+}
+
+// texture paths of a material, by the sampler type names of Mesh::Draw
+struct ObjMaterial
+{
+	vector<TextureRef> textures;
+};
+
+// file name of a map statement, behind its options like "-bm 0.012"
+static std::string mapFileName(const char *&p, const char *end)
+{
+	for (;;)
+	{
+		skipBlanks(p, end);
+		if (p >= end || *p != '-')
+			break;
+		while (p < end && !isBlank(*p) && *p != '\n')
+			p++;
+		// numeric arguments of the option
+		for (;;)
+		{
+			skipBlanks(p, end);
+			if (p >= end || !((*p >= '0' && *p <= '9') || *p == '.' || ((*p == '-' || *p == '+') && p + 1 < end && p[1] >= '0' && p[1] <= '9')))
+				break;
+			while (p < end && !isBlank(*p) && *p != '\n')
+				p++;
+		}
+	}
+	return restOfLine(p, end);
+}
+
+static void parseMaterialLibrary(const std::string &path, std::map<std::string, ObjMaterial> &materials)
+{
+	MappedFile file;
+	if (!file.open(path))
+	{
+		cout << "WARNING::OBJ_LOADER:: material library not found: " << path << endl;
+		return;
+	}
+
+	// per material the maps in the order processMesh collects them: diffuse, specular, normal, height
+	struct Maps { std::string diffuse, specular, normal, height; };
+	std::map<std::string, Maps> maps;
+	Maps *current = nullptr;
+
+	const char *p = reinterpret_cast<const char*>(file.data());
+	const char *end = p + file.size();
+	while (p < end)
+	{
+		skipBlanks(p, end);
+		if (keyword(p, end, "newmtl"))
+			current = &maps[restOfLine(p, end)];
+		else if (current && keyword(p, end, "map_Kd"))
+			current->diffuse = mapFileName(p, end);
+		else if (current && keyword(p, end, "map_Ks"))
+			current->specular = mapFileName(p, end);
+		else if (current && (keyword(p, end, "map_Bump") || keyword(p, end, "map_bump") || keyword(p, end, "bump")))
+			current->normal = mapFileName(p, end);
+		else if (current && keyword(p, end, "map_Ka"))
+			current->height = mapFileName(p, end);
+		skipLine(p, end);
+	}
+
+	for (std::map<std::string, Maps>::const_iterator it = maps.begin(); it != maps.end(); ++it)
+	{
+		const std::string names[4] = { it->second.diffuse, it->second.specular, it->second.normal, it->second.height };
+		const char *types[4] = { "texture_diffuse", "texture_specular", "texture_normal", "texture_height" };
+		ObjMaterial &material = materials[it->first];
+		material.textures.clear();
+		for (int i = 0; i < 4; i++)
+		{
+			if (names[i].empty())
+				continue;
+			TextureRef ref;
+			ref.type = types[i];
+			ref.path = names[i];
+			material.textures.push_back(ref);
+		}
+	}
+}
+
+struct ObjCornerHash
+{
+	size_t operator()(const ObjCorner &c) const
+	{
+		return (static_cast<size_t>(c.position) * 73856093u) ^ (static_cast<size_t>(c.texCoord) * 19349663u) ^ (static_cast<size_t>(c.normal) * 83492791u);
+	}
+};
+
+struct ObjCornerEqual
+{
+	bool operator()(const ObjCorner &a, const ObjCorner &b) const
+	{
+		return a.position == b.position && a.texCoord == b.texCoord && a.normal == b.normal;
+	}
+};
+
+// smooth normals for vertices without one, and tangent frames from the texture coordinates
+static void completeVertices(MeshData &mesh, const vector<bool> &missingNormal, bool generateNormals)
+{
+	vector<Vertex> &vertices = mesh.vertices;
+	if (generateNormals)
+	{
+		// only the vertices without a normal in the file get the ones of their faces
+		for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+		{
+			Vertex &a = vertices[mesh.indices[i]], &b = vertices[mesh.indices[i + 1]], &c = vertices[mesh.indices[i + 2]];
+			glm::vec3 normal = glm::cross(b.Position - a.Position, c.Position - a.Position);
+			for (int k = 0; k < 3; k++)
+			{
+				if (missingNormal[mesh.indices[i + k]])
+					vertices[mesh.indices[i + k]].Normal += normal;
+			}
+		}
+		for (size_t i = 0; i < vertices.size(); i++)
+		{
+			if (!missingNormal[i])
+				continue;
+			float length = glm::length(vertices[i].Normal);
+			vertices[i].Normal = length > 0.0f ? vertices[i].Normal / length : glm::vec3(0.0f);
+		}
+	}
+
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+	{
+		Vertex &a = vertices[mesh.indices[i]], &b = vertices[mesh.indices[i + 1]], &c = vertices[mesh.indices[i + 2]];
+		glm::vec3 e1 = b.Position - a.Position, e2 = c.Position - a.Position;
+		glm::vec2 d1 = b.TexCoords - a.TexCoords, d2 = c.TexCoords - a.TexCoords;
+		float determinant = d1.x * d2.y - d2.x * d1.y;
+		if (determinant == 0.0f)
+			continue;
+		float r = 1.0f / determinant;
+		glm::vec3 tangent = (e1 * d2.y - e2 * d1.y) * r;
+		glm::vec3 bitangent = (e2 * d1.x - e1 * d2.x) * r;
+		a.Tangent += tangent; b.Tangent += tangent; c.Tangent += tangent;
+		a.Bitangent += bitangent; b.Bitangent += bitangent; c.Bitangent += bitangent;
+	}
+
+	// orthogonalize against the normal
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		Vertex &v = vertices[i];
+		glm::vec3 tangent = v.Tangent - v.Normal * glm::dot(v.Normal, v.Tangent);
+		glm::vec3 bitangent = v.Bitangent - v.Normal * glm::dot(v.Normal, v.Bitangent);
+		v.Tangent = glm::length(tangent) > 0.0f ? glm::normalize(tangent) : glm::vec3(0.0f);
+		v.Bitangent = glm::length(bitangent) > 0.0f ? glm::normalize(bitangent) : glm::vec3(0.0f);
+	}
+}
+
+vector<std::string> ObjLoader::materialLibraries(const std::string &path)
+{
+	vector<std::string> libraries;
+	MappedFile file;
+	if (!file.open(path))
+		return libraries;
+
+	const std::string directory = path.substr(0, path.find_last_of('/'));
+	const char *p = reinterpret_cast<const char*>(file.data());
+	const char *end = p + file.size();
+	while (p < end)
+	{
+		skipBlanks(p, end);
+		if (keyword(p, end, "mtllib"))
+			libraries.push_back(directory + '/' + restOfLine(p, end));
+		skipLine(p, end);
+	}
+	return libraries;
+}
+
+bool ObjLoader::load(const std::string &path, vector<MeshData> &meshes, const std::atomic<bool> *cancel)
+{
+	MappedFile file;
+	if (!file.open(path))
+	{
+		cout << "ERROR::OBJ_LOADER:: could not read " << path << endl;
+		return false;
+	}
+	const std::string directory = path.substr(0, path.find_last_of('/'));
+
+	// cut the file into chunks at line ends and parse them in parallel
+	const char *data = reinterpret_cast<const char*>(file.data());
+	const char *fileEnd = data + file.size();
+	vector<ObjChunk> chunks;
+	for (const char *begin = data; begin < fileEnd;)
+	{
+		const char *end = begin + std::min(CHUNK_SIZE, static_cast<size_t>(fileEnd - begin));
+		while (end < fileEnd && end[-1] != '\n')
+			end++;
+		chunks.push_back(ObjChunk());
+		chunks.back().begin = begin;
+		chunks.back().end = end;
+		begin = end;
+	}
+
+	ThreadPool::shared().parallelFor(chunks.size(), [&](size_t i)
+	{
+		parseChunk(chunks[i]);
+	});
+	if (cancel && cancel->load())
+		return false;
+
+	// offsets of every chunk in the file wide attribute arrays
+	size_t positionCount = 0, normalCount = 0, texCoordCount = 0;
+	for (size_t i = 0; i < chunks.size(); i++)
+	{
+		chunks[i].positionBase = positionCount;
+		chunks[i].normalBase = normalCount;
+		chunks[i].texCoordBase = texCoordCount;
+		positionCount += chunks[i].positions.size();
+		normalCount += chunks[i].normals.size();
+		texCoordCount += chunks[i].texCoords.size();
+	}
+
+	vector<glm::vec3> positions, normals;
+	vector<glm::vec2> texCoords;
+	positions.reserve(positionCount);
+	normals.reserve(normalCount);
+	texCoords.reserve(texCoordCount);
+	for (size_t i = 0; i < chunks.size(); i++)
+	{
+		positions.insert(positions.end(), chunks[i].positions.begin(), chunks[i].positions.end());
+		normals.insert(normals.end(), chunks[i].normals.begin(), chunks[i].normals.end());
+		texCoords.insert(texCoords.end(), chunks[i].texCoords.begin(), chunks[i].texCoords.end());
+	}
+
+	// relative indices become file wide, anything out of range is dropped
+	ThreadPool::shared().parallelFor(chunks.size(), [&](size_t i)
+	{
+		ObjChunk &chunk = chunks[i];
+		for (size_t c = 0; c < chunk.corners.size(); c++)
+		{
+			ObjCorner &corner = chunk.corners[c];
+			unsigned char flags = chunk.relativeFlags[c];
+			if (flags & RELATIVE_POSITION)
+				corner.position += static_cast<int>(chunk.positionBase);
+			if (flags & RELATIVE_TEXCOORD)
+				corner.texCoord += static_cast<int>(chunk.texCoordBase);
+			if (flags & RELATIVE_NORMAL)
+				corner.normal += static_cast<int>(chunk.normalBase);
+
+			if (corner.position < 0 || corner.position >= static_cast<int>(positionCount))
+				corner.position = -1;
+			if (corner.texCoord >= static_cast<int>(texCoordCount))
+				corner.texCoord = -1;
+			if (corner.normal >= static_cast<int>(normalCount))
+				corner.normal = -1;
+		}
+	});
+
+	// triangle ranges per material, in the order the materials are first used
+	std::map<std::string, size_t> materialIndex;
+	vector<std::string> materialNames;
+	vector<vector<ObjTriangleRange>> materialRanges;
+	std::string currentMaterial;
+	std::map<std::string, ObjMaterial> materials;
+	for (size_t i = 0; i < chunks.size(); i++)
+	{
+		ObjChunk &chunk = chunks[i];
+		for (size_t l = 0; l < chunk.libraries.size(); l++)
+			parseMaterialLibrary(directory + '/' + chunk.libraries[l], materials);
+
+		size_t triangleCount = chunk.corners.size() / 3;
+		size_t first = 0;
+		for (size_t s = 0; s <= chunk.materialSwitches.size(); s++)
+		{
+			size_t end = s < chunk.materialSwitches.size() ? chunk.materialSwitches[s].triangle : triangleCount;
+			if (end > first)
+			{
+				std::map<std::string, size_t>::iterator found = materialIndex.find(currentMaterial);
+				if (found == materialIndex.end())
+				{
+					found = materialIndex.insert(std::make_pair(currentMaterial, materialNames.size())).first;
+					materialNames.push_back(currentMaterial);
+					materialRanges.push_back(vector<ObjTriangleRange>());
+				}
+				ObjTriangleRange range = { i, first, end };
+				materialRanges[found->second].push_back(range);
+			}
+			if (s < chunk.materialSwitches.size())
+				currentMaterial = chunk.materialSwitches[s].name;
+			first = end;
+		}
+	}
+
+	// one mesh per material with the vertices welded by their index triplet
+	vector<MeshData> result(materialNames.size());
+	ThreadPool::shared().parallelFor(result.size(), [&](size_t m)
+	{
+		MeshData &mesh = result[m];
+		std::unordered_map<ObjCorner, unsigned int, ObjCornerHash, ObjCornerEqual> vertexOf;
+		vector<bool> missingNormal;
+		bool missingNormals = false;
+
+		for (size_t r = 0; r < materialRanges[m].size(); r++)
+		{
+			const ObjTriangleRange &range = materialRanges[m][r];
+			const ObjChunk &chunk = chunks[range.chunk];
+			for (size_t t = range.first; t < range.end; t++)
+			{
+				const ObjCorner *triangle = &chunk.corners[t * 3];
+				if (triangle[0].position < 0 || triangle[1].position < 0 || triangle[2].position < 0)
+					continue;
+
+				for (int k = 0; k < 3; k++)
+				{
+					const ObjCorner &corner = triangle[k];
+					std::pair<std::unordered_map<ObjCorner, unsigned int, ObjCornerHash, ObjCornerEqual>::iterator, bool> inserted =
+						vertexOf.insert(std::make_pair(corner, static_cast<unsigned int>(mesh.vertices.size())));
+					if (inserted.second)
+					{
+						Vertex vertex;
+						vertex.Position = positions[corner.position];
+						vertex.Normal = corner.normal >= 0 ? normals[corner.normal] : glm::vec3(0.0f);
+						// flipped like aiProcess_FlipUVs
+						vertex.TexCoords = corner.texCoord >= 0 ? glm::vec2(texCoords[corner.texCoord].x, 1.0f - texCoords[corner.texCoord].y) : glm::vec2(0.0f);
+						vertex.Tangent = glm::vec3(0.0f);
+						vertex.Bitangent = glm::vec3(0.0f);
+						mesh.vertices.push_back(vertex);
+						missingNormal.push_back(corner.normal < 0);
+						missingNormals = missingNormals || corner.normal < 0;
+					}
+					mesh.indices.push_back(inserted.first->second);
+				}
+			}
+		}
+
+		completeVertices(mesh, missingNormal, missingNormals);
+
+		std::map<std::string, ObjMaterial>::const_iterator material = materials.find(materialNames[m]);
+		if (material != materials.end())
+			mesh.textures = material->second.textures;
+	});
+
+	meshes.clear();
+	for (size_t m = 0; m < result.size(); m++)
+	{
+		if (!result[m].indices.empty())
+			meshes.push_back(std::move(result[m]));
+	}
+	return !(cancel && cancel->load());
+}
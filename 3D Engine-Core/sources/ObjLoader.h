@@ -0,0 +1,29 @@
+#pragma once
+
+#include "Mesh.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+// Wavefront OBJ/MTL reader producing the same MeshData as the ASSIMP import with Triangulate, FlipUVs and
+// CalcTangentSpace, one mesh per material. The file is memory mapped and split at line ends into chunks that
+// are parsed in parallel on the shared ThreadPool; meshes are then assembled per material in parallel.
+class ObjLoader
+{
+public:
+	// parses path and the material libraries it references, returns false if the file cannot be read.
+	// Setting *cancel aborts between the stages.
+	static bool load(const std::string &path, vector<MeshData> &meshes, const std::atomic<bool> *cancel = nullptr);
+
+	// paths of the material libraries an OBJ file references, found by scanning its lines without parsing them
+	static vector<std::string> materialLibraries(const std::string &path);
+
+	// parses a decimal float at p, stopping at end, and moves p behind it. Gives the same value as strtod for
+	// up to 15 significant digits and exponents up to 22, falls back to pow beyond.
+	static float parseFloat(const char *&p, const char *end);
+
+private:
+	// bytes per parse job, cut at the next line end
+	static const size_t CHUNK_SIZE = 1 << 20;
+};
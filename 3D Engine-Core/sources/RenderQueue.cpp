@@ -0,0 +1,250 @@
+#include "RenderQueue.h"
+#include "GLExtensions.h"
+#include "GLState.h"
+
+#include <cstddef>
+#include <cstring>
+
+// the last id of a field is shared by everything that did not get its own, which is always rebound
+static const uint32_t PROGRAM_OVERFLOW = (1u << RenderQueue::PROGRAM_BITS) - 1;
+static const uint32_t TEXTURE_SET_OVERFLOW = (1u << RenderQueue::TEXTURE_SET_BITS) - 1;
+
+bool RenderQueue::useIndirect = true;
+
+RenderQueue::RenderQueue()
+	: instanceBuffer(0), instanceOffset(0), indirectBuffer(0), indirectOffset(0),
+	currentProgram(0), currentTextureSet(TEXTURE_SET_OVERFLOW), currentFormat(-1)
+{
+}
+
+uint32_t RenderQueue::programId(GLuint program)
+{
+	std::map<GLuint, uint32_t>::iterator it = this->programs.find(program);
+	if (it != this->programs.end())
+		return it->second;
+	if (this->programs.size() >= PROGRAM_OVERFLOW)
+		return PROGRAM_OVERFLOW;
+	uint32_t id = static_cast<uint32_t>(this->programs.size());
+	this->programs[program] = id;
+	return id;
+}
+
+uint32_t RenderQueue::textureSetId(const vector<Texture> &textures)
+{
+	this->textureIds.resize(textures.size());
+	for (size_t i = 0; i < textures.size(); i++)
+		this->textureIds[i] = textures[i].id;
+
+	std::map<vector<GLuint>, uint32_t>::iterator it = this->textureSets.find(this->textureIds);
+	if (it != this->textureSets.end())
+		return it->second;
+	if (this->textureSets.size() >= TEXTURE_SET_OVERFLOW)
+		return TEXTURE_SET_OVERFLOW;
+	uint32_t id = static_cast<uint32_t>(this->textureSets.size());
+	this->textureSets[this->textureIds] = id;
+	return id;
+}
+
+DrawInstance* RenderQueue::submit(Shader &shader, Mesh &mesh, unsigned int instanceCount, float depth)
+{
+	Draw draw = { &shader, &mesh, textureSetId(mesh.textures), static_cast<uint32_t>(this->instances.size()), instanceCount };
+
+	// the bits of a positive float sort like the float, the sign bit is always clear and the lowest mantissa bit is dropped
+	float positiveDepth = depth > 0.0f ? depth : 0.0f;
+	uint32_t depthBits;
+	std::memcpy(&depthBits, &positiveDepth, sizeof(depthBits));
+
+	Packet packet;
+	packet.key = (static_cast<uint64_t>(programId(shader.Program)) << (TEXTURE_SET_BITS + VERTEX_ARRAY_BITS + DEPTH_BITS))
+		| (static_cast<uint64_t>(draw.textureSet) << (VERTEX_ARRAY_BITS + DEPTH_BITS))
+		| (static_cast<uint64_t>((mesh.format << 1) | (mesh.indexType == GL_UNSIGNED_INT)) << DEPTH_BITS)
+		| (depthBits >> 1);
+	packet.draw = static_cast<uint32_t>(this->draws.size());
+
+	this->draws.push_back(draw);
+	this->packets.push_back(packet);
+	this->instances.resize(this->instances.size() + instanceCount);
+	return &this->instances[draw.firstInstance];
+}
+
+void RenderQueue::flushDirect(RenderStats &stats)
+{
+	for (size_t i = 0; i < this->packets.size(); i++)
+	{
+		Draw &draw = this->draws[this->packets[i].draw];
+		bindState(draw, i == 0, stats);
+
+		// GL 3.3 has no base instance, the attributes are pointed at the range of the draw instead
+		setInstanceAttributes(this->instanceOffset + draw.firstInstance * sizeof(DrawInstance));
+		draw.mesh->drawGeometry(draw.instanceCount);
+		stats.draws++;
+		stats.drawCalls++;
+		stats.instances += draw.instanceCount;
+	}
+}
+
+void RenderQueue::batchCommands(RenderStats &stats)
+{
+	this->batches.clear();
+	this->commands.clear();
+	const uint64_t stateMask = ~((static_cast<uint64_t>(1) << DEPTH_BITS) - 1);
+	for (size_t i = 0; i < this->packets.size(); i++)
+	{
+		const Draw &draw = this->draws[this->packets[i].draw];
+		// overflowing ids are shared by different programs or texture sets, their packets never batch
+		bool sameState = i > 0
+			&& (this->packets[i].key & stateMask) == (this->packets[i - 1].key & stateMask)
+			&& draw.textureSet != TEXTURE_SET_OVERFLOW
+			&& draw.shader->Program == this->draws[this->packets[i - 1].draw].shader->Program;
+		if (!sameState)
+		{
+			Batch batch = { static_cast<uint32_t>(i), static_cast<uint32_t>(this->commands.size()), 0 };
+			this->batches.push_back(batch);
+		}
+		draw.mesh->appendCommands(draw.instanceCount, draw.firstInstance, this->commands);
+		this->batches.back().commandCount = static_cast<uint32_t>(this->commands.size()) - this->batches.back().firstCommand;
+		stats.draws++;
+		stats.instances += draw.instanceCount;
+	}
+}
+
+void RenderQueue::flushIndirect(RenderStats &stats)
+{
+	for (size_t i = 0; i < this->batches.size(); i++)
+	{
+		const Batch &batch = this->batches[i];
+		if (batch.commandCount == 0)
+			continue;
+		const Draw &draw = this->draws[this->packets[batch.packet].draw];
+		bindState(draw, i == 0, stats);
+		GLExtensions::glMultiDrawElementsIndirect(GL_TRIANGLES, draw.mesh->indexType,
+			(const void*)(this->indirectOffset + batch.firstCommand * sizeof(DrawElementsIndirectCommand)), static_cast<GLsizei>(batch.commandCount), 0);
+		stats.drawCalls++;
+	}
+}
+
+void RenderQueue::sortPackets(vector<Packet> &packets, vector<Packet> &scratch)
+{
+	const size_t count = packets.size();
+	if (count < 2)
+		return;
+
+	// histograms of all eight digits in one pass over the keys
+	size_t histograms[8][256];
+	std::memset(histograms, 0, sizeof(histograms));
+	for (size_t i = 0; i < count; i++)
+	{
+		uint64_t key = packets[i].key;
+		for (unsigned int digit = 0; digit < 8; digit++)
+			histograms[digit][(key >> (digit * 8)) & 0xff]++;
+	}
+
+	scratch.resize(count);
+	for (unsigned int digit = 0; digit < 8; digit++)
+	{
+		size_t *histogram = histograms[digit];
+		const unsigned int shift = digit * 8;
+		// every key has the same digit, the pass would not move anything
+		if (histogram[(packets[0].key >> shift) & 0xff] == count)
+			continue;
+
+		size_t offset = 0;
+		for (unsigned int value = 0; value < 256; value++)
+		{
+			size_t n = histogram[value];
+			histogram[value] = offset;
+			offset += n;
+		}
+		for (size_t i = 0; i < count; i++)
+			scratch[histogram[(packets[i].key >> shift) & 0xff]++] = packets[i];
+		packets.swap(scratch);
+	}
+}
+
+void RenderQueue::bindState(const Draw &draw, bool first, RenderStats &stats)
+{
+	if (first || draw.shader->Program != this->currentProgram)
+	{
+		draw.shader->use();
+		this->currentProgram = draw.shader->Program;
+		stats.programBinds++;
+	}
+	if (first || draw.textureSet != this->currentTextureSet || draw.textureSet == TEXTURE_SET_OVERFLOW)
+	{
+		draw.mesh->bindTextures();
+		this->currentTextureSet = draw.textureSet;
+		stats.textureSetBinds++;
+	}
+	if (first || draw.mesh->format != this->currentFormat)
+	{
+		GeometryHeap::shared(draw.mesh->format).bind();
+		this->currentFormat = draw.mesh->format;
+		stats.vertexArrayBinds++;
+		for (unsigned int a = 0; a < INSTANCE_ATTRIBUTE_COUNT; a++)
+		{
+			glEnableVertexAttribArray(INSTANCE_ATTRIBUTE + a);
+			glVertexAttribDivisor(INSTANCE_ATTRIBUTE + a, 1);
+		}
+		// the indirect path reads every batch from the start of the instances, the base instances select the ranges
+		if (useIndirect && GLExtensions::multiDrawIndirect)
+			setInstanceAttributes(this->instanceOffset);
+	}
+}
+
+void RenderQueue::setInstanceAttributes(size_t offset)
+{
+	for (unsigned int column = 0; column < 4; column++)
+		glVertexAttribPointer(INSTANCE_ATTRIBUTE + column, 4, GL_FLOAT, GL_FALSE, sizeof(DrawInstance), (void*)(offset + column * sizeof(glm::vec4)));
+	glVertexAttribPointer(INSTANCE_ATTRIBUTE + 4, 4, GL_FLOAT, GL_FALSE, sizeof(DrawInstance), (void*)(offset + offsetof(DrawInstance, tint)));
+	glVertexAttribPointer(INSTANCE_ATTRIBUTE + 5, 3, GL_FLOAT, GL_FALSE, sizeof(DrawInstance), (void*)(offset + offsetof(DrawInstance, positionOffset)));
+	glVertexAttribPointer(INSTANCE_ATTRIBUTE + 6, 3, GL_FLOAT, GL_FALSE, sizeof(DrawInstance), (void*)(offset + offsetof(DrawInstance, positionScale)));
+}
+
+void RenderQueue::flush(RenderStats &stats, StreamBuffer &stream)
+{
+	sortPackets(this->packets, this->scratch);
+	const bool indirect = useIndirect && GLExtensions::multiDrawIndirect;
+	if (indirect)
+		batchCommands(stats);
+
+	// the instances and commands of the frame are copied into the stream buffer, the draws read them from there
+	if (!this->packets.empty())
+	{
+		const size_t instanceBytes = this->instances.size() * sizeof(DrawInstance);
+		void *instanceData = stream.allocate(instanceBytes, sizeof(glm::vec4), this->instanceBuffer, this->instanceOffset);
+		if (instanceData)
+			std::memcpy(instanceData, this->instances.data(), instanceBytes);
+		// may grow the stream buffer, the instances then stay in the old one until the next frame
+		void *commandData = nullptr;
+		if (instanceData && indirect)
+		{
+			const size_t commandBytes = this->commands.size() * sizeof(DrawElementsIndirectCommand);
+			commandData = stream.allocate(commandBytes, sizeof(GLuint), this->indirectBuffer, this->indirectOffset);
+			if (commandData)
+				std::memcpy(commandData, this->commands.data(), commandBytes);
+		}
+		stream.commit();
+
+		if (instanceData && (commandData || !indirect))
+		{
+			GLState::bindBuffer(GL_ARRAY_BUFFER, this->instanceBuffer);
+			if (indirect)
+			{
+				GLState::bindBuffer(GL_DRAW_INDIRECT_BUFFER, this->indirectBuffer);
+				flushIndirect(stats);
+			}
+			else
+				flushDirect(stats);
+		}
+	}
+
+	this->draws.clear();
+	this->packets.clear();
+	this->instances.clear();
+
+	// ids only have to be unique within a frame, programs and textures replaced by hot reloads leave stale ones behind
+	if (this->programs.size() >= PROGRAM_OVERFLOW / 2)
+		this->programs.clear();
+	if (this->textureSets.size() >= TEXTURE_SET_OVERFLOW / 2)
+		this->textureSets.clear();
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+#include "RenderStats.h"
+#include "Shader.h"
+#include "StreamBuffer.h"
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+// per instance vertex attributes of the drawn meshes, read from the instance buffer of the RenderQueue:
+// the columns of the model matrix at INSTANCE_ATTRIBUTE to INSTANCE_ATTRIBUTE + 3, then the tint and the
+// dequantization of packed positions, which vary per mesh and so are passed per instance to let meshes share a draw
+struct DrawInstance
+{
+	glm::mat4 transform;
+	glm::vec4 tint;
+	glm::vec3 positionOffset;
+	glm::vec3 positionScale;
+};
+
+// Collects the visible meshes of a frame as draw packets and submits them sorted by the state they need, so
+// every program, texture set and vertex array is bound once per run of packets sharing it instead of once per mesh.
+// A packet is a 64 bit key and the index of its draw; the keys are radix sorted every frame.
+// A draw covers every visible instance of a mesh: the instances of the frame go to one buffer and each draw is
+// a single instanced draw call over its range of it; the instances are copied into the StreamBuffer of the frame.
+// With multi draw indirect, the draws of a run of packets sharing
+// all state become commands in an indirect buffer that one glMultiDrawElementsIndirect issues, each reading its
+// instances from its base instance. GL thread only.
+class RenderQueue
+{
+public:
+	static const unsigned int INSTANCE_ATTRIBUTE = 5;
+	static const unsigned int INSTANCE_ATTRIBUTE_COUNT = 7;
+
+	// bits of the key, from the most significant: program, texture set, vertex array and index type, depth.
+	// Packets of the same state are drawn front to back.
+	static const unsigned int PROGRAM_BITS = 10;
+	static const unsigned int TEXTURE_SET_BITS = 20;
+	static const unsigned int VERTEX_ARRAY_BITS = 4;
+	static const unsigned int DEPTH_BITS = 30;
+
+	// batch the draws into glMultiDrawElementsIndirect calls when GLExtensions::multiDrawIndirect is supported
+	static bool useIndirect;
+
+	RenderQueue();
+
+	// queues instanceCount instances of a mesh drawn with shader, depth is the distance of the nearest to the camera.
+	// Returns where to write the instances, valid until the next submit.
+	DrawInstance* submit(Shader &shader, Mesh &mesh, unsigned int instanceCount, float depth);
+
+	// sorts and draws the packets of the frame and empties the queue, with the instances and indirect commands
+	// written to stream. Counts the draws and the state changes into stats.
+	void flush(RenderStats &stats, StreamBuffer &stream);
+
+	size_t size() const { return this->packets.size(); }
+
+private:
+	struct Draw
+	{
+		Shader *shader;
+		Mesh *mesh;
+		uint32_t textureSet;
+		uint32_t firstInstance;
+		uint32_t instanceCount;
+	};
+
+	struct Packet
+	{
+		uint64_t key;
+		uint32_t draw;
+	};
+
+	// commands of the packets from packet on sharing its state, drawn by one multi draw indirect call
+	struct Batch
+	{
+		uint32_t packet;
+		uint32_t firstCommand;
+		uint32_t commandCount;
+	};
+
+	// small ids of the programs and texture sets in the keys, kept over frames and restarted when they run out
+	uint32_t programId(GLuint program);
+	uint32_t textureSetId(const vector<Texture> &textures);
+
+	// stable LSD radix sort on 8 bit digits, skipping the digits all keys share
+	static void sortPackets(vector<Packet> &packets, vector<Packet> &scratch);
+
+	// binds what the draw needs of program, textures and vertex array that differs from the current state
+	void bindState(const Draw &draw, bool first, RenderStats &stats);
+	// points the instance attributes at the instances from byte offset on
+	static void setInstanceAttributes(size_t offset);
+
+	// one instanced draw call per packet
+	void flushDirect(RenderStats &stats);
+	// groups the sorted packets into batches of the same key state and collects their commands
+	void batchCommands(RenderStats &stats);
+	// one multi draw indirect call per batch
+	void flushIndirect(RenderStats &stats);
+
+	vector<Draw> draws;
+	vector<Packet> packets;
+	vector<Packet> scratch;
+	vector<DrawInstance> instances;
+	// where the instances of the frame are in the stream buffer
+	GLuint instanceBuffer;
+	size_t instanceOffset;
+	// commands and batches of the frame for the indirect path, and where the commands are in the stream buffer
+	vector<DrawElementsIndirectCommand> commands;
+	vector<Batch> batches;
+	GLuint indirectBuffer;
+	size_t indirectOffset;
+	// state bound by bindState
+	GLuint currentProgram;
+	uint32_t currentTextureSet;
+	int currentFormat;
+
+	std::map<GLuint, uint32_t> programs;
+	std::map<vector<GLuint>, uint32_t> textureSets;
+	vector<GLuint> textureIds;
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+
+// counters of one frame, shown in the stats overlay
+struct RenderStats
+{
+	// triangles of all meshes at full detail, after the level of detail selection and drawn after frustum and cluster culling
+	size_t fullTriangles;
+	size_t lodTriangles;
+	size_t drawnTriangles;
+	// meshes tested against the frustum, how many were off screen and their triangles at the selected level
+	unsigned int meshes;
+	unsigned int frustumCulledMeshes;
+	size_t frustumCulledTriangles;
+	// clusters of the meshes drawn at full detail, and how many of them were culled
+	unsigned int clusters;
+	unsigned int culledClusters;
+	// draw packets submitted by the RenderQueue, the instances they drew and how often it had to switch program, textures and vertex array
+	unsigned int draws;
+	unsigned int instances;
+	// draw calls issued for the packets, fewer than the packets when they are batched into multi draw indirect calls
+	unsigned int drawCalls;
+	unsigned int programBinds;
+	unsigned int textureSetBinds;
+	unsigned int vertexArrayBinds;
+
+	void reset()
+	{
+		fullTriangles = 0;
+		lodTriangles = 0;
+		drawnTriangles = 0;
+		meshes = 0;
+		frustumCulledMeshes = 0;
+		frustumCulledTriangles = 0;
+		clusters = 0;
+		culledClusters = 0;
+		draws = 0;
+		instances = 0;
+		drawCalls = 0;
+		programBinds = 0;
+		textureSetBinds = 0;
+		vertexArrayBinds = 0;
+	}
+};
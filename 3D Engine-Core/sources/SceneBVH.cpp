@@ -0,0 +1,472 @@
+#include "SceneBVH.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+
+float SceneBVH::rebuildThreshold = 1.3f;
+
+// centroids are sorted into this many bins per axis to evaluate the split planes
+static const unsigned int SAH_BINS = 16;
+// deeper nodes become leaves whatever their size, the tree stays usable for degenerate scenes
+static const int MAX_DEPTH = 64;
+static const unsigned int NO_PARENT = ~0u;
+
+// half the surface area of a box, the SAH only compares them
+static float halfArea(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax)
+{
+	glm::vec3 size = glm::max(boundsMax - boundsMin, glm::vec3(0.0f));
+	return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+SceneBVH::SceneBVH()
+	: firstInstance(1, 0), currentCost(0.0f), generation(0), pendingGeneration(0)
+{
+	Tree empty;
+	build(this->instances, empty);
+	adopt(empty);
+}
+
+void SceneBVH::build(const std::vector<Instance> &instances, Tree &tree)
+{
+	const unsigned int count = static_cast<unsigned int>(instances.size());
+	tree.order.resize(count);
+	for (unsigned int i = 0; i < count; i++)
+		tree.order[i] = i;
+
+	// a binary tree with leaves of at least one instance has fewer than twice as many nodes
+	tree.nodes.clear();
+	tree.nodes.reserve(count * 2 + 1);
+	Node root = { glm::vec3(0.0f), 0, glm::vec3(0.0f), count };
+	tree.nodes.push_back(root);
+	if (count > 0)
+		buildNode(instances, tree, 0, 0, count, 0);
+	tree.cost = cost(tree.nodes);
+}
+
+void SceneBVH::buildNode(const std::vector<Instance> &instances, Tree &tree, unsigned int node, unsigned int first, unsigned int count, int depth)
+{
+	glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+	glm::vec3 centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+	for (unsigned int i = first; i < first + count; i++)
+	{
+		const Instance &instance = instances[tree.order[i]];
+		boundsMin = glm::min(boundsMin, instance.boundsMin);
+		boundsMax = glm::max(boundsMax, instance.boundsMax);
+		glm::vec3 centroid = (instance.boundsMin + instance.boundsMax) * 0.5f;
+		centroidMin = glm::min(centroidMin, centroid);
+		centroidMax = glm::max(centroidMax, centroid);
+	}
+	tree.nodes[node].boundsMin = boundsMin;
+	tree.nodes[node].boundsMax = boundsMax;
+	tree.nodes[node].first = first;
+	tree.nodes[node].count = count;
+	if (count == 1 || depth >= MAX_DEPTH)
+		return;
+
+	// cheapest split plane between the bins of any axis: cost of traversing the node plus the
+	// instances on both sides weighted by the area of their boxes relative to the node
+	const float leafCost = static_cast<float>(count);
+	float bestCost = FLT_MAX;
+	int bestAxis = -1;
+	unsigned int bestSplit = 0;
+	glm::vec3 binScale(0.0f);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float extent = centroidMax[axis] - centroidMin[axis];
+		if (extent <= 0.0f)
+			continue;
+		binScale[axis] = SAH_BINS / extent;
+
+		unsigned int binCounts[SAH_BINS] = {};
+		glm::vec3 binMin[SAH_BINS], binMax[SAH_BINS];
+		for (unsigned int b = 0; b < SAH_BINS; b++)
+		{
+			binMin[b] = glm::vec3(FLT_MAX);
+			binMax[b] = glm::vec3(-FLT_MAX);
+		}
+		for (unsigned int i = first; i < first + count; i++)
+		{
+			const Instance &instance = instances[tree.order[i]];
+			float centroid = (instance.boundsMin[axis] + instance.boundsMax[axis]) * 0.5f;
+			unsigned int b = std::min(static_cast<unsigned int>((centroid - centroidMin[axis]) * binScale[axis]), SAH_BINS - 1);
+			binCounts[b]++;
+			binMin[b] = glm::min(binMin[b], instance.boundsMin);
+			binMax[b] = glm::max(binMax[b], instance.boundsMax);
+		}
+
+		// areas and counts left of every plane, then sweep from the right
+		float leftArea[SAH_BINS];
+		unsigned int leftCount[SAH_BINS];
+		glm::vec3 sweepMin(FLT_MAX), sweepMax(-FLT_MAX);
+		unsigned int sweepCount = 0;
+		for (unsigned int b = 0; b < SAH_BINS - 1; b++)
+		{
+			sweepCount += binCounts[b];
+			sweepMin = glm::min(sweepMin, binMin[b]);
+			sweepMax = glm::max(sweepMax, binMax[b]);
+			leftCount[b] = sweepCount;
+			leftArea[b] = sweepCount > 0 ? halfArea(sweepMin, sweepMax) : 0.0f;
+		}
+		sweepMin = glm::vec3(FLT_MAX);
+		sweepMax = glm::vec3(-FLT_MAX);
+		sweepCount = 0;
+		const float nodeArea = glm::max(halfArea(boundsMin, boundsMax), FLT_MIN);
+		for (unsigned int b = SAH_BINS - 1; b > 0; b--)
+		{
+			sweepCount += binCounts[b];
+			sweepMin = glm::min(sweepMin, binMin[b]);
+			sweepMax = glm::max(sweepMax, binMax[b]);
+			if (sweepCount == 0 || leftCount[b - 1] == 0)
+				continue;
+			float splitCost = 1.0f + (leftArea[b - 1] * leftCount[b - 1] + halfArea(sweepMin, sweepMax) * sweepCount) / nodeArea;
+			if (splitCost < bestCost)
+			{
+				bestCost = splitCost;
+				bestAxis = axis;
+				bestSplit = b;
+			}
+		}
+	}
+
+	unsigned int middle;
+	if (bestAxis >= 0 && (bestCost < leafCost || count > MAX_LEAF_SIZE))
+	{
+		const int axis = bestAxis;
+		const float origin = centroidMin[axis], scale = binScale[axis];
+		unsigned int *split = std::partition(&tree.order[first], &tree.order[first] + count, [&](unsigned int index) {
+			float centroid = (instances[index].boundsMin[axis] + instances[index].boundsMax[axis]) * 0.5f;
+			return std::min(static_cast<unsigned int>((centroid - origin) * scale), SAH_BINS - 1) < bestSplit;
+		});
+		middle = static_cast<unsigned int>(split - &tree.order[first]);
+	}
+	else if (count > MAX_LEAF_SIZE)
+		// all centroids in one point, any halves are as good
+		middle = count / 2;
+	else
+		return;
+
+	unsigned int left = static_cast<unsigned int>(tree.nodes.size());
+	Node child = { glm::vec3(0.0f), 0, glm::vec3(0.0f), 0 };
+	tree.nodes.push_back(child);
+	tree.nodes.push_back(child);
+	tree.nodes[node].first = left;
+	tree.nodes[node].count = 0;
+	buildNode(instances, tree, left, first, middle, depth + 1);
+	buildNode(instances, tree, left + 1, first + middle, count - middle, depth + 1);
+}
+
+float SceneBVH::cost(const std::vector<Node> &nodes)
+{
+	const float rootArea = halfArea(nodes[0].boundsMin, nodes[0].boundsMax);
+	if (rootArea <= 0.0f)
+		return 0.0f;
+
+	float total = 0.0f;
+	for (size_t i = 0; i < nodes.size(); i++)
+		total += halfArea(nodes[i].boundsMin, nodes[i].boundsMax) * (nodes[i].count > 0 ? nodes[i].count : 1.0f);
+	return total / rootArea;
+}
+
+void SceneBVH::adopt(Tree &built)
+{
+	this->tree.nodes.swap(built.nodes);
+	this->tree.order.swap(built.order);
+
+	std::vector<Node> &nodes = this->tree.nodes;
+	this->parents.assign(nodes.size(), NO_PARENT);
+	this->instanceLeaves.resize(this->instances.size());
+	for (unsigned int i = 0; i < nodes.size(); i++)
+	{
+		if (nodes[i].count == 0 && nodes[i].first > i)
+		{
+			this->parents[nodes[i].first] = i;
+			this->parents[nodes[i].first + 1] = i;
+		}
+		else
+		{
+			for (unsigned int j = nodes[i].first; j < nodes[i].first + nodes[i].count; j++)
+				this->instanceLeaves[this->tree.order[j]] = i;
+		}
+	}
+
+	// a background build saw the boxes of the frame it started in, children come after their parents
+	for (size_t i = nodes.size(); i-- > 0;)
+	{
+		Node &node = nodes[i];
+		if (node.count > 0)
+		{
+			node.boundsMin = glm::vec3(FLT_MAX);
+			node.boundsMax = glm::vec3(-FLT_MAX);
+			for (unsigned int j = node.first; j < node.first + node.count; j++)
+			{
+				node.boundsMin = glm::min(node.boundsMin, this->instances[this->tree.order[j]].boundsMin);
+				node.boundsMax = glm::max(node.boundsMax, this->instances[this->tree.order[j]].boundsMax);
+			}
+		}
+		else if (node.first > i)
+		{
+			node.boundsMin = glm::min(nodes[node.first].boundsMin, nodes[node.first + 1].boundsMin);
+			node.boundsMax = glm::max(nodes[node.first].boundsMax, nodes[node.first + 1].boundsMax);
+		}
+	}
+	// compared against what the build achieved, so a tree outdated by the time it is done gets rebuilt again
+	this->tree.cost = built.cost;
+	this->currentCost = cost(nodes);
+}
+
+void SceneBVH::refitLeaf(unsigned int leaf)
+{
+	std::vector<Node> &nodes = this->tree.nodes;
+	for (unsigned int i = leaf; i != NO_PARENT; i = this->parents[i])
+	{
+		Node &node = nodes[i];
+		glm::vec3 boundsMin, boundsMax;
+		if (node.count > 0)
+		{
+			boundsMin = glm::vec3(FLT_MAX);
+			boundsMax = glm::vec3(-FLT_MAX);
+			for (unsigned int j = node.first; j < node.first + node.count; j++)
+			{
+				boundsMin = glm::min(boundsMin, this->instances[this->tree.order[j]].boundsMin);
+				boundsMax = glm::max(boundsMax, this->instances[this->tree.order[j]].boundsMax);
+			}
+		}
+		else
+		{
+			boundsMin = glm::min(nodes[node.first].boundsMin, nodes[node.first + 1].boundsMin);
+			boundsMax = glm::max(nodes[node.first].boundsMax, nodes[node.first + 1].boundsMax);
+		}
+
+		// the ancestors only depend on this box
+		if (boundsMin == node.boundsMin && boundsMax == node.boundsMax)
+			break;
+		node.boundsMin = boundsMin;
+		node.boundsMax = boundsMax;
+	}
+}
+
+// world space box of a mesh of an instance of a model
+static SceneBVH::Instance makeInstance(const Model &model, unsigned int modelIndex, unsigned int copy, unsigned int mesh, const glm::mat4 &transform)
+{
+	glm::vec3 center, extent;
+	float radius;
+	model.meshes[mesh].worldBounds(model.instanceTransform(transform, copy), center, extent, radius);
+	SceneBVH::Instance instance = { modelIndex, copy, mesh, center - extent, center + extent };
+	return instance;
+}
+
+void SceneBVH::sync(const std::vector<Model*> &models, const std::vector<glm::mat4> &transforms)
+{
+	bool changed = models != this->models;
+	for (size_t i = 0; !changed && i < models.size(); i++)
+	{
+		changed = models[i]->instanceRevision != this->revisions[i] ||
+			models[i]->meshes.size() * models[i]->instances.size() != this->firstInstance[i + 1] - this->firstInstance[i];
+	}
+
+	// models were added, removed or replaced, their instances are new
+	if (changed)
+	{
+		this->instances.clear();
+		this->firstInstance.assign(1, 0);
+		this->revisions.resize(models.size());
+		for (unsigned int i = 0; i < models.size(); i++)
+		{
+			for (unsigned int copy = 0; copy < models[i]->instances.size(); copy++)
+			{
+				for (unsigned int j = 0; j < models[i]->meshes.size(); j++)
+					this->instances.push_back(makeInstance(*models[i], i, copy, j, transforms[i]));
+			}
+			this->firstInstance.push_back(static_cast<unsigned int>(this->instances.size()));
+			this->revisions[i] = models[i]->instanceRevision;
+		}
+		this->models = models;
+		this->transforms = transforms;
+		this->generation++;
+
+		Tree built;
+		build(this->instances, built);
+		adopt(built);
+		return;
+	}
+
+	bool moved = false;
+	for (unsigned int i = 0; i < models.size(); i++)
+	{
+		if (transforms[i] == this->transforms[i])
+			continue;
+		for (unsigned int index = this->firstInstance[i]; index < this->firstInstance[i + 1]; index++)
+		{
+			this->instances[index] = makeInstance(*models[i], i, this->instances[index].copy, this->instances[index].mesh, transforms[i]);
+			refitLeaf(this->instanceLeaves[index]);
+		}
+		this->transforms[i] = transforms[i];
+		moved = true;
+	}
+	if (moved)
+		this->currentCost = cost(this->tree.nodes);
+
+	if (this->pending.valid())
+	{
+		if (this->pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			return;
+		Tree built = this->pending.get();
+		if (this->pendingGeneration == this->generation)
+			adopt(built);
+	}
+	if (degradation() > rebuildThreshold)
+	{
+		this->pendingGeneration = this->generation;
+		std::vector<Instance> snapshot = this->instances;
+		this->pending = ThreadPool::shared().submit([snapshot]() {
+			Tree built;
+			build(snapshot, built);
+			return built;
+		});
+	}
+}
+
+float SceneBVH::degradation() const
+{
+	return this->tree.cost > 0.0f ? this->currentCost / this->tree.cost : 1.0f;
+}
+
+void SceneBVH::queryFrustum(const Frustum &frustum, std::vector<unsigned int> &inside, std::vector<unsigned int> &intersecting) const
+{
+	const std::vector<Node> &nodes = this->tree.nodes;
+	if (this->instances.empty())
+		return;
+
+	// nodes still to visit with the planes their parent was not completely inside of, one bit per plane
+	std::vector<std::pair<unsigned int, unsigned int>> stack;
+	stack.push_back(std::make_pair(0u, 0x3fu));
+	while (!stack.empty())
+	{
+		const Node &node = nodes[stack.back().first];
+		unsigned int planes = stack.back().second;
+		stack.pop_back();
+
+		glm::vec3 center = (node.boundsMin + node.boundsMax) * 0.5f;
+		glm::vec3 extent = (node.boundsMax - node.boundsMin) * 0.5f;
+		bool outside = false;
+		for (int p = 0; p < 6 && !outside; p++)
+		{
+			if (!(planes & (1u << p)))
+				continue;
+			const glm::vec4 &plane = frustum.planes[p];
+			float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+			float reach = glm::dot(glm::abs(glm::vec3(plane)), extent);
+			if (distance + reach < 0.0f)
+				outside = true;
+			else if (distance - reach >= 0.0f)
+				planes &= ~(1u << p);
+		}
+		if (outside)
+			continue;
+
+		if (node.count > 0)
+		{
+			std::vector<unsigned int> &result = planes == 0 ? inside : intersecting;
+			result.insert(result.end(), &this->tree.order[node.first], &this->tree.order[node.first] + node.count);
+			continue;
+		}
+		stack.push_back(std::make_pair(node.first, planes));
+		stack.push_back(std::make_pair(node.first + 1, planes));
+	}
+}
+
+void SceneBVH::querySphere(const glm::vec3 &center, float radius, std::vector<unsigned int> &instances) const
+{
+	const std::vector<Node> &nodes = this->tree.nodes;
+	if (this->instances.empty())
+		return;
+
+	std::vector<unsigned int> stack(1, 0);
+	while (!stack.empty())
+	{
+		const Node &node = nodes[stack.back()];
+		stack.pop_back();
+
+		glm::vec3 offset = center - glm::clamp(center, node.boundsMin, node.boundsMax);
+		if (glm::dot(offset, offset) > radius * radius)
+			continue;
+
+		if (node.count == 0)
+		{
+			stack.push_back(node.first);
+			stack.push_back(node.first + 1);
+			continue;
+		}
+		for (unsigned int i = node.first; i < node.first + node.count; i++)
+		{
+			const Instance &instance = this->instances[this->tree.order[i]];
+			offset = center - glm::clamp(center, instance.boundsMin, instance.boundsMax);
+			if (glm::dot(offset, offset) <= radius * radius)
+				instances.push_back(this->tree.order[i]);
+		}
+	}
+}
+
+// distance along the ray where it enters the box, or FLT_MAX if it misses it before maxDistance
+static float enterBox(const glm::vec3 &origin, const glm::vec3 &inverseDirection, float maxDistance, const glm::vec3 &boundsMin, const glm::vec3 &boundsMax)
+{
+	glm::vec3 t0 = (boundsMin - origin) * inverseDirection;
+	glm::vec3 t1 = (boundsMax - origin) * inverseDirection;
+	glm::vec3 tEnter = glm::min(t0, t1), tExit = glm::max(t0, t1);
+	float enter = glm::max(glm::max(tEnter.x, tEnter.y), glm::max(tEnter.z, 0.0f));
+	float exit = glm::min(glm::min(tExit.x, tExit.y), glm::min(tExit.z, maxDistance));
+	return enter <= exit ? enter : FLT_MAX;
+}
+
+bool SceneBVH::raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, unsigned int &instance, float &distance) const
+{
+	const std::vector<Node> &nodes = this->tree.nodes;
+	if (this->instances.empty())
+		return false;
+
+	// infinities for the axes the ray runs parallel to, the slab test handles them
+	const glm::vec3 inverseDirection = 1.0f / direction;
+	bool hit = false;
+	distance = maxDistance;
+
+	std::vector<unsigned int> stack;
+	if (enterBox(origin, inverseDirection, distance, nodes[0].boundsMin, nodes[0].boundsMax) != FLT_MAX)
+		stack.push_back(0);
+	while (!stack.empty())
+	{
+		const Node &node = nodes[stack.back()];
+		stack.pop_back();
+		// the nearest hit may have moved closer since the node was pushed
+		if (enterBox(origin, inverseDirection, distance, node.boundsMin, node.boundsMax) == FLT_MAX)
+			continue;
+
+		if (node.count > 0)
+		{
+			for (unsigned int i = node.first; i < node.first + node.count; i++)
+			{
+				const Instance &candidate = this->instances[this->tree.order[i]];
+				float enter = enterBox(origin, inverseDirection, distance, candidate.boundsMin, candidate.boundsMax);
+				if (enter != FLT_MAX && (!hit || enter < distance))
+				{
+					distance = enter;
+					instance = this->tree.order[i];
+					hit = true;
+				}
+			}
+			continue;
+		}
+
+		// the nearer child is visited first so it can shorten the ray for the other one
+		float left = enterBox(origin, inverseDirection, distance, nodes[node.first].boundsMin, nodes[node.first].boundsMax);
+		float right = enterBox(origin, inverseDirection, distance, nodes[node.first + 1].boundsMin, nodes[node.first + 1].boundsMax);
+		unsigned int nearChild = left <= right ? node.first : node.first + 1;
+		float farDistance = left <= right ? right : left;
+		if (farDistance != FLT_MAX)
+			stack.push_back(nearChild == node.first ? node.first + 1 : node.first);
+		if (glm::min(left, right) != FLT_MAX)
+			stack.push_back(nearChild);
+	}
+	return hit;
+}
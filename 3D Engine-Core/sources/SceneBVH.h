@@ -0,0 +1,101 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "Frustum.h"
+#include "Model.h"
+
+#include <future>
+#include <vector>
+
+// Bounding volume hierarchy over the mesh instances of the scene, one per mesh of every instance of every model, in world space.
+// Built with the surface area heuristic over binned centroids. When models move, the boxes of their instances are
+// refitted from the leaves up, which keeps the queries correct but lets the tree degrade; once its SAH cost grows
+// past rebuildThreshold times the cost it was built with, a new tree is built on the ThreadPool and swapped in when done.
+// Queries walk the tree, so they touch only the subtrees that overlap the query volume. Main thread only.
+class SceneBVH
+{
+public:
+	// a mesh of an instance of a model, with its world space box
+	struct Instance
+	{
+		unsigned int model;		// index of the model as passed to sync
+		unsigned int copy;		// index into Model::instances
+		unsigned int mesh;		// index into Model::meshes
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+	};
+
+	// instances a leaf holds at most
+	static const unsigned int MAX_LEAF_SIZE = 4;
+	// SAH cost over the cost at build that starts a background rebuild
+	static float rebuildThreshold;
+
+	SceneBVH();
+
+	// builds the tree again when the models or their instances changed and refits the instances of the models
+	// whose transform changed. Adopts a finished background build and starts one when the tree degraded.
+	void sync(const std::vector<Model*> &models, const std::vector<glm::mat4> &transforms);
+
+	// instances whose boxes lie inside the frustum, and those of the leaves crossing one of its planes,
+	// which still need a finer test
+	void queryFrustum(const Frustum &frustum, std::vector<unsigned int> &inside, std::vector<unsigned int> &intersecting) const;
+
+	// instances whose boxes overlap the sphere
+	void querySphere(const glm::vec3 &center, float radius, std::vector<unsigned int> &instances) const;
+
+	// nearest instance whose box the ray from origin along direction enters before maxDistance.
+	// Returns false if it hits none, distance is where it enters the box.
+	bool raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, unsigned int &instance, float &distance) const;
+
+	const Instance& instance(unsigned int index) const { return this->instances[index]; }
+	size_t size() const { return this->instances.size(); }
+
+	// SAH cost of the current tree over the cost it was built with, 1 right after a build
+	float degradation() const;
+	bool rebuilding() const { return this->pending.valid(); }
+
+private:
+	struct Node
+	{
+		glm::vec3 boundsMin;
+		unsigned int first;		// first child for inner nodes, the second follows it. First entry of order for leaves.
+		glm::vec3 boundsMax;
+		unsigned int count;		// instances of a leaf, 0 for inner nodes
+	};
+
+	// nodes, with the children after their parents, and the instances in leaf order
+	struct Tree
+	{
+		std::vector<Node> nodes;
+		std::vector<unsigned int> order;
+		float cost;
+	};
+
+	// builds a tree over instance boxes. Only reads the boxes, so it runs on a worker thread.
+	static void build(const std::vector<Instance> &instances, Tree &tree);
+	static void buildNode(const std::vector<Instance> &instances, Tree &tree, unsigned int node, unsigned int first, unsigned int count, int depth);
+	static float cost(const std::vector<Node> &nodes);
+
+	// takes over a built tree and refits it to the current instance boxes
+	void adopt(Tree &tree);
+	// recomputes the box of a leaf and of its ancestors, stopping at the first that does not change
+	void refitLeaf(unsigned int leaf);
+
+	std::vector<Model*> models;
+	std::vector<glm::mat4> transforms;
+	std::vector<unsigned int> revisions;
+	std::vector<Instance> instances;
+	// instances of model i are firstInstance[i] to firstInstance[i + 1] - 1
+	std::vector<unsigned int> firstInstance;
+
+	Tree tree;
+	std::vector<unsigned int> parents;
+	std::vector<unsigned int> instanceLeaves;
+	float currentCost;
+
+	// background rebuild and the scene generation it was started for, dropped when the models changed meanwhile
+	std::future<Tree> pending;
+	unsigned int generation;
+	unsigned int pendingGeneration;
+};
@@ -1,6 +1,8 @@
 #include "Shader.h"
+#include "GLState.h"
+#include "FrameUniforms.h"
 
-void Shader::checkCompileErrors(unsigned int shader, std::string type) 
+bool Shader::checkCompileErrors(unsigned int shader, std::string type) 
 {
 	int success;
 	char infoLog[1024];
@@ -22,46 +24,64 @@ void Shader::checkCompileErrors(unsigned int shader, std::string type)
 			std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog <<"\n-------------------------------------------------------" << std::endl;
 		}
 	}
+	return success != 0;
 };
 
-Shader::Shader(const char * vertexPath, const char * fragmentPath)
+bool Shader::readFile(const std::string &path, std::string &code)
 {
-	// 1. Retrieve the vertex/fragment source code from filePath
-	std::string vertexCode;
-	std::string fragmentCode;
-	std::ifstream vShaderFile;
-	std::ifstream fShaderFile;
+	std::ifstream file;
 	// ensures ifstream objects can throw exceptions:
-	vShaderFile.exceptions(std::ifstream::badbit);
-	fShaderFile.exceptions(std::ifstream::badbit);
+	file.exceptions(std::ifstream::badbit);
 
 	try
 	{
-		// Open files
-		vShaderFile.open(vertexPath);
-		fShaderFile.open(fragmentPath);
-
-		std::stringstream vShaderStream, fShaderStream;
-		// Read file's buffer contents into streams
-		vShaderStream << vShaderFile.rdbuf();
-		fShaderStream << fShaderFile.rdbuf();
-
-		// close file handlers
-		vShaderFile.close();
-		fShaderFile.close();
-
-		// Convert stream into string
-		vertexCode = vShaderStream.str();
-		fragmentCode = fShaderStream.str();
-	} 
+		file.open(path.c_str());
+		if(!file.is_open())
+			return false;
+
+		// Read file's buffer contents into a stream and convert it into a string
+		std::stringstream stream;
+		stream << file.rdbuf();
+		file.close();
+		code = stream.str();
+	}
 	catch(std::ifstream::failure e)
 	{
-		std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;		
+		return false;
 	}
+	return true;
+}
+
+Shader::Shader(const char * vertexPath, const char * fragmentPath)
+	: vertexPath(vertexPath), fragmentPath(fragmentPath)
+{
+	// 1. Retrieve the vertex/fragment source code from filePath
+	std::string vertexCode;
+	std::string fragmentCode;
+	if(!readFile(this->vertexPath, vertexCode) || !readFile(this->fragmentPath, fragmentCode))
+		std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+
+	// 2. Compile shaders
+	this->Program = build(vertexCode, fragmentCode);
+}
 
+bool Shader::reload(const std::string &vertexCode, const std::string &fragmentCode)
+{
+	unsigned int program = build(vertexCode, fragmentCode);
+	if(!program)
+		return false;
+
+	// the uniforms are set every frame, so the new program only needs to replace the old one
+	GLState::deleteProgram(this->Program);
+	this->Program = program;
+	this->uniformLocations.clear();
+	return true;
+}
+
+unsigned int Shader::build(const std::string &vertexCode, const std::string &fragmentCode)
+{
 	const char *vShaderCode = vertexCode.c_str();
 	const char *fShaderCode = fragmentCode.c_str();
-	// 2. Compile shaders
 	unsigned int vertex, fragment;
 
 	// Vertex Shader
@@ -81,52 +101,80 @@ Shader::Shader(const char * vertexPath, const char * fragmentPath)
 	checkCompileErrors(fragment, "FRAGMENT");
 	
 	// Shader Program
-	this->Program = glCreateProgram();
-	glAttachShader(this->Program, vertex);
-	glAttachShader(this->Program, fragment);
-	glLinkProgram(this->Program);
+	unsigned int program = glCreateProgram();
+	glAttachShader(program, vertex);
+	glAttachShader(program, fragment);
+	glLinkProgram(program);
 
 	// Print linking errors if any
-	checkCompileErrors(this->Program, "PROGRAM");
+	bool linked = checkCompileErrors(program, "PROGRAM");
 
 	// Delete the shaders as they're linked into our program now and no longer necessery
 	glDeleteShader(vertex);
 	glDeleteShader(fragment);
+
+	if(!linked)
+	{
+		GLState::deleteProgram(program);
+		return 0;
+	}
+
+	// the per frame blocks this program declares read the buffers of FrameUniforms
+	const UniformBlockBinding bindings[] = { UNIFORM_BLOCK_CAMERA, UNIFORM_BLOCK_LIGHTS };
+	for(unsigned int i = 0; i < sizeof(bindings) / sizeof(bindings[0]); i++)
+	{
+		GLuint block = glGetUniformBlockIndex(program, uniformBlockName(bindings[i]));
+		if(block != GL_INVALID_INDEX)
+			glUniformBlockBinding(program, block, bindings[i]);
+	}
+	return program;
 }
 
 void Shader::use()
 {
-	glUseProgram(this->Program);
+	GLState::useProgram(this->Program);
 }
 
 void Shader::unUse()
 {
-	glUseProgram(0);
+	GLState::useProgram(0);
+}
+
+GLint Shader::uniformLocation(const std::string &name) const
+{
+	std::unordered_map<std::string, GLint>::const_iterator cached = this->uniformLocations.find(name);
+	if(cached != this->uniformLocations.end())
+		return cached->second;
+
+	// unknown names are cached as -1 too, glUniform ignores them
+	GLint location = glGetUniformLocation(this->Program, name.c_str());
+	this->uniformLocations[name] = location;
+	return location;
 }
 
 void Shader::setUniform1i(const std::string &nameUniform, int value) const
 {
-	glUniform1i(glGetUniformLocation(this->Program, nameUniform.c_str()), value);
+	glUniform1i(uniformLocation(nameUniform), value);
 }
 
 void Shader::setUniform1f(const std::string &nameUniform, float value) const
 {
-	glUniform1f(glGetUniformLocation(this->Program, nameUniform.c_str()), value);
+	glUniform1f(uniformLocation(nameUniform), value);
 }
 
 void Shader::setUniformVec2(const std::string &nameUniform, const glm::vec2 &value) const
 {
-	glUniform2f(glGetUniformLocation(this->Program, nameUniform.c_str()), value.x, value.y);
+	glUniform2f(uniformLocation(nameUniform), value.x, value.y);
 }
 
 void Shader::setUniformVec3(const std::string &nameUniform, const glm::vec3 &value) const
 {
-	glUniform3f(glGetUniformLocation(this->Program, nameUniform.c_str()), value.x, value.y, value.z);
+	glUniform3f(uniformLocation(nameUniform), value.x, value.y, value.z);
 }
 
 void Shader::setUniformMat4(const std::string &nameUnifrom, const glm::mat4 &value, bool transpose) const
 {
-	glUniformMatrix4fv(glGetUniformLocation(this->Program, nameUnifrom.c_str()), 1, transpose, glm::value_ptr(value));
+	glUniformMatrix4fv(uniformLocation(nameUnifrom), 1, transpose, glm::value_ptr(value));
 }
 
 
@@ -3,6 +3,7 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -15,8 +16,15 @@ public:
 	unsigned int ID;
 	// The program ID
 	unsigned int Program;
+	// Source files, kept to reload the program when they change
+	std::string vertexPath;
+	std::string fragmentPath;
 	// Constructor reads and builds the shader
 	Shader(const char* vertexPath, const char* fragmentPath);
+	// Builds a new program from the given sources and swaps it in if it links, otherwise keeps the current one
+	bool reload(const std::string &vertexCode, const std::string &fragmentCode);
+	// Reads a whole source file, returns false if it cannot be read
+	static bool readFile(const std::string &path, std::string &code);
 	// Use the program
 	void use();
 	// Un use the program
@@ -25,8 +33,11 @@ public:
 	// ------------------------------------------------------------------------
 	void setInt(const std::string& name, int value) const
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+		glUniform1i(uniformLocation(name), value);
 	}
+
+	// Location of a uniform of the program, looked up once and then cached
+	GLint uniformLocation(const std::string &name) const;
 	
 	//Set uniform1i
 	void setUniform1i(const std::string &nameUniform, const int value) const;
@@ -40,6 +51,11 @@ public:
 	void setUniformMat4(const std::string &nameUnifrom, const glm::mat4 &value, bool transpose) const;
 
 private:
-	void checkCompileErrors(unsigned int shader, std::string type);
+	// compiles and links a program, returns 0 if it does not link
+	unsigned int build(const std::string &vertexCode, const std::string &fragmentCode);
+	bool checkCompileErrors(unsigned int shader, std::string type);
+
+	// uniform locations of Program by name, cleared when the program is replaced
+	mutable std::unordered_map<std::string, GLint> uniformLocations;
 };
 
@@ -0,0 +1,185 @@
+#include "StreamBuffer.h"
+#include "GLExtensions.h"
+#include "GLState.h"
+
+#include <algorithm>
+#include <iostream>
+
+StreamBuffer::StreamBuffer(size_t frameBytes)
+	: name(0), persistentMapping(false), segmentBytes(frameBytes), segment(0), segmentStart(0), head(0),
+	mapped(nullptr), mappedStart(0), waitCount(0)
+{
+	for (unsigned int i = 0; i < FRAMES; i++)
+		this->fences[i] = nullptr;
+}
+
+void StreamBuffer::release()
+{
+	commit();
+	for (unsigned int i = 0; i < FRAMES; i++)
+	{
+		if (this->fences[i])
+			glDeleteSync(this->fences[i]);
+		this->fences[i] = nullptr;
+	}
+	if (!this->retired.empty())
+		GLState::deleteBuffers(static_cast<GLsizei>(this->retired.size()), this->retired.data());
+	this->retired.clear();
+	GLState::deleteBuffers(1, &this->name);
+	this->name = 0;
+}
+
+void StreamBuffer::unmap()
+{
+	if (this->mapped == nullptr)
+		return;
+	GLState::bindBuffer(GL_COPY_WRITE_BUFFER, this->name);
+	glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+	this->mapped = nullptr;
+}
+
+void StreamBuffer::create(size_t bytes)
+{
+	// ranges handed out this frame stay writable until commit, the old buffer is unmapped there
+	if (this->mapped != nullptr && !this->persistentMapping)
+		this->retiredMapped.push_back(this->name);
+	this->mapped = nullptr;
+	if (this->name != 0)
+		this->retired.push_back(this->name);
+	// the fences guard segments of the old buffer, which is only deleted once the GPU is done with it
+	for (unsigned int i = 0; i < FRAMES; i++)
+	{
+		if (this->fences[i])
+			glDeleteSync(this->fences[i]);
+		this->fences[i] = nullptr;
+	}
+
+	this->segmentBytes = bytes;
+	this->segment = 0;
+	this->segmentStart = 0;
+	this->head = 0;
+
+	glGenBuffers(1, &this->name);
+	GLState::bindBuffer(GL_COPY_WRITE_BUFFER, this->name);
+	this->persistentMapping = GLExtensions::bufferStorage;
+	if (this->persistentMapping)
+	{
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		GLExtensions::glBufferStorage(GL_COPY_WRITE_BUFFER, this->segmentBytes * FRAMES, nullptr, flags);
+		this->mapped = static_cast<char*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, this->segmentBytes * FRAMES, flags));
+		this->mappedStart = 0;
+		if (this->mapped == nullptr)
+		{
+			std::cout << "WARNING::STREAM_BUFFER::PERSISTENT_MAPPING_FAILED, orphaning instead" << std::endl;
+			GLState::deleteBuffers(1, &this->name);
+			glGenBuffers(1, &this->name);
+			GLState::bindBuffer(GL_COPY_WRITE_BUFFER, this->name);
+			this->persistentMapping = false;
+		}
+	}
+	if (!this->persistentMapping)
+		glBufferData(GL_COPY_WRITE_BUFFER, this->segmentBytes, nullptr, GL_STREAM_DRAW);
+}
+
+void StreamBuffer::beginFrame()
+{
+	if (this->name == 0)
+	{
+		create(this->segmentBytes);
+		return;
+	}
+
+	// nothing of the frames before the last endFrame is drawn from the replaced buffers any more
+	if (!this->retired.empty())
+		GLState::deleteBuffers(static_cast<GLsizei>(this->retired.size()), this->retired.data());
+	this->retired.clear();
+
+	if (this->persistentMapping)
+	{
+		this->segment = (this->segment + 1) % FRAMES;
+		this->segmentStart = this->segment * this->segmentBytes;
+
+		// written by the frame FRAMES ago, usually long done
+		GLsync &fence = this->fences[this->segment];
+		if (fence)
+		{
+			GLenum result = glClientWaitSync(fence, 0, 0);
+			if (result == GL_TIMEOUT_EXPIRED)
+			{
+				this->waitCount++;
+				result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+			}
+			if (result == GL_WAIT_FAILED || result == GL_TIMEOUT_EXPIRED)
+				std::cout << "ERROR::STREAM_BUFFER::FENCE_WAIT_FAILED" << std::endl;
+			glDeleteSync(fence);
+			fence = nullptr;
+		}
+	}
+	else
+	{
+		// new storage for the frame, the driver keeps the old one until the GPU has read it
+		unmap();
+		GLState::bindBuffer(GL_COPY_WRITE_BUFFER, this->name);
+		glBufferData(GL_COPY_WRITE_BUFFER, this->segmentBytes, nullptr, GL_STREAM_DRAW);
+		this->segmentStart = 0;
+	}
+	this->head = this->segmentStart;
+}
+
+void* StreamBuffer::allocate(size_t bytes, size_t alignment, GLuint &buffer, size_t &offset)
+{
+	if (this->name == 0)
+		beginFrame();
+
+	size_t start = (this->head + alignment - 1) / alignment * alignment;
+	if (start + bytes > this->segmentStart + this->segmentBytes)
+	{
+		create(std::max(this->segmentBytes * 2, (bytes + alignment) * 2));
+		start = 0;
+	}
+
+	if (this->mapped == nullptr)
+	{
+		// the rest of the orphaned storage, which no draw has read from yet
+		GLState::bindBuffer(GL_COPY_WRITE_BUFFER, this->name);
+		this->mapped = static_cast<char*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, start, this->segmentBytes - start,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+		this->mappedStart = start;
+		if (this->mapped == nullptr)
+		{
+			std::cout << "ERROR::STREAM_BUFFER::MAPPING_FAILED" << std::endl;
+			return nullptr;
+		}
+	}
+
+	this->head = start + bytes;
+	buffer = this->name;
+	offset = start;
+	return this->mapped + (start - this->mappedStart);
+}
+
+void StreamBuffer::commit()
+{
+	// coherent persistent mappings are seen by every command issued after the write
+	if (this->persistentMapping)
+		return;
+	unmap();
+	for (size_t i = 0; i < this->retiredMapped.size(); i++)
+	{
+		GLState::bindBuffer(GL_COPY_WRITE_BUFFER, this->retiredMapped[i]);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+	}
+	this->retiredMapped.clear();
+}
+
+void StreamBuffer::endFrame()
+{
+	if (!this->persistentMapping)
+	{
+		commit();
+		return;
+	}
+	if (this->fences[this->segment])
+		glDeleteSync(this->fences[this->segment]);
+	this->fences[this->segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
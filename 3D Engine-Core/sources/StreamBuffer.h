@@ -0,0 +1,74 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <vector>
+
+// Ring buffer for the data written once per frame, the frame uniforms, the instances and the indirect commands.
+// Users take aligned ranges of the current frame with a bump pointer, write them through the returned pointer
+// and point their draws at the buffer and the offset.
+// With GL_ARB_buffer_storage the buffer is mapped once for good and split into FRAMES segments, one per frame in
+// flight; a fence after the draws of a frame guards its segment, so writing only waits when the GPU falls more
+// than FRAMES - 1 frames behind. Without it the buffer is orphaned every frame and mapped unsynchronized instead.
+// When a frame needs more than a segment, a buffer twice the size replaces it. GL thread only.
+class StreamBuffer
+{
+public:
+	static const unsigned int FRAMES = 3;
+
+	explicit StreamBuffer(size_t frameBytes = 1 << 20);
+
+	// moves to the segment of the next frame, waiting for the GPU to finish with it if it has to.
+	// Creates the buffer on first use.
+	void beginFrame();
+
+	// reserves bytes of the current frame starting at a multiple of alignment. Returns where to write them, valid
+	// until commit, and the buffer and offset to draw them from; a range taken after the buffer grew is in the new one,
+	// the ones taken before stay writable and drawable in the old one.
+	// Returns nullptr if the buffer cannot be mapped.
+	void* allocate(size_t bytes, size_t alignment, GLuint &buffer, size_t &offset);
+
+	// makes the writes so far visible to draws, call before drawing from the buffer.
+	// Allocating again afterwards is fine.
+	void commit();
+
+	// fences the draws of the frame, call after the last one reading from the buffer
+	void endFrame();
+
+	// deletes the buffer and the fences, call before the context is destroyed
+	void release();
+
+	bool persistent() const { return this->persistentMapping; }
+	// bytes allocated in the current frame
+	size_t frameUsage() const { return this->head - this->segmentStart; }
+	size_t frameCapacity() const { return this->segmentBytes; }
+	// frames whose beginFrame had to wait for the GPU, since the buffer was created
+	unsigned int waits() const { return this->waitCount; }
+
+private:
+	StreamBuffer(const StreamBuffer&) = delete;
+	StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+	// creates a buffer with segments of segmentBytes, the current one is deleted at the next beginFrame
+	void create(size_t bytes);
+	void unmap();
+
+	GLuint name;
+	bool persistentMapping;
+	size_t segmentBytes;
+	unsigned int segment;
+	size_t segmentStart;
+	size_t head;
+
+	// persistent: the whole buffer. Orphaning: the range from mappedStart on, until commit.
+	char *mapped;
+	size_t mappedStart;
+
+	GLsync fences[FRAMES];
+	// buffers replaced this frame, bindings of the frame may still point at them
+	std::vector<GLuint> retired;
+	// the retired ones still mapped for ranges handed out before they were replaced, orphaning only
+	std::vector<GLuint> retiredMapped;
+	unsigned int waitCount;
+};
@@ -0,0 +1,376 @@
+#include "TextureCache.h"
+#include "FileUtils.h"
+#include "TextureCompressor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <vector>
+
+// layout of a cache file, following the KTX 2.0 specification without supercompression:
+//   header, level index (largest level first), data format descriptor,
+//   key/value data with the cache key under "3DEngine.source",
+//   level data (smallest level first, each aligned to its block size and 4)
+static const unsigned char KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+static const char CACHE_KEY_NAME[] = "3DEngine.source";
+static const char WRITER_NAME[] = "3D Engine-Core";
+
+struct Ktx2Header
+{
+	unsigned char identifier[12];
+	uint32_t vkFormat;
+	uint32_t typeSize;
+	uint32_t pixelWidth;
+	uint32_t pixelHeight;
+	uint32_t pixelDepth;
+	uint32_t layerCount;
+	uint32_t faceCount;
+	uint32_t levelCount;
+	uint32_t supercompressionScheme;
+	uint32_t dfdByteOffset;
+	uint32_t dfdByteLength;
+	uint32_t kvdByteOffset;
+	uint32_t kvdByteLength;
+	uint64_t sgdByteOffset;
+	uint64_t sgdByteLength;
+};
+
+static_assert(sizeof(Ktx2Header) == 80, "KTX2 header must not be padded");
+
+struct Ktx2Level
+{
+	uint64_t byteOffset;
+	uint64_t byteLength;
+	uint64_t uncompressedByteLength;
+};
+
+// what the cooked chain was built from
+struct TextureCacheKey
+{
+	uint64_t sourceHash;
+	uint32_t version;
+	uint32_t usage;
+	uint32_t settings;
+	uint32_t components;
+};
+
+// VkFormat values of the formats the TextureLoader uploads
+enum
+{
+	VK_FORMAT_R8_UNORM = 9,
+	VK_FORMAT_R8G8_UNORM = 16,
+	VK_FORMAT_R8G8B8_UNORM = 23,
+	VK_FORMAT_R8G8B8A8_UNORM = 37,
+	VK_FORMAT_BC1_RGB_UNORM_BLOCK = 131,
+	VK_FORMAT_BC3_UNORM_BLOCK = 137,
+	VK_FORMAT_BC4_UNORM_BLOCK = 139,
+	VK_FORMAT_BC5_UNORM_BLOCK = 141,
+	VK_FORMAT_BC7_UNORM_BLOCK = 145
+};
+
+static uint32_t vkFormatOf(GLenum format, int components)
+{
+	switch (format)
+	{
+	case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: return VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+	case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: return VK_FORMAT_BC3_UNORM_BLOCK;
+	case GL_COMPRESSED_RED_RGTC1: return VK_FORMAT_BC4_UNORM_BLOCK;
+	case GL_COMPRESSED_RG_RGTC2: return VK_FORMAT_BC5_UNORM_BLOCK;
+	case GL_COMPRESSED_RGBA_BPTC_UNORM: return VK_FORMAT_BC7_UNORM_BLOCK;
+	}
+	static const uint32_t uncompressed[4] = { VK_FORMAT_R8_UNORM, VK_FORMAT_R8G8_UNORM, VK_FORMAT_R8G8B8_UNORM, VK_FORMAT_R8G8B8A8_UNORM };
+	return uncompressed[components - 1];
+}
+
+// GL format of a VkFormat, with the component count for the uncompressed ones
+static bool glFormatOf(uint32_t vkFormat, GLenum &format, int &components)
+{
+	format = 0;
+	components = 0;
+	switch (vkFormat)
+	{
+	case VK_FORMAT_R8_UNORM: components = 1; return true;
+	case VK_FORMAT_R8G8_UNORM: components = 2; return true;
+	case VK_FORMAT_R8G8B8_UNORM: components = 3; return true;
+	case VK_FORMAT_R8G8B8A8_UNORM: components = 4; return true;
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK: format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT; return true;
+	case VK_FORMAT_BC3_UNORM_BLOCK: format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; return true;
+	case VK_FORMAT_BC4_UNORM_BLOCK: format = GL_COMPRESSED_RED_RGTC1; return true;
+	case VK_FORMAT_BC5_UNORM_BLOCK: format = GL_COMPRESSED_RG_RGTC2; return true;
+	case VK_FORMAT_BC7_UNORM_BLOCK: format = GL_COMPRESSED_RGBA_BPTC_UNORM; return true;
+	}
+	return false;
+}
+
+// basic data format descriptor of a format, linear BT.709 colors
+static void describeFormat(GLenum format, int components, std::vector<uint32_t> &dfd)
+{
+	struct Sample { uint32_t bitOffset, bitLength, channel, upper; };
+	Sample samples[4];
+	int sampleCount = 0;
+	uint32_t colorModel, bytesPlane0, blockSize;
+
+	switch (format)
+	{
+	case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+		colorModel = 128; bytesPlane0 = 8;
+		samples[sampleCount++] = { 0, 63, 0, 0xFFFFFFFFu };
+		break;
+	case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+		colorModel = 130; bytesPlane0 = 16;
+		samples[sampleCount++] = { 0, 63, 15, 0xFFFFFFFFu };
+		samples[sampleCount++] = { 64, 63, 0, 0xFFFFFFFFu };
+		break;
+	case GL_COMPRESSED_RED_RGTC1:
+		colorModel = 131; bytesPlane0 = 8;
+		samples[sampleCount++] = { 0, 63, 0, 0xFFFFFFFFu };
+		break;
+	case GL_COMPRESSED_RG_RGTC2:
+		colorModel = 132; bytesPlane0 = 16;
+		samples[sampleCount++] = { 0, 63, 0, 0xFFFFFFFFu };
+		samples[sampleCount++] = { 64, 63, 1, 0xFFFFFFFFu };
+		break;
+	case GL_COMPRESSED_RGBA_BPTC_UNORM:
+		colorModel = 134; bytesPlane0 = 16;
+		samples[sampleCount++] = { 0, 127, 0, 0xFFFFFFFFu };
+		break;
+	default:
+	{
+		// RGBSDA, one byte per channel with alpha as channel 15
+		static const uint32_t channels[4] = { 0, 1, 2, 15 };
+		colorModel = 1; bytesPlane0 = components;
+		for (int c = 0; c < components; c++)
+			samples[sampleCount++] = { uint32_t(c * 8), 7, channels[c], 255 };
+		break;
+	}
+	}
+	const bool blocks = format != 0;
+	blockSize = 24 + 16 * sampleCount;
+
+	dfd.clear();
+	dfd.push_back(4 + blockSize);
+	dfd.push_back(0);												// vendor and descriptor type
+	dfd.push_back(2 | (blockSize << 16));							// version 2 and block size
+	dfd.push_back(colorModel | (1u << 8) | (1u << 16));				// model, BT.709 primaries, linear transfer
+	dfd.push_back(blocks ? (3u | (3u << 8)) : 0u);					// texel block dimensions minus one
+	dfd.push_back(bytesPlane0);
+	dfd.push_back(0);
+	for (int i = 0; i < sampleCount; i++)
+	{
+		dfd.push_back(samples[i].bitOffset | (samples[i].bitLength << 16) | (samples[i].channel << 24));
+		dfd.push_back(0);											// sample position
+		dfd.push_back(0);											// lower
+		dfd.push_back(samples[i].upper);
+	}
+}
+
+static void appendKeyValue(std::vector<unsigned char> &kvd, const char *key, const void *value, size_t valueSize)
+{
+	uint32_t length = static_cast<uint32_t>(strlen(key) + 1 + valueSize);
+	const unsigned char *lengthBytes = reinterpret_cast<const unsigned char*>(&length);
+	kvd.insert(kvd.end(), lengthBytes, lengthBytes + sizeof(length));
+	kvd.insert(kvd.end(), key, key + strlen(key) + 1);
+	kvd.insert(kvd.end(), static_cast<const unsigned char*>(value), static_cast<const unsigned char*>(value) + valueSize);
+	while (kvd.size() % 4)
+		kvd.push_back(0);
+}
+
+// finds the cache key in the key/value data of a mapped file
+static bool findCacheKey(const unsigned char *data, size_t size, const Ktx2Header &header, TextureCacheKey &key)
+{
+	if (uint64_t(header.kvdByteOffset) + header.kvdByteLength > size)
+		return false;
+
+	const unsigned char *cursor = data + header.kvdByteOffset;
+	const unsigned char *end = cursor + header.kvdByteLength;
+	const size_t nameSize = sizeof(CACHE_KEY_NAME);
+	while (end - cursor >= 4)
+	{
+		uint32_t length;
+		memcpy(&length, cursor, sizeof(length));
+		cursor += sizeof(length);
+		if (static_cast<size_t>(end - cursor) < length)
+			return false;
+
+		if (length == nameSize + sizeof(key) && memcmp(cursor, CACHE_KEY_NAME, nameSize) == 0)
+		{
+			memcpy(&key, cursor + nameSize, sizeof(key));
+			return true;
+		}
+		cursor += (length + 3) & ~3u;
+	}
+	return false;
+}
+
+static uint32_t fullChainLevels(uint32_t width, uint32_t height)
+{
+	uint32_t levels = 1;
+	while (width > 1 || height > 1)
+	{
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+		levels++;
+	}
+	return levels;
+}
+
+std::string TextureCache::cachePath(const std::string &sourcePath, TextureUsage usage)
+{
+	// usages are cooked differently, so a normal map gets its own file
+	return sourcePath + (usage == TEXTURE_USAGE_NORMAL ? ".normal.ktx2" : ".ktx2");
+}
+
+uint32_t TextureCache::settingsKey()
+{
+	return (TextureLoader::compressTextures ? 1u : 0u) | (GLExtensions::textureCompressionS3TC ? 2u : 0u) | (GLExtensions::textureCompressionBPTC ? 4u : 0u);
+}
+
+bool TextureCache::load(const std::string &sourcePath, TextureUsage usage, DecodedImage &image)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+	if (!file->open(cachePath(sourcePath, usage)))
+		return false;
+	const unsigned char *data = file->data();
+	const size_t size = file->size();
+
+	Ktx2Header header;
+	if (size < sizeof(header))
+		return false;
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0 || header.pixelWidth == 0 || header.pixelHeight == 0 ||
+		header.pixelDepth != 0 || header.layerCount != 0 || header.faceCount != 1 || header.supercompressionScheme != 0 ||
+		header.levelCount != fullChainLevels(header.pixelWidth, header.pixelHeight))
+		return false;
+
+	GLenum format;
+	int components;
+	TextureCacheKey key;
+	if (!glFormatOf(header.vkFormat, format, components) || !findCacheKey(data, size, header, key) ||
+		key.version != VERSION || key.usage != uint32_t(usage) || key.settings != settingsKey() || key.components < 1 || key.components > 4)
+		return false;
+	if (format != 0)
+		components = key.components;
+
+	// the cache is only valid for the exact source content it was cooked from
+	uint64_t sourceHash;
+	if (!hashFile(sourcePath, sourceHash) || sourceHash != key.sourceHash)
+		return false;
+
+	if (sizeof(header) + header.levelCount * sizeof(Ktx2Level) > size)
+		return false;
+	std::vector<MipLevel> levels(header.levelCount);
+	size_t mipBytes = 0;
+	for (uint32_t level = 0; level < header.levelCount; level++)
+	{
+		Ktx2Level entry;
+		memcpy(&entry, data + sizeof(header) + level * sizeof(Ktx2Level), sizeof(entry));
+
+		int width = std::max(int(header.pixelWidth >> level), 1), height = std::max(int(header.pixelHeight >> level), 1);
+		if (entry.byteLength != TextureCompressor::levelSize(format, components, width, height) || entry.byteOffset + entry.byteLength > size)
+			return false;
+
+		MipLevel mip = { width, height, size_t(entry.byteOffset), size_t(entry.byteLength) };
+		levels[level] = mip;
+		mipBytes += mip.size;
+	}
+
+	// the levels are uploaded straight from the mapping, which lives as long as the image data
+	image = DecodedImage();
+	image.width = int(header.pixelWidth);
+	image.height = int(header.pixelHeight);
+	image.components = components;
+	image.usage = usage;
+	image.compressedFormat = format;
+	image.mipData = std::shared_ptr<const unsigned char>(file, data);
+	image.mipBytes = mipBytes;
+	image.levels.swap(levels);
+	image.cached = true;
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	image.decodeSeconds = elapsed.count();
+	return true;
+}
+
+bool TextureCache::store(const std::string &sourcePath, const DecodedImage &image)
+{
+	if (!image.mipData || image.levels.empty())
+		return false;
+
+	TextureCacheKey key = { 0, VERSION, uint32_t(image.usage), settingsKey(), uint32_t(image.components) };
+	if (!hashFile(sourcePath, key.sourceHash))
+		return false;
+
+	std::vector<uint32_t> dfd;
+	describeFormat(image.compressedFormat, image.components, dfd);
+	std::vector<unsigned char> kvd;
+	appendKeyValue(kvd, CACHE_KEY_NAME, &key, sizeof(key));
+	appendKeyValue(kvd, "KTXwriter", WRITER_NAME, sizeof(WRITER_NAME));
+
+	const uint32_t levelCount = static_cast<uint32_t>(image.levels.size());
+	Ktx2Header header;
+	memcpy(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+	header.vkFormat = vkFormatOf(image.compressedFormat, image.components);
+	header.typeSize = 1;
+	header.pixelWidth = image.width;
+	header.pixelHeight = image.height;
+	header.pixelDepth = 0;
+	header.layerCount = 0;
+	header.faceCount = 1;
+	header.levelCount = levelCount;
+	header.supercompressionScheme = 0;
+	header.dfdByteOffset = static_cast<uint32_t>(sizeof(header) + levelCount * sizeof(Ktx2Level));
+	header.dfdByteLength = static_cast<uint32_t>(dfd.size() * sizeof(uint32_t));
+	header.kvdByteOffset = header.dfdByteOffset + header.dfdByteLength;
+	header.kvdByteLength = static_cast<uint32_t>(kvd.size());
+	header.sgdByteOffset = 0;
+	header.sgdByteLength = 0;
+
+	// level data from the smallest level up, aligned to the least common multiple of the texel block size and 4
+	const size_t blockBytes = image.compressedFormat ? TextureCompressor::levelSize(image.compressedFormat, image.components, 1, 1) : size_t(image.components);
+	const size_t alignment = blockBytes % 4 == 0 ? blockBytes : blockBytes * (blockBytes % 2 == 0 ? 2 : 4);
+	std::vector<Ktx2Level> index(levelCount);
+	uint64_t offset = header.kvdByteOffset + header.kvdByteLength;
+	for (uint32_t level = levelCount; level-- > 0;)
+	{
+		offset = (offset + alignment - 1) / alignment * alignment;
+		index[level].byteOffset = offset;
+		index[level].byteLength = image.levels[level].size;
+		index[level].uncompressedByteLength = image.levels[level].size;
+		offset += image.levels[level].size;
+	}
+
+	// write to a temporary file first so a crash never leaves a truncated cache behind
+	std::string path = cachePath(sourcePath, image.usage);
+	std::string tempPath = path + ".tmp";
+	{
+		std::ofstream out(tempPath.c_str(), std::ios::binary | std::ios::trunc);
+		if (!out)
+			return false;
+
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		out.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(Ktx2Level));
+		out.write(reinterpret_cast<const char*>(dfd.data()), dfd.size() * sizeof(uint32_t));
+		out.write(reinterpret_cast<const char*>(kvd.data()), kvd.size());
+
+		uint64_t written = header.kvdByteOffset + header.kvdByteLength;
+		static const char padding[16] = {};
+		for (uint32_t level = levelCount; level-- > 0;)
+		{
+			out.write(padding, size_t(index[level].byteOffset - written));
+			const MipLevel &mip = image.levels[level];
+			out.write(reinterpret_cast<const char*>(image.mipData.get() + mip.offset), mip.size);
+			written = index[level].byteOffset + index[level].byteLength;
+		}
+
+		if (!out)
+			return false;
+	}
+
+	std::remove(path.c_str());
+	return std::rename(tempPath.c_str(), path.c_str()) == 0;
+}
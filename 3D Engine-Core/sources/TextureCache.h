@@ -0,0 +1,28 @@
+#pragma once
+
+#include "TextureLoader.h"
+
+#include <cstdint>
+#include <string>
+
+// Cooked copy of a texture with its full mip chain, stored as a KTX2 file next to the source image.
+// The file is keyed by the source content hash, the usage and the settings the chain was built with,
+// so a warm load is a memory map whose levels are uploaded in place, without decoding or mip generation.
+class TextureCache
+{
+public:
+	// fills image with the cooked chain of sourcePath, returns false on a miss or a stale cache.
+	// The image keeps the cache file mapped until its last copy is gone.
+	static bool load(const std::string &sourcePath, TextureUsage usage, DecodedImage &image);
+
+	// writes the cooked chain of image, returns false if the file cannot be written
+	static bool store(const std::string &sourcePath, const DecodedImage &image);
+
+	static std::string cachePath(const std::string &sourcePath, TextureUsage usage);
+
+	// bumped whenever the encoders change their output
+	static const uint32_t VERSION = 1;
+
+	// compression setting and supported extensions the chain depends on
+	static uint32_t settingsKey();
+};
@@ -0,0 +1,594 @@
+#include "TextureCompressor.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEXTURE_COMPRESSOR_SSE2
+#include <emmintrin.h>
+#endif
+
+// interpolation weights of the 4 bit BC7 indices, out of 64
+static const int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// index of the nearest palette color for each of the 16 pixels, all four channels weighted equally
+static void nearestIndices(const unsigned char pixels[64], const unsigned char palette[][4], int paletteSize, unsigned char indices[16])
+{
+#ifdef TEXTURE_COMPRESSOR_SSE2
+	// four pixels per step: squared distances of two pixels per madd, summed per pixel with a shuffle
+	const __m128i zero = _mm_setzero_si128();
+	for (int group = 0; group < 4; group++)
+	{
+		__m128i source = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + group * 16));
+		__m128i low = _mm_unpacklo_epi8(source, zero);
+		__m128i high = _mm_unpackhi_epi8(source, zero);
+
+		__m128i bestDistance = _mm_set1_epi32(0x7fffffff);
+		__m128i bestIndex = _mm_setzero_si128();
+		for (int i = 0; i < paletteSize; i++)
+		{
+			__m128i color = _mm_set_epi16(palette[i][3], palette[i][2], palette[i][1], palette[i][0], palette[i][3], palette[i][2], palette[i][1], palette[i][0]);
+			__m128i dLow = _mm_sub_epi16(low, color);
+			__m128i dHigh = _mm_sub_epi16(high, color);
+			__m128 sLow = _mm_castsi128_ps(_mm_madd_epi16(dLow, dLow));
+			__m128 sHigh = _mm_castsi128_ps(_mm_madd_epi16(dHigh, dHigh));
+			__m128i distance = _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(sLow, sHigh, _MM_SHUFFLE(2, 0, 2, 0))),
+				_mm_castps_si128(_mm_shuffle_ps(sLow, sHigh, _MM_SHUFFLE(3, 1, 3, 1))));
+
+			__m128i closer = _mm_cmplt_epi32(distance, bestDistance);
+			bestDistance = _mm_or_si128(_mm_and_si128(closer, distance), _mm_andnot_si128(closer, bestDistance));
+			bestIndex = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(i)), _mm_andnot_si128(closer, bestIndex));
+		}
+
+		int32_t result[4];
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(result), bestIndex);
+		for (int k = 0; k < 4; k++)
+			indices[group * 4 + k] = static_cast<unsigned char>(result[k]);
+	}
+#else
+	for (int p = 0; p < 16; p++)
+	{
+		int bestDistance = 0x7fffffff, best = 0;
+		for (int i = 0; i < paletteSize; i++)
+		{
+			int distance = 0;
+			for (int c = 0; c < 4; c++)
+			{
+				int d = pixels[p * 4 + c] - palette[i][c];
+				distance += d * d;
+			}
+			if (distance < bestDistance)
+			{
+				bestDistance = distance;
+				best = i;
+			}
+		}
+		indices[p] = static_cast<unsigned char>(best);
+	}
+#endif
+}
+
+static int paletteError(const unsigned char pixels[64], const unsigned char palette[][4], const unsigned char indices[16])
+{
+	int error = 0;
+	for (int p = 0; p < 16; p++)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			int d = pixels[p * 4 + c] - palette[indices[p]][c];
+			error += d * d;
+		}
+	}
+	return error;
+}
+
+// mean and main axis of the colors of a block over the first channels components
+static void principalAxis(const unsigned char pixels[64], int channels, float mean[4], float axis[4])
+{
+	for (int c = 0; c < 4; c++)
+	{
+		mean[c] = 0.0f;
+		axis[c] = 0.0f;
+	}
+	for (int p = 0; p < 16; p++)
+		for (int c = 0; c < channels; c++)
+			mean[c] += pixels[p * 4 + c];
+	for (int c = 0; c < channels; c++)
+		mean[c] /= 16.0f;
+
+	float covariance[4][4] = {};
+	for (int p = 0; p < 16; p++)
+	{
+		for (int a = 0; a < channels; a++)
+		{
+			float da = pixels[p * 4 + a] - mean[a];
+			for (int b = 0; b < channels; b++)
+				covariance[a][b] += da * (pixels[p * 4 + b] - mean[b]);
+		}
+	}
+
+	// power iteration, started on the diagonal so it cannot begin orthogonal to a gray ramp
+	float vector[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	for (int iteration = 0; iteration < 8; iteration++)
+	{
+		float next[4] = {};
+		float largest = 0.0f;
+		for (int a = 0; a < channels; a++)
+		{
+			for (int b = 0; b < channels; b++)
+				next[a] += covariance[a][b] * vector[b];
+			largest = std::max(largest, std::fabs(next[a]));
+		}
+		if (largest == 0.0f)
+			break;
+		for (int a = 0; a < channels; a++)
+			vector[a] = next[a] / largest;
+	}
+
+	float length = 0.0f;
+	for (int c = 0; c < channels; c++)
+		length += vector[c] * vector[c];
+	length = std::sqrt(length);
+	for (int c = 0; c < channels; c++)
+		axis[c] = length > 0.0f ? vector[c] / length : 0.0f;
+}
+
+// ends of the block colors projected on their main axis
+static void axisEndpoints(const unsigned char pixels[64], int channels, float low[4], float high[4])
+{
+	float mean[4], axis[4];
+	principalAxis(pixels, channels, mean, axis);
+
+	float minT = 0.0f, maxT = 0.0f;
+	for (int p = 0; p < 16; p++)
+	{
+		float t = 0.0f;
+		for (int c = 0; c < channels; c++)
+			t += (pixels[p * 4 + c] - mean[c]) * axis[c];
+		minT = std::min(minT, t);
+		maxT = std::max(maxT, t);
+	}
+	for (int c = 0; c < 4; c++)
+	{
+		low[c] = std::min(std::max(mean[c] + axis[c] * minT, 0.0f), 255.0f);
+		high[c] = std::min(std::max(mean[c] + axis[c] * maxT, 0.0f), 255.0f);
+	}
+}
+
+static inline uint16_t packRGB565(const float color[3])
+{
+	int r = static_cast<int>(color[0] * 31.0f / 255.0f + 0.5f);
+	int g = static_cast<int>(color[1] * 63.0f / 255.0f + 0.5f);
+	int b = static_cast<int>(color[2] * 31.0f / 255.0f + 0.5f);
+	return static_cast<uint16_t>((std::min(r, 31) << 11) | (std::min(g, 63) << 5) | std::min(b, 31));
+}
+
+static inline void unpackRGB565(uint16_t color, unsigned char rgba[4])
+{
+	int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+	rgba[0] = static_cast<unsigned char>((r << 3) | (r >> 2));
+	rgba[1] = static_cast<unsigned char>((g << 2) | (g >> 4));
+	rgba[2] = static_cast<unsigned char>((b << 3) | (b >> 2));
+	rgba[3] = 0;
+}
+
+// four color BC1 palette of two endpoints, c0 > c1
+static void paletteBC1(uint16_t c0, uint16_t c1, unsigned char palette[4][4])
+{
+	unpackRGB565(c0, palette[0]);
+	unpackRGB565(c1, palette[1]);
+	for (int c = 0; c < 4; c++)
+	{
+		palette[2][c] = static_cast<unsigned char>((2 * palette[0][c] + palette[1][c]) / 3);
+		palette[3][c] = static_cast<unsigned char>((palette[0][c] + 2 * palette[1][c]) / 3);
+	}
+}
+
+// color block with the best of the axis endpoints and one least squares refit, always in four color mode
+static void encodeColorBlock(const unsigned char pixels[64], unsigned char block[8])
+{
+	// alpha does not take part in the color search
+	unsigned char colors[64];
+	for (int p = 0; p < 16; p++)
+	{
+		memcpy(colors + p * 4, pixels + p * 4, 3);
+		colors[p * 4 + 3] = 0;
+	}
+
+	float low[4], high[4];
+	axisEndpoints(colors, 3, low, high);
+	// pull the ends in a little, the extremes are rarely worth exact representation
+	for (int c = 0; c < 3; c++)
+	{
+		float inset = (high[c] - low[c]) / 16.0f;
+		low[c] += inset;
+		high[c] -= inset;
+	}
+
+	uint16_t c0 = packRGB565(high), c1 = packRGB565(low);
+	unsigned char indices[16] = {};
+	unsigned char palette[4][4];
+	int error = 0x7fffffff;
+	if (c0 != c1)
+	{
+		if (c0 < c1)
+			std::swap(c0, c1);
+		paletteBC1(c0, c1, palette);
+		nearestIndices(colors, palette, 4, indices);
+		error = paletteError(colors, palette, indices);
+
+		// least squares endpoints for the chosen indices: pixel = a * e0 + b * e1
+		static const float weight0[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+		float aa = 0.0f, ab = 0.0f, bb = 0.0f, ax[3] = {}, bx[3] = {};
+		for (int p = 0; p < 16; p++)
+		{
+			float a = weight0[indices[p]], b = 1.0f - a;
+			aa += a * a;
+			ab += a * b;
+			bb += b * b;
+			for (int c = 0; c < 3; c++)
+			{
+				ax[c] += a * colors[p * 4 + c];
+				bx[c] += b * colors[p * 4 + c];
+			}
+		}
+		float determinant = aa * bb - ab * ab;
+		if (std::fabs(determinant) > 1e-6f)
+		{
+			float e0[3], e1[3];
+			for (int c = 0; c < 3; c++)
+			{
+				e0[c] = std::min(std::max((ax[c] * bb - bx[c] * ab) / determinant, 0.0f), 255.0f);
+				e1[c] = std::min(std::max((bx[c] * aa - ax[c] * ab) / determinant, 0.0f), 255.0f);
+			}
+			uint16_t r0 = packRGB565(e0), r1 = packRGB565(e1);
+			if (r0 < r1)
+				std::swap(r0, r1);
+			if (r0 != r1)
+			{
+				unsigned char refitPalette[4][4], refitIndices[16];
+				paletteBC1(r0, r1, refitPalette);
+				nearestIndices(colors, refitPalette, 4, refitIndices);
+				int refitError = paletteError(colors, refitPalette, refitIndices);
+				if (refitError < error)
+				{
+					c0 = r0;
+					c1 = r1;
+					memcpy(indices, refitIndices, 16);
+				}
+			}
+		}
+	}
+
+	uint32_t bits = 0;
+	for (int p = 0; p < 16; p++)
+		bits |= static_cast<uint32_t>(indices[p]) << (p * 2);
+
+	block[0] = static_cast<unsigned char>(c0);
+	block[1] = static_cast<unsigned char>(c0 >> 8);
+	block[2] = static_cast<unsigned char>(c1);
+	block[3] = static_cast<unsigned char>(c1 >> 8);
+	for (int i = 0; i < 4; i++)
+		block[4 + i] = static_cast<unsigned char>(bits >> (i * 8));
+}
+
+void TextureCompressor::encodeBC1(const unsigned char pixels[64], unsigned char block[8])
+{
+	encodeColorBlock(pixels, block);
+}
+
+void TextureCompressor::encodeBC3(const unsigned char pixels[64], unsigned char block[16])
+{
+	encodeBC4(pixels, 3, block);
+	encodeColorBlock(pixels, block + 8);
+}
+
+void TextureCompressor::encodeBC4(const unsigned char pixels[64], int channel, unsigned char block[8])
+{
+	int low = 255, high = 0;
+	for (int p = 0; p < 16; p++)
+	{
+		low = std::min(low, int(pixels[p * 4 + channel]));
+		high = std::max(high, int(pixels[p * 4 + channel]));
+	}
+
+	// eight value mode: index 0 is high, 1 is low and 2..7 step from high to low
+	uint64_t bits = 0;
+	if (high > low)
+	{
+		for (int p = 0; p < 16; p++)
+		{
+			int step = ((high - pixels[p * 4 + channel]) * 14 + (high - low)) / (2 * (high - low));
+			uint64_t index = step == 0 ? 0 : step == 7 ? 1 : step + 1;
+			bits |= index << (p * 3);
+		}
+	}
+
+	block[0] = static_cast<unsigned char>(high);
+	block[1] = static_cast<unsigned char>(low);
+	for (int i = 0; i < 6; i++)
+		block[2 + i] = static_cast<unsigned char>(bits >> (i * 8));
+}
+
+void TextureCompressor::encodeBC5(const unsigned char pixels[64], unsigned char block[16])
+{
+	encodeBC4(pixels, 0, block);
+	encodeBC4(pixels, 1, block + 8);
+}
+
+// appends count bits of value to a 128 bit block, lowest bit first
+static inline void writeBits(unsigned char block[16], int &position, uint32_t value, int count)
+{
+	for (int i = 0; i < count; i++, position++)
+	{
+		if (value & (1u << i))
+			block[position >> 3] |= static_cast<unsigned char>(1u << (position & 7));
+	}
+}
+
+// 7 bit endpoint and p-bit closest to an 8 bit color
+static void quantizeBC7(const float color[4], unsigned char endpoint[4], int &pBit)
+{
+	int bestError = 0x7fffffff;
+	for (int p = 0; p < 2; p++)
+	{
+		unsigned char candidate[4];
+		int error = 0;
+		for (int c = 0; c < 4; c++)
+		{
+			int q = static_cast<int>((color[c] - p) / 2.0f + 0.5f);
+			candidate[c] = static_cast<unsigned char>(std::min(std::max(q, 0), 127));
+			int d = ((candidate[c] << 1) | p) - static_cast<int>(color[c] + 0.5f);
+			error += d * d;
+		}
+		if (error < bestError)
+		{
+			bestError = error;
+			pBit = p;
+			memcpy(endpoint, candidate, 4);
+		}
+	}
+}
+
+void TextureCompressor::encodeBC7(const unsigned char pixels[64], unsigned char block[16])
+{
+	float low[4], high[4];
+	axisEndpoints(pixels, 4, low, high);
+
+	unsigned char endpoints[2][4];
+	int pBits[2];
+	quantizeBC7(low, endpoints[0], pBits[0]);
+	quantizeBC7(high, endpoints[1], pBits[1]);
+
+	unsigned char palette[16][4];
+	for (int c = 0; c < 4; c++)
+	{
+		int e0 = (endpoints[0][c] << 1) | pBits[0];
+		int e1 = (endpoints[1][c] << 1) | pBits[1];
+		for (int i = 0; i < 16; i++)
+			palette[i][c] = static_cast<unsigned char>(((64 - BC7_WEIGHTS[i]) * e0 + BC7_WEIGHTS[i] * e1 + 32) >> 6);
+	}
+	unsigned char indices[16];
+	nearestIndices(pixels, palette, 16, indices);
+
+	// the first index is stored without its top bit, which swapping the endpoints clears
+	if (indices[0] & 8)
+	{
+		for (int c = 0; c < 4; c++)
+			std::swap(endpoints[0][c], endpoints[1][c]);
+		std::swap(pBits[0], pBits[1]);
+		for (int p = 0; p < 16; p++)
+			indices[p] = static_cast<unsigned char>(15 - indices[p]);
+	}
+
+	memset(block, 0, 16);
+	int position = 0;
+	writeBits(block, position, 1u << 6, 7);
+	for (int c = 0; c < 4; c++)
+	{
+		writeBits(block, position, endpoints[0][c], 7);
+		writeBits(block, position, endpoints[1][c], 7);
+	}
+	writeBits(block, position, pBits[0], 1);
+	writeBits(block, position, pBits[1], 1);
+	writeBits(block, position, indices[0], 3);
+	for (int p = 1; p < 16; p++)
+		writeBits(block, position, indices[p], 4);
+}
+
+GLenum TextureCompressor::formatFor(const DecodedImage &image)
+{
+	if (image.components <= 2)
+		return image.components == 1 ? GL_COMPRESSED_RED_RGTC1 : GL_COMPRESSED_RG_RGTC2;
+	if (image.usage == TEXTURE_USAGE_NORMAL)
+		return GL_COMPRESSED_RG_RGTC2;
+
+	bool opaque = true;
+	if (image.components == 4)
+	{
+		const unsigned char *pixels = image.pixels.get();
+		size_t count = size_t(image.width) * image.height;
+		for (size_t i = 0; i < count && opaque; i++)
+			opaque = pixels[i * 4 + 3] == 255;
+	}
+
+	if (opaque)
+		return GLExtensions::textureCompressionS3TC ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : 0;
+	if (GLExtensions::textureCompressionBPTC)
+		return GL_COMPRESSED_RGBA_BPTC_UNORM;
+	return GLExtensions::textureCompressionS3TC ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : 0;
+}
+
+const char* TextureCompressor::formatName(GLenum format)
+{
+	switch (format)
+	{
+	case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: return "BC1";
+	case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: return "BC3";
+	case GL_COMPRESSED_RED_RGTC1: return "BC4";
+	case GL_COMPRESSED_RG_RGTC2: return "BC5";
+	case GL_COMPRESSED_RGBA_BPTC_UNORM: return "BC7";
+	}
+	return "uncompressed";
+}
+
+size_t TextureCompressor::uncompressedSize(const DecodedImage &image)
+{
+	// a full mip chain adds a third
+	return size_t(image.width) * image.height * image.components * 4 / 3;
+}
+
+// box filtered half size level of an RGBA image, odd edges repeat their last texel
+static void downsample(const std::vector<unsigned char> &source, int width, int height, bool normals, std::vector<unsigned char> &result, int &resultWidth, int &resultHeight)
+{
+	resultWidth = std::max(width / 2, 1);
+	resultHeight = std::max(height / 2, 1);
+	result.resize(size_t(resultWidth) * resultHeight * 4);
+	for (int y = 0; y < resultHeight; y++)
+	{
+		for (int x = 0; x < resultWidth; x++)
+		{
+			int x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+			int y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+			unsigned char *target = &result[(size_t(y) * resultWidth + x) * 4];
+			float sum[4];
+			for (int c = 0; c < 4; c++)
+			{
+				sum[c] = float(source[(size_t(y0) * width + x0) * 4 + c]) + source[(size_t(y0) * width + x1) * 4 + c]
+					+ source[(size_t(y1) * width + x0) * 4 + c] + source[(size_t(y1) * width + x1) * 4 + c];
+				sum[c] *= 0.25f;
+			}
+
+			// averaged normals get shorter, put them back on the unit sphere
+			if (normals)
+			{
+				float n[3], length = 0.0f;
+				for (int c = 0; c < 3; c++)
+				{
+					n[c] = sum[c] / 127.5f - 1.0f;
+					length += n[c] * n[c];
+				}
+				length = std::sqrt(length);
+				if (length > 0.0f)
+					for (int c = 0; c < 3; c++)
+						sum[c] = (n[c] / length + 1.0f) * 127.5f;
+			}
+
+			for (int c = 0; c < 4; c++)
+				target[c] = static_cast<unsigned char>(std::min(std::max(sum[c] + 0.5f, 0.0f), 255.0f));
+		}
+	}
+}
+
+size_t TextureCompressor::levelSize(GLenum format, int components, int width, int height)
+{
+	if (format == 0)
+		return size_t(width) * height * components;
+	const size_t blockBytes = (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || format == GL_COMPRESSED_RED_RGTC1) ? 8 : 16;
+	return size_t((width + 3) / 4) * ((height + 3) / 4) * blockBytes;
+}
+
+// replaces the pixels of image with its full mip chain in format, 0 keeping the pixels uncompressed
+static void buildMipChain(DecodedImage &image, GLenum format)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	// RGBA working copy, missing components are 0 and alpha is opaque
+	int width = image.width, height = image.height;
+	const int components = image.components;
+	std::vector<unsigned char> level(size_t(width) * height * 4);
+	const unsigned char *source = image.pixels.get();
+	for (size_t i = 0; i < size_t(width) * height; i++)
+	{
+		unsigned char *target = &level[i * 4];
+		target[0] = target[1] = target[2] = 0;
+		target[3] = 255;
+		for (int c = 0; c < components; c++)
+			target[c] = source[i * components + c];
+	}
+
+	std::shared_ptr<std::vector<unsigned char>> chain = std::make_shared<std::vector<unsigned char>>();
+	std::vector<MipLevel> levels;
+	const bool normals = image.usage == TEXTURE_USAGE_NORMAL;
+
+	for (;;)
+	{
+		MipLevel mip = { width, height, chain->size(), TextureCompressor::levelSize(format, components, width, height) };
+		chain->resize(mip.offset + mip.size);
+		levels.push_back(mip);
+		unsigned char *output = chain->data() + mip.offset;
+
+		if (format == 0)
+		{
+			for (size_t i = 0; i < size_t(width) * height; i++)
+				memcpy(output + i * components, &level[i * 4], components);
+		}
+		else
+		{
+			const int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+			const size_t blockBytes = mip.size / (size_t(blocksX) * blocksY);
+			ThreadPool::shared().parallelFor(size_t(blocksY), [&](size_t by)
+			{
+				unsigned char pixels[64];
+				for (int bx = 0; bx < blocksX; bx++)
+				{
+					// blocks over the edge repeat the last row and column
+					for (int y = 0; y < 4; y++)
+					{
+						int sy = std::min(int(by) * 4 + y, height - 1);
+						for (int x = 0; x < 4; x++)
+						{
+							int sx = std::min(bx * 4 + x, width - 1);
+							memcpy(pixels + (y * 4 + x) * 4, &level[(size_t(sy) * width + sx) * 4], 4);
+						}
+					}
+
+					unsigned char *block = output + (by * blocksX + bx) * blockBytes;
+					switch (format)
+					{
+					case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: TextureCompressor::encodeBC1(pixels, block); break;
+					case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: TextureCompressor::encodeBC3(pixels, block); break;
+					case GL_COMPRESSED_RED_RGTC1: TextureCompressor::encodeBC4(pixels, 0, block); break;
+					case GL_COMPRESSED_RG_RGTC2: TextureCompressor::encodeBC5(pixels, block); break;
+					case GL_COMPRESSED_RGBA_BPTC_UNORM: TextureCompressor::encodeBC7(pixels, block); break;
+					}
+				}
+			});
+		}
+
+		if (width == 1 && height == 1)
+			break;
+		std::vector<unsigned char> next;
+		downsample(level, width, height, normals, next, width, height);
+		level.swap(next);
+	}
+
+	image.compressedFormat = format;
+	image.mipBytes = chain->size();
+	image.mipData = std::shared_ptr<const unsigned char>(chain, chain->data());
+	image.levels.swap(levels);
+	image.pixels.reset();
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	image.encodeSeconds = elapsed.count();
+}
+
+bool TextureCompressor::compress(DecodedImage &image)
+{
+	GLenum format = formatFor(image);
+	if (!image.pixels || format == 0)
+		return false;
+
+	buildMipChain(image, format);
+	return true;
+}
+
+void TextureCompressor::generateMips(DecodedImage &image)
+{
+	if (image.pixels)
+		buildMipChain(image, 0);
+}
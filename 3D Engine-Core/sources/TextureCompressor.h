@@ -0,0 +1,38 @@
+#pragma once
+
+#include "GLExtensions.h"
+#include "TextureLoader.h"
+
+// CPU encoder for the block compressed texture formats, run at import on the worker threads.
+// Color maps become BC1 when opaque and BC7 (or BC3 without BPTC) with alpha, one channel maps BC4 and
+// two channel and normal maps BC5. Normal maps keep only x and y, so a shader sampling them
+// reconstructs z = sqrt(1 - x * x - y * y). Formats the context does not support stay uncompressed.
+class TextureCompressor
+{
+public:
+	// format image would be encoded in with the extensions of the context, 0 to keep it uncompressed
+	static GLenum formatFor(const DecodedImage &image);
+
+	// encodes the full mip chain of a decoded image and drops its pixels. Block rows are encoded in parallel.
+	// Returns false and leaves the image as is when formatFor gives no format.
+	static bool compress(DecodedImage &image);
+
+	// builds the uncompressed mip chain of a decoded image with the same filter and drops its pixels
+	static void generateMips(DecodedImage &image);
+
+	// bytes of one level in format, 0 for tightly packed pixels of components bytes
+	static size_t levelSize(GLenum format, int components, int width, int height);
+
+	// bytes of the image with a mip chain when uploaded uncompressed
+	static size_t uncompressedSize(const DecodedImage &image);
+
+	static const char* formatName(GLenum format);
+
+	// 4x4 block encoders on RGBA pixels in row order. channel selects the component BC4 encodes.
+	static void encodeBC1(const unsigned char pixels[64], unsigned char block[8]);
+	static void encodeBC3(const unsigned char pixels[64], unsigned char block[16]);
+	static void encodeBC4(const unsigned char pixels[64], int channel, unsigned char block[8]);
+	static void encodeBC5(const unsigned char pixels[64], unsigned char block[16]);
+	// BC7 in mode 6: one subset of 7 bit RGBA endpoints with a p-bit each and 4 bit indices
+	static void encodeBC7(const unsigned char pixels[64], unsigned char block[16]);
+};
@@ -0,0 +1,164 @@
+#include "TextureLoader.h"
+#include "GLState.h"
+#include "TextureCache.h"
+#include "TextureCompressor.h"
+#include "ThreadPool.h"
+#include <stb_image.h>
+
+#include <chrono>
+#include <iostream>
+
+bool TextureLoader::compressTextures = true;
+
+DecodedImage TextureLoader::decode(const std::string &filename)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	DecodedImage image;
+	unsigned char *data = stbi_load(filename.c_str(), &image.width, &image.height, &image.components, 0);
+	if(data)
+		image.pixels = std::shared_ptr<unsigned char>(data, stbi_image_free);
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	image.decodeSeconds = elapsed.count();
+	return image;
+}
+
+DecodedImage TextureLoader::prepare(const std::string &filename, TextureUsage usage)
+{
+	DecodedImage image;
+	if(TextureCache::load(filename, usage, image))
+		return image;
+
+	image = decode(filename);
+	image.usage = usage;
+	if(!image.valid())
+		return image;
+
+	// the cache holds the full chain, so nothing is left for glGenerateMipmap at upload
+	if(!compressTextures || !TextureCompressor::compress(image))
+		TextureCompressor::generateMips(image);
+	if(!TextureCache::store(filename, image))
+		std::cout << "WARNING::TEXTURE_CACHE:: could not write " << TextureCache::cachePath(filename, usage) << std::endl;
+	return image;
+}
+
+std::map<std::string, DecodedImage> TextureLoader::decodeAll(const std::string &directory, const std::map<std::string, TextureUsage> &textures,
+	std::atomic<unsigned int> *decodedCount, const std::atomic<bool> *cancel)
+{
+	std::vector<std::pair<std::string, TextureUsage>> items(textures.begin(), textures.end());
+
+	// every image goes to its own job, so a model's textures are all in flight at the same time
+	std::vector<DecodedImage> images(items.size());
+	ThreadPool::shared().parallelFor(items.size(), [&](size_t i)
+	{
+		if(cancel && cancel->load())
+			return;
+
+		images[i] = prepare(directory + '/' + items[i].first, items[i].second);
+		if(decodedCount)
+			(*decodedCount)++;
+	});
+
+	std::map<std::string, DecodedImage> decoded;
+	for(size_t i = 0; i < items.size(); i++)
+		decoded[items[i].first] = images[i];
+	return decoded;
+}
+
+TextureUsage TextureLoader::usageOf(const std::string &type)
+{
+	return type == "texture_normal" ? TEXTURE_USAGE_NORMAL : TEXTURE_USAGE_COLOR;
+}
+
+void TextureLoader::reportTiming(const std::string &path, const DecodedImage &image, double uploadSeconds)
+{
+	std::cout << "TEXTURE:: " << path << " (" << image.width << "x" << image.height << "x" << image.components << ")"
+		<< (image.cached ? " cache load " : " decode ") << image.decodeSeconds * 1000.0 << " ms";
+	if(image.compressedFormat)
+	{
+		std::cout << ", " << TextureCompressor::formatName(image.compressedFormat);
+		if(!image.cached)
+			std::cout << " encode " << image.encodeSeconds * 1000.0 << " ms";
+		std::cout << ", " << TextureCompressor::uncompressedSize(image) / 1024 << " KB -> " << image.mipBytes / 1024 << " KB";
+	}
+	std::cout << ", upload " << uploadSeconds * 1000.0 << " ms" << std::endl;
+}
+
+GLenum TextureLoader::formatOf(int components)
+{
+	if(components == 1)
+		return GL_RED;
+	else if(components == 2)
+		return GL_RG;
+	else if(components == 3)
+		return GL_RGB;
+	return GL_RGBA;
+}
+
+unsigned int TextureLoader::upload(const DecodedImage &image)
+{
+	unsigned int textureID;
+	glGenTextures(1, &textureID);
+
+	if(image.mipData)
+	{
+		// the whole chain is cooked, glGenerateMipmap is not needed (and cannot work on compressed formats)
+		GLState::bindTexture(GL_TEXTURE_2D, textureID);
+		uploadLevels(GL_TEXTURE_2D, image);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)image.levels.size() - 1);
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	}
+	else if(image.valid())
+	{
+		GLenum format = formatOf(image.components);
+
+		GLState::bindTexture(GL_TEXTURE_2D, textureID);
+		// rows of 1 and 3 component images are not 4 byte aligned
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels.get());
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glGenerateMipmap(GL_TEXTURE_2D);
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	}
+
+	return textureID;
+}
+
+void TextureLoader::uploadLevel(GLenum target, const DecodedImage &image, size_t level)
+{
+	const MipLevel &mip = image.levels[level];
+	if(image.compressedFormat)
+	{
+		glCompressedTexImage2D(target, (GLint)level, image.compressedFormat, mip.width, mip.height, 0, (GLsizei)mip.size, image.mipData.get() + mip.offset);
+		return;
+	}
+
+	// rows of 1 and 3 component levels are not 4 byte aligned
+	const GLenum format = formatOf(image.components);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(target, (GLint)level, format, mip.width, mip.height, 0, format, GL_UNSIGNED_BYTE, image.mipData.get() + mip.offset);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+void TextureLoader::uploadLevels(GLenum target, const DecodedImage &image)
+{
+	for(size_t level = 0; level < image.levels.size(); level++)
+		uploadLevel(target, image, level);
+}
+
+void TextureLoader::uploadCubeFace(unsigned int face, const DecodedImage &image)
+{
+	if(image.mipData)
+		uploadLevels(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, image);
+	else
+		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGB, image.width, image.height, 0, GL_RGB, GL_UNSIGNED_BYTE, image.pixels.get());
+}
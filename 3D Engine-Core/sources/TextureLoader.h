@@ -0,0 +1,94 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// what a material texture holds, which decides its block compression format
+enum TextureUsage
+{
+	TEXTURE_USAGE_COLOR,
+	TEXTURE_USAGE_NORMAL
+};
+
+// one level of a mip chain, offset and size in bytes within the chain data
+struct MipLevel
+{
+	int width;
+	int height;
+	size_t offset;
+	size_t size;
+};
+
+// pixels decoded from an image file. The buffer is shared so a decoded image can be handed from a worker thread to the GL thread.
+// A cooked image carries its whole mip chain in mipData instead of pixels, which may point into a mapped cache file.
+struct DecodedImage
+{
+	std::shared_ptr<unsigned char> pixels;
+	int width;
+	int height;
+	int components;
+	TextureUsage usage;
+	// wall time spent in the decoder, reported with the upload time once the texture is created
+	double decodeSeconds;
+
+	// block format of the mip chain, 0 for tightly packed pixels of components bytes
+	GLenum compressedFormat;
+	std::shared_ptr<const unsigned char> mipData;
+	size_t mipBytes;
+	std::vector<MipLevel> levels;
+	// wall time spent building the mip chain, 0 when it came from the texture cache
+	double encodeSeconds;
+	bool cached;
+
+	DecodedImage() : width(0), height(0), components(0), usage(TEXTURE_USAGE_COLOR), decodeSeconds(0.0),
+		compressedFormat(0), mipBytes(0), encodeSeconds(0.0), cached(false) {}
+
+	bool valid() const { return this->pixels != nullptr || this->mipData != nullptr; }
+};
+
+// Splits texture loading in a CPU decode step, safe on any thread, and a GL upload step for the context thread.
+class TextureLoader
+{
+public:
+	// block compress material textures with the TextureCompressor before they are uploaded
+	static bool compressTextures;
+
+	// decodes a JPG/PNG/TGA file with stb_image, returns an invalid image on failure
+	static DecodedImage decode(const std::string &filename);
+
+	// cooked mip chain of a texture for its usage: from the TextureCache when it is current, otherwise decoded,
+	// block compressed with compressTextures (or mipmapped uncompressed) and written to the cache
+	static DecodedImage prepare(const std::string &filename, TextureUsage usage);
+
+	// prepares all images of a model at once on the worker pool, keyed by their path relative to directory.
+	// decodedCount is advanced as images finish, setting *cancel skips the images not started yet.
+	static std::map<std::string, DecodedImage> decodeAll(const std::string &directory, const std::map<std::string, TextureUsage> &textures,
+		std::atomic<unsigned int> *decodedCount = nullptr, const std::atomic<bool> *cancel = nullptr);
+
+	// creates a repeating, mipmapped 2D texture. An invalid image still gets a texture name, like a failed load always did.
+	static unsigned int upload(const DecodedImage &image);
+
+	// usage of a material texture from its sampler type name
+	static TextureUsage usageOf(const std::string &type);
+
+	// specifies one face of the currently bound cube map
+	static void uploadCubeFace(unsigned int face, const DecodedImage &image);
+
+	// prints the decode/upload breakdown of one texture
+	static void reportTiming(const std::string &path, const DecodedImage &image, double uploadSeconds);
+
+	// GL pixel format matching a component count
+	static GLenum formatOf(int components);
+
+	// specifies one level of a cooked image on target
+	static void uploadLevel(GLenum target, const DecodedImage &image, size_t level);
+
+private:
+	// specifies every level of a cooked image on target
+	static void uploadLevels(GLenum target, const DecodedImage &image);
+};
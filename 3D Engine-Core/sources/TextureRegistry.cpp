@@ -0,0 +1,122 @@
+#include "TextureRegistry.h"
+#include "GLState.h"
+#include "FileUtils.h"
+#include "TextureStreamer.h"
+
+#include <chrono>
+#include <iostream>
+
+TextureRegistry& TextureRegistry::shared()
+{
+	static TextureRegistry registry;
+	return registry;
+}
+
+bool TextureRegistry::identify(const std::string &filename, TextureUsage usage, uint64_t &hash)
+{
+	std::string canonical = canonicalPath(filename);
+
+	int64_t mtime, size;
+	if (!fileStamp(canonical, mtime, size))
+		return false;
+
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		std::unordered_map<std::string, Identity>::const_iterator known = this->identities.find(canonical);
+		if (known != this->identities.end() && known->second.mtime == mtime && known->second.size == size)
+		{
+			hash = usage == TEXTURE_USAGE_COLOR ? known->second.hash : hashBytes(&usage, sizeof(usage), known->second.hash);
+			return true;
+		}
+	}
+
+	// unknown or modified file, hash its content outside the lock
+	uint64_t content;
+	if (!hashFile(canonical, content))
+		return false;
+
+	Identity identity = { mtime, size, content };
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->identities[canonical] = identity;
+	}
+	hash = usage == TEXTURE_USAGE_COLOR ? content : hashBytes(&usage, sizeof(usage), content);
+	return true;
+}
+
+bool TextureRegistry::contains(const std::string &filename, TextureUsage usage)
+{
+	uint64_t hash;
+	if (!identify(filename, usage, hash))
+		return false;
+
+	std::lock_guard<std::mutex> lock(this->mutex);
+	return this->byHash.count(hash) != 0;
+}
+
+unsigned int TextureRegistry::acquire(const std::string &filename, TextureUsage usage, const DecodedImage *decoded)
+{
+	uint64_t hash = 0;
+	bool hashed = identify(filename, usage, hash);
+
+	if (hashed)
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		std::unordered_map<uint64_t, unsigned int>::const_iterator resident = this->byHash.find(hash);
+		if (resident != this->byHash.end())
+		{
+			this->entries[resident->second].refs++;
+			return resident->second;
+		}
+	}
+
+	DecodedImage image = decoded ? *decoded : TextureLoader::prepare(filename, usage);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	// cooked chains start with their small levels and stream the rest as the view needs them
+	unsigned int id = TextureStreamer::enabled && image.mipData ? TextureStreamer::shared().create(image) : TextureLoader::upload(image);
+	std::chrono::duration<double> uploadTime = std::chrono::steady_clock::now() - start;
+
+	if (image.valid())
+		TextureLoader::reportTiming(filename, image, uploadTime.count());
+	else
+		std::cout << "Texture failed to load at path: " << filename << std::endl;
+
+	// a failed load still owns its texture name, it is just never shared
+	Entry entry = { 1, hashed && image.valid(), hash };
+	std::lock_guard<std::mutex> lock(this->mutex);
+	this->entries[id] = entry;
+	if (entry.hashed)
+		this->byHash[hash] = id;
+	return id;
+}
+
+void TextureRegistry::release(unsigned int id)
+{
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		std::unordered_map<unsigned int, Entry>::iterator entry = this->entries.find(id);
+		if (entry == this->entries.end() || --entry->second.refs > 0)
+			return;
+
+		if (entry->second.hashed)
+			this->byHash.erase(entry->second.hash);
+		this->entries.erase(entry);
+	}
+
+	TextureStreamer::shared().remove(id);
+	GLState::deleteTextures(1, &id);
+}
+
+void TextureRegistry::invalidate(const std::string &filename)
+{
+	std::string canonical = canonicalPath(filename);
+	std::lock_guard<std::mutex> lock(this->mutex);
+	this->identities.erase(canonical);
+}
+
+size_t TextureRegistry::size()
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	return this->entries.size();
+}
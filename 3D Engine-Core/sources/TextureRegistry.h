@@ -0,0 +1,62 @@
+#pragma once
+
+#include "TextureLoader.h"
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Engine wide, reference counted set of the 2D textures loaded from files.
+// Textures are identified by a hash of the file content and their usage, so the same image is decoded and uploaded
+// once even when it is shipped under several paths. Known files skip the hashing when their canonical path,
+// modification time and size did not change. The GL texture is deleted when its last user releases it.
+class TextureRegistry
+{
+public:
+	static TextureRegistry& shared();
+
+	// true if the file is already resident, so decoding it can be skipped. Safe on worker threads.
+	bool contains(const std::string &filename, TextureUsage usage);
+
+	// returns the texture of a file and adds a reference to it. A texture that is not resident is created
+	// from the decoded image when one is given, otherwise the file is prepared here. GL thread only.
+	unsigned int acquire(const std::string &filename, TextureUsage usage, const DecodedImage *decoded = nullptr);
+
+	// drops a reference, deleting the GL texture with the last one. GL thread only.
+	void release(unsigned int id);
+
+	// forgets the stamp of a file that changed, so it is hashed again even if its time and size look the same
+	void invalidate(const std::string &filename);
+
+	// number of resident textures
+	size_t size();
+
+private:
+	TextureRegistry() {}
+	TextureRegistry(const TextureRegistry&) = delete;
+	TextureRegistry& operator=(const TextureRegistry&) = delete;
+
+	struct Identity
+	{
+		int64_t mtime;
+		int64_t size;
+		uint64_t hash;
+	};
+
+	struct Entry
+	{
+		unsigned int refs;
+		bool hashed;
+		uint64_t hash;
+	};
+
+	// content hash of a file combined with its usage, through the canonical path + stamp fast path.
+	// Usages are encoded differently, so they never share a texture.
+	bool identify(const std::string &filename, TextureUsage usage, uint64_t &hash);
+
+	std::mutex mutex;
+	std::unordered_map<std::string, Identity> identities;	// canonical path -> last seen stamp and hash
+	std::unordered_map<uint64_t, unsigned int> byHash;		// content and usage hash -> texture
+	std::unordered_map<unsigned int, Entry> entries;		// texture -> reference count
+};
@@ -0,0 +1,204 @@
+#include "TextureStreamer.h"
+#include "GLState.h"
+
+#include <algorithm>
+#include <cmath>
+
+bool TextureStreamer::enabled = true;
+
+TextureStreamer& TextureStreamer::shared()
+{
+	static TextureStreamer streamer;
+	return streamer;
+}
+
+TextureStreamer::TextureStreamer()
+	: budgetBytes(256u << 20), uploadBytesPerFrame(4u << 20), frame(1), resident(0), pending(0)
+{
+}
+
+size_t TextureStreamer::bytesFrom(const StreamedTexture &texture, int level)
+{
+	size_t bytes = 0;
+	for (size_t i = level; i < texture.image.levels.size(); i++)
+		bytes += texture.image.levels[i].size;
+	return bytes;
+}
+
+unsigned int TextureStreamer::create(const DecodedImage &image)
+{
+	StreamedTexture texture;
+	texture.image = image;
+	texture.lastRequest = 0;
+	texture.pixelsPerUv = 0.0f;
+
+	// the largest level not above INITIAL_SIZE, or the smallest one
+	const int last = static_cast<int>(image.levels.size()) - 1;
+	int base = 0;
+	while (base < last && std::max(image.levels[base].width, image.levels[base].height) > INITIAL_SIZE)
+		base++;
+	texture.baseLevel = texture.minimumLevel = texture.requestedLevel = texture.targetLevel = base;
+
+	unsigned int id;
+	glGenTextures(1, &id);
+	GLState::bindTexture(GL_TEXTURE_2D, id);
+	for (int level = base; level <= last; level++)
+		TextureLoader::uploadLevel(GL_TEXTURE_2D, image, level);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, base);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, last);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	this->resident += bytesFrom(texture, base);
+	this->textures[id] = texture;
+	return id;
+}
+
+void TextureStreamer::remove(unsigned int id)
+{
+	std::unordered_map<unsigned int, StreamedTexture>::iterator texture = this->textures.find(id);
+	if (texture == this->textures.end())
+		return;
+
+	this->resident -= bytesFrom(texture->second, texture->second.baseLevel);
+	this->textures.erase(texture);
+}
+
+void TextureStreamer::request(unsigned int id, float pixelsPerUv)
+{
+	std::unordered_map<unsigned int, StreamedTexture>::iterator found = this->textures.find(id);
+	if (found == this->textures.end() || pixelsPerUv <= 0.0f)
+		return;
+	StreamedTexture &texture = found->second;
+
+	// one texel per pixel: the level whose size matches the pixels one texture repeat covers
+	float texels = static_cast<float>(std::max(texture.image.width, texture.image.height));
+	int level = static_cast<int>(std::floor(std::log2(std::max(texels / pixelsPerUv, 1.0f))));
+	level = std::min(level, texture.minimumLevel);
+
+	// the closest mesh using the texture decides
+	if (texture.lastRequest != this->frame || level < texture.requestedLevel)
+		texture.requestedLevel = level;
+	if (texture.lastRequest != this->frame || pixelsPerUv > texture.pixelsPerUv)
+		texture.pixelsPerUv = pixelsPerUv;
+	texture.lastRequest = this->frame;
+}
+
+void TextureStreamer::setBaseLevel(unsigned int id, StreamedTexture &texture, int level)
+{
+	GLState::bindTexture(GL_TEXTURE_2D, id);
+	if (level < texture.baseLevel)
+	{
+		for (int i = texture.baseLevel - 1; i >= level; i--)
+		{
+			TextureLoader::uploadLevel(GL_TEXTURE_2D, texture.image, i);
+			this->resident += texture.image.levels[i].size;
+		}
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+	}
+	else
+	{
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+		// levels below the base are ignored for completeness, redefining them empty frees their storage
+		for (int i = texture.baseLevel; i < level; i++)
+		{
+			glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+			this->resident -= texture.image.levels[i].size;
+		}
+	}
+	texture.baseLevel = level;
+}
+
+void TextureStreamer::update()
+{
+	// what the textures drawn this frame ask for, the others keep what they have
+	size_t total = 0;
+	std::vector<std::pair<unsigned int, StreamedTexture*>> all;
+	all.reserve(this->textures.size());
+	for (std::unordered_map<unsigned int, StreamedTexture>::iterator it = this->textures.begin(); it != this->textures.end(); ++it)
+	{
+		StreamedTexture &texture = it->second;
+		texture.targetLevel = texture.lastRequest == this->frame ? std::min(texture.requestedLevel, texture.baseLevel) : texture.baseLevel;
+		total += bytesFrom(texture, texture.targetLevel);
+		all.push_back(std::make_pair(it->first, &texture));
+	}
+
+	if (total > this->budgetBytes)
+	{
+		// drops the top target level of a texture, false when it is down to its minimum
+		unsigned long long currentFrame = this->frame;
+		auto drop = [&total](StreamedTexture &texture) -> bool
+		{
+			if (texture.targetLevel >= texture.minimumLevel)
+				return false;
+			total -= texture.image.levels[texture.targetLevel].size;
+			texture.targetLevel++;
+			return true;
+		};
+
+		// 1. levels sharper than the screen needs
+		for (size_t i = 0; i < all.size() && total > this->budgetBytes; i++)
+		{
+			StreamedTexture &texture = *all[i].second;
+			while (total > this->budgetBytes && texture.lastRequest == currentFrame && texture.targetLevel < texture.requestedLevel)
+				drop(texture);
+		}
+
+		// 2. textures not drawn this frame, the longest unseen first
+		std::sort(all.begin(), all.end(), [](const std::pair<unsigned int, StreamedTexture*> &a, const std::pair<unsigned int, StreamedTexture*> &b)
+		{
+			return a.second->lastRequest < b.second->lastRequest;
+		});
+		for (size_t i = 0; i < all.size() && total > this->budgetBytes && all[i].second->lastRequest != currentFrame; i++)
+			while (total > this->budgetBytes && drop(*all[i].second));
+
+		// 3. visible textures a level at a time, those covering the fewest pixels first
+		std::sort(all.begin(), all.end(), [](const std::pair<unsigned int, StreamedTexture*> &a, const std::pair<unsigned int, StreamedTexture*> &b)
+		{
+			return a.second->pixelsPerUv < b.second->pixelsPerUv;
+		});
+		for (bool dropped = true; dropped && total > this->budgetBytes;)
+		{
+			dropped = false;
+			for (size_t i = 0; i < all.size() && total > this->budgetBytes; i++)
+				dropped = drop(*all[i].second) || dropped;
+		}
+	}
+
+	// frees take effect at once, uploads go a level at a time with the closest textures first
+	std::vector<std::pair<unsigned int, StreamedTexture*>> uploads;
+	for (size_t i = 0; i < all.size(); i++)
+	{
+		StreamedTexture &texture = *all[i].second;
+		if (texture.targetLevel > texture.baseLevel)
+			setBaseLevel(all[i].first, texture, texture.targetLevel);
+		else if (texture.targetLevel < texture.baseLevel)
+			uploads.push_back(all[i]);
+	}
+	std::sort(uploads.begin(), uploads.end(), [](const std::pair<unsigned int, StreamedTexture*> &a, const std::pair<unsigned int, StreamedTexture*> &b)
+	{
+		return a.second->pixelsPerUv > b.second->pixelsPerUv;
+	});
+
+	size_t uploaded = 0;
+	this->pending = 0;
+	for (size_t i = 0; i < uploads.size(); i++)
+	{
+		StreamedTexture &texture = *uploads[i].second;
+		size_t bytes = texture.image.levels[texture.baseLevel - 1].size;
+		if (uploaded > 0 && uploaded + bytes > this->uploadBytesPerFrame)
+		{
+			this->pending++;
+			continue;
+		}
+		setBaseLevel(uploads[i].first, texture, texture.baseLevel - 1);
+		uploaded += bytes;
+		if (texture.targetLevel < texture.baseLevel)
+			this->pending++;
+	}
+
+	this->frame++;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "TextureLoader.h"
+
+#include <unordered_map>
+#include <vector>
+
+// Mip level residency of the cooked 2D textures. A texture starts with only its small levels uploaded and
+// GL_TEXTURE_BASE_LEVEL pointing at the largest of them. Every frame the visible meshes request the level
+// their projected texel density needs, and update() uploads missing levels one at a time within a per frame
+// upload budget. When the resident levels exceed the memory budget the top levels are dropped again, first
+// where they are sharper than needed, then from textures that went off-screen, then from the most distant ones.
+// GL thread only.
+class TextureStreamer
+{
+public:
+	static TextureStreamer& shared();
+
+	// stream the textures created from now on, otherwise they are uploaded whole
+	static bool enabled;
+
+	// largest level uploaded when a texture is created
+	static const int INITIAL_SIZE = 64;
+
+	// bytes all streamed levels may use together
+	size_t budgetBytes;
+	// bytes uploaded per update at most, a single level larger than this still goes up alone
+	size_t uploadBytesPerFrame;
+
+	// creates a texture with the small levels of a cooked image and keeps the image to stream the rest
+	unsigned int create(const DecodedImage &image);
+
+	// forgets a texture before it is deleted
+	void remove(unsigned int id);
+
+	// the texture is drawn this frame with pixelsPerUv screen pixels per unit of texture coordinates
+	void request(unsigned int id, float pixelsPerUv);
+
+	// applies the requests of this frame: drops levels over the budget and uploads wanted ones
+	void update();
+
+	bool streams(unsigned int id) const { return this->textures.count(id) != 0; }
+	size_t residentBytes() const { return this->resident; }
+	// textures still below the level they want
+	unsigned int pendingTextures() const { return this->pending; }
+	size_t size() const { return this->textures.size(); }
+
+private:
+	TextureStreamer();
+	TextureStreamer(const TextureStreamer&) = delete;
+	TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+	struct StreamedTexture
+	{
+		DecodedImage image;
+		// largest uploaded level, the base level of the texture
+		int baseLevel;
+		// largest level kept however little memory is left
+		int minimumLevel;
+		// level asked for by the requests of the last frame they came in
+		int requestedLevel;
+		unsigned long long lastRequest;
+		// level wanted after the budget is applied
+		int targetLevel;
+		float pixelsPerUv;
+	};
+
+	// bytes of levels [level, last] of a texture
+	static size_t bytesFrom(const StreamedTexture &texture, int level);
+	// makes level the base level, uploading or freeing the levels between
+	void setBaseLevel(unsigned int id, StreamedTexture &texture, int level);
+
+	std::unordered_map<unsigned int, StreamedTexture> textures;
+	unsigned long long frame;
+	size_t resident;
+	unsigned int pending;
+};
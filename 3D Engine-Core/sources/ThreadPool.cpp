@@ -0,0 +1,117 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+	: stopping(false)
+{
+	if (threadCount == 0)
+	{
+		unsigned int hardware = std::thread::hardware_concurrency();
+		threadCount = hardware > 1 ? hardware - 1 : 1;
+	}
+
+	for (unsigned int i = 0; i < threadCount; i++)
+		this->workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stopping = true;
+	}
+	this->wake.notify_all();
+
+	for (std::thread& worker : this->workers)
+		worker.join();
+}
+
+void ThreadPool::enqueue(std::function<void()> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->jobs.push(std::move(job));
+	}
+	this->wake.notify_one();
+}
+
+void ThreadPool::workerLoop()
+{
+	for (;;)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->wake.wait(lock, [this]() { return this->stopping || !this->jobs.empty(); });
+			if (this->stopping && this->jobs.empty())
+				return;
+
+			job = std::move(this->jobs.front());
+			this->jobs.pop();
+		}
+		job();
+	}
+}
+
+// shared between the caller of parallelFor and its helper jobs, helpers may start after the loop is over
+struct ParallelForState
+{
+	std::function<void(size_t)> body;
+	size_t count;
+	std::atomic<size_t> next;
+	std::atomic<size_t> done;
+	std::mutex mutex;
+	std::condition_variable finished;
+
+	void run()
+	{
+		size_t completed = 0;
+		for (size_t i = next++; i < count; i = next++)
+		{
+			body(i);
+			completed++;
+		}
+
+		if (completed > 0 && (done += completed) == count)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			finished.notify_all();
+		}
+	}
+};
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& body)
+{
+	if (count == 0)
+		return;
+
+	if (count == 1 || this->workers.empty())
+	{
+		for (size_t i = 0; i < count; i++)
+			body(i);
+		return;
+	}
+
+	std::shared_ptr<ParallelForState> state = std::make_shared<ParallelForState>();
+	state->body = body;
+	state->count = count;
+	state->next = 0;
+	state->done = 0;
+
+	size_t helpers = std::min(count - 1, this->workers.size());
+	for (size_t i = 0; i < helpers; i++)
+		enqueue([state]() { state->run(); });
+
+	state->run();
+
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->finished.wait(lock, [&state]() { return state->done == state->count; });
+}
+
+ThreadPool& ThreadPool::shared()
+{
+	static ThreadPool pool;
+	return pool;
+}
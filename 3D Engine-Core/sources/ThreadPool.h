@@ -0,0 +1,53 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads executing queued jobs. Only CPU work goes through the pool,
+// GL calls must stay on the thread owning the context.
+class ThreadPool
+{
+public:
+	// threadCount 0 uses one worker per hardware thread minus the calling thread
+	explicit ThreadPool(unsigned int threadCount = 0);
+	~ThreadPool();
+
+	// queues a job and returns a future for its result
+	template<class F>
+	std::future<typename std::result_of<F()>::type> submit(F job)
+	{
+		typedef typename std::result_of<F()>::type Result;
+		std::shared_ptr<std::packaged_task<Result()>> task = std::make_shared<std::packaged_task<Result()>>(job);
+		std::future<Result> result = task->get_future();
+		enqueue([task]() { (*task)(); });
+		return result;
+	}
+
+	// runs body(i) for every i in [0, count) on the workers and the calling thread, returns when all are done.
+	// Safe to call from inside a job: the caller keeps taking items itself, so it never waits on a busy pool.
+	void parallelFor(size_t count, const std::function<void(size_t)>& body);
+
+	unsigned int size() const { return static_cast<unsigned int>(this->workers.size()); }
+
+	// pool shared by the engine subsystems
+	static ThreadPool& shared();
+
+private:
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	void enqueue(std::function<void()> job);
+	void workerLoop();
+
+	std::vector<std::thread> workers;
+	std::queue<std::function<void()>> jobs;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping;
+};
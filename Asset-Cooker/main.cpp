@@ -0,0 +1,67 @@
+#include "sources/AssetCooker.h"
+#include "GLExtensions.h"
+#include "Model.h"
+#include "TextureLoader.h"
+
+#include <cstring>
+#include <iostream>
+
+static void printUsage()
+{
+	std::cout << "usage: Asset-Cooker <directory> [options]\n"
+		<< "  --force         cook everything again, ignoring the database and the caches\n"
+		<< "  --no-optimize   skip the vertex cache, overdraw and vertex fetch optimization\n"
+		<< "  --no-lods       skip the levels of detail\n"
+		<< "  --no-clusters   skip the cluster split\n"
+		<< "  --assimp-obj    read .obj files with ASSIMP instead of the ObjLoader\n"
+		<< "  --no-compress   keep textures uncompressed\n"
+		<< "  --no-bptc       target GPUs without BC7, alpha textures become BC3\n"
+		<< "  --no-s3tc       target GPUs without BC1 and BC3" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2 || argv[1][0] == '-')
+	{
+		printUsage();
+		return 1;
+	}
+
+	// the engine defaults, on a GPU with the desktop compressed formats.
+	// The engine only hits the cooked caches when it runs with the same settings.
+	GLExtensions::textureCompressionS3TC = true;
+	GLExtensions::textureCompressionBPTC = true;
+	bool force = false;
+	for (int i = 2; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], "--force") == 0)
+			force = true;
+		else if (std::strcmp(argv[i], "--no-optimize") == 0)
+			Model::optimizeMeshes = false;
+		else if (std::strcmp(argv[i], "--no-lods") == 0)
+			Model::generateLods = false;
+		else if (std::strcmp(argv[i], "--no-clusters") == 0)
+			Model::buildClusters = false;
+		else if (std::strcmp(argv[i], "--assimp-obj") == 0)
+			Model::useObjLoader = false;
+		else if (std::strcmp(argv[i], "--no-compress") == 0)
+			TextureLoader::compressTextures = false;
+		else if (std::strcmp(argv[i], "--no-bptc") == 0)
+			GLExtensions::textureCompressionBPTC = false;
+		else if (std::strcmp(argv[i], "--no-s3tc") == 0)
+			GLExtensions::textureCompressionS3TC = false;
+		else
+		{
+			std::cout << "ERROR::COOKER:: unknown option " << argv[i] << std::endl;
+			printUsage();
+			return 1;
+		}
+	}
+
+	std::string directory = argv[1];
+	while (directory.size() > 1 && (directory.back() == '/' || directory.back() == '\\'))
+		directory.pop_back();
+
+	AssetCooker cooker(directory);
+	return cooker.run(force) == 0 ? 0 : 2;
+}
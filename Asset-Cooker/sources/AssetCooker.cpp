@@ -0,0 +1,164 @@
+#include "AssetCooker.h"
+#include "FileUtils.h"
+#include "MeshCache.h"
+#include "Model.h"
+#include "ObjLoader.h"
+#include "TextureCache.h"
+#include "ThreadPool.h"
+
+#include <assimp/Importer.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <set>
+
+AssetCooker::AssetCooker(const std::string &directory)
+	: directory(directory), cooked(0), skipped(0), failed(0)
+{
+}
+
+std::string AssetCooker::databasePath(const std::string &directory)
+{
+	return directory + "/cook.db";
+}
+
+// mesh caches only match the import settings and the cache version they were written with
+static uint64_t meshSettings(const std::string &path)
+{
+	return (static_cast<uint64_t>(MeshCache::VERSION) << 32) | Model::importKey(path);
+}
+
+static uint64_t textureSettings()
+{
+	return (static_cast<uint64_t>(TextureCache::VERSION) << 32) | TextureCache::settingsKey();
+}
+
+void AssetCooker::cookModel(const std::string &path, bool force)
+{
+	const std::string output = MeshCache::cachePath(path);
+	if (!force && this->database.upToDate(output, meshSettings(path)))
+	{
+		this->skipped++;
+		return;
+	}
+
+	// the inputs are hashed before the import, so a file saved during it is cooked again next time
+	CookDatabase::Output entry;
+	entry.settings = meshSettings(path);
+	vector<std::string> inputs(1, path);
+	vector<std::string> libraries = ObjLoader::materialLibraries(path);
+	inputs.insert(inputs.end(), libraries.begin(), libraries.end());
+	for (size_t i = 0; i < inputs.size(); i++)
+	{
+		CookDatabase::Input input = { inputs[i], 0 };
+		this->database.hash(inputs[i], input.hash);
+		entry.inputs.push_back(input);
+	}
+
+	if (force)
+		std::remove(output.c_str());
+
+	vector<MeshData> meshData;
+	if (!Model::importMeshData(path, meshData))
+	{
+		std::cout << "ERROR::COOKER:: could not import " << path << std::endl;
+		this->failed++;
+		return;
+	}
+
+	const std::string modelDirectory = path.substr(0, path.find_last_of('/'));
+	map<string, TextureUsage> textures = Model::referencedTextures(meshData, modelDirectory, false);
+	for (map<string, TextureUsage>::const_iterator it = textures.begin(); it != textures.end(); ++it)
+		entry.textures.push_back(std::make_pair(modelDirectory + '/' + it->first, it->second));
+
+	this->database.record(output, entry);
+	this->cooked++;
+	std::cout << "COOKER:: " << output << std::endl;
+}
+
+void AssetCooker::cookTexture(const std::string &path, TextureUsage usage, bool force)
+{
+	const std::string output = TextureCache::cachePath(path, usage);
+	if (!force && this->database.upToDate(output, textureSettings()))
+	{
+		this->skipped++;
+		return;
+	}
+
+	CookDatabase::Output entry;
+	entry.settings = textureSettings();
+	CookDatabase::Input input = { path, 0 };
+	this->database.hash(path, input.hash);
+	entry.inputs.push_back(input);
+
+	if (force)
+		std::remove(output.c_str());
+
+	// prepare stores the cooked chain in the cache as the engine would on a cold load
+	DecodedImage image = TextureLoader::prepare(path, usage);
+	int64_t mtime, size;
+	if (!image.valid() || !fileStamp(output, mtime, size))
+	{
+		std::cout << "ERROR::COOKER:: could not cook " << path << std::endl;
+		this->failed++;
+		return;
+	}
+
+	this->database.record(output, entry);
+	this->cooked++;
+	std::cout << "COOKER:: " << output << std::endl;
+}
+
+int AssetCooker::run(bool force)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	const std::string database = databasePath(this->directory);
+	if (!force)
+		this->database.load(database);
+
+	vector<std::string> files;
+	if (!listFiles(this->directory, files))
+	{
+		std::cout << "ERROR::COOKER:: cannot read " << this->directory << std::endl;
+		return 1;
+	}
+
+	// every file ASSIMP or the ObjLoader can read is a model, the textures are found through their materials
+	vector<std::string> models;
+	Assimp::Importer importer;
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		size_t dot = files[i].find_last_of('.');
+		if (dot != std::string::npos && files[i].find('/', dot) == std::string::npos && importer.IsExtensionSupported(files[i].substr(dot)))
+			models.push_back(files[i]);
+	}
+
+	ThreadPool::shared().parallelFor(models.size(), [&](size_t i) { this->cookModel(models[i], force); });
+
+	// textures of all models, each cooked once per usage
+	std::set<std::string> outputs;
+	std::set<std::pair<std::string, TextureUsage>> textureSet;
+	for (size_t i = 0; i < models.size(); i++)
+	{
+		CookDatabase::Output entry;
+		if (!this->database.find(MeshCache::cachePath(models[i]), entry))
+			continue;
+		outputs.insert(MeshCache::cachePath(models[i]));
+		textureSet.insert(entry.textures.begin(), entry.textures.end());
+	}
+	vector<std::pair<std::string, TextureUsage>> textures(textureSet.begin(), textureSet.end());
+	ThreadPool::shared().parallelFor(textures.size(), [&](size_t i) { this->cookTexture(textures[i].first, textures[i].second, force); });
+	for (size_t i = 0; i < textures.size(); i++)
+		outputs.insert(TextureCache::cachePath(textures[i].first, textures[i].second));
+
+	// outputs of deleted models are forgotten, not deleted
+	this->database.retain(outputs);
+	if (!this->database.save(database))
+		std::cout << "WARNING::COOKER:: could not write " << database << std::endl;
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	std::cout << "COOKER:: " << models.size() << " models, " << textures.size() << " textures: " << this->cooked << " cooked, "
+		<< this->skipped << " up to date, " << this->failed << " failed in " << elapsed.count() << " s" << std::endl;
+	return static_cast<int>(this->failed);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "CookDatabase.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+// Cooks the models below a directory into the formats the engine loads at runtime: the optimized meshes with their
+// levels of detail and clusters into mesh caches, and every texture they reference into a KTX2 cache with its
+// compressed mip chain. The caches are written next to their sources, where the engine looks for them, using the
+// import and compression settings currently set on Model, TextureLoader and GLExtensions.
+// Models and then textures are cooked in parallel on the shared ThreadPool.
+class AssetCooker
+{
+public:
+	explicit AssetCooker(const std::string &directory);
+
+	// cooks what changed since the last run, or everything with force. Returns the number of failed outputs.
+	int run(bool force);
+
+	// database file of a cooked directory
+	static std::string databasePath(const std::string &directory);
+
+private:
+	// imports one model into its mesh cache and records the textures it references
+	void cookModel(const std::string &path, bool force);
+	// prepares one texture into its KTX2 cache
+	void cookTexture(const std::string &path, TextureUsage usage, bool force);
+
+	std::string directory;
+	CookDatabase database;
+
+	std::atomic<unsigned int> cooked;
+	std::atomic<unsigned int> skipped;
+	std::atomic<unsigned int> failed;
+};
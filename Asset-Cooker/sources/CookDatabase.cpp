@@ -0,0 +1,182 @@
+#include "CookDatabase.h"
+#include "FileUtils.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+// layout of the database, one record per line with the path last so it may contain blanks:
+//   cookdb <version>
+//   stamp <mtime> <size> <hash> <path>
+//   output <settings> <path>          followed by the inputs and textures of that output
+//   input <hash> <path>
+//   texture <usage> <path>
+// hashes and settings are written in hex
+
+// rest of a record behind its fields, without the separating blank
+static std::string restOfLine(std::istringstream &line)
+{
+	std::string rest;
+	std::getline(line, rest);
+	if (!rest.empty() && rest[0] == ' ')
+		rest.erase(0, 1);
+	return rest;
+}
+
+bool CookDatabase::load(const std::string &path)
+{
+	std::ifstream in(path.c_str());
+	std::string text;
+	int version = 0;
+	if (!std::getline(in, text) || std::sscanf(text.c_str(), "cookdb %d", &version) != 1 || version != VERSION)
+		return false;
+
+	std::lock_guard<std::mutex> lock(this->mutex);
+	Output *current = nullptr;
+	while (std::getline(in, text))
+	{
+		std::istringstream line(text);
+		std::string record;
+		line >> record;
+		if (record == "stamp")
+		{
+			Stamp stamp;
+			line >> stamp.mtime >> stamp.size >> std::hex >> stamp.hash;
+			this->stamps[restOfLine(line)] = stamp;
+		}
+		else if (record == "output")
+		{
+			Output output;
+			line >> std::hex >> output.settings;
+			current = &(this->outputs[restOfLine(line)] = output);
+		}
+		else if (record == "input" && current)
+		{
+			Input input;
+			line >> std::hex >> input.hash;
+			input.path = restOfLine(line);
+			current->inputs.push_back(input);
+		}
+		else if (record == "texture" && current)
+		{
+			int usage;
+			line >> usage;
+			current->textures.push_back(std::make_pair(restOfLine(line), static_cast<TextureUsage>(usage)));
+		}
+	}
+	return true;
+}
+
+bool CookDatabase::save(const std::string &path)
+{
+	// written next to the old one and renamed over it, so an interrupted run keeps the last database
+	std::string tempPath = path + ".tmp";
+	{
+		std::ofstream out(tempPath.c_str(), std::ios::trunc);
+		if (!out)
+			return false;
+
+		std::lock_guard<std::mutex> lock(this->mutex);
+		out << "cookdb " << VERSION << "\n";
+		for (std::map<std::string, Stamp>::const_iterator it = this->stamps.begin(); it != this->stamps.end(); ++it)
+			out << "stamp " << it->second.mtime << " " << it->second.size << " " << std::hex << it->second.hash << std::dec << " " << it->first << "\n";
+		for (std::map<std::string, Output>::const_iterator it = this->outputs.begin(); it != this->outputs.end(); ++it)
+		{
+			out << "output " << std::hex << it->second.settings << std::dec << " " << it->first << "\n";
+			for (size_t i = 0; i < it->second.inputs.size(); i++)
+				out << "input " << std::hex << it->second.inputs[i].hash << std::dec << " " << it->second.inputs[i].path << "\n";
+			for (size_t i = 0; i < it->second.textures.size(); i++)
+				out << "texture " << it->second.textures[i].second << " " << it->second.textures[i].first << "\n";
+		}
+		if (!out)
+			return false;
+	}
+
+	std::remove(path.c_str());
+	return std::rename(tempPath.c_str(), path.c_str()) == 0;
+}
+
+bool CookDatabase::hash(const std::string &path, uint64_t &hash)
+{
+	int64_t mtime, size;
+	if (!fileStamp(path, mtime, size))
+		return false;
+
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		std::map<std::string, Stamp>::const_iterator known = this->stamps.find(path);
+		if (known != this->stamps.end() && known->second.mtime == mtime && known->second.size == size)
+		{
+			hash = known->second.hash;
+			return true;
+		}
+	}
+
+	// new or touched file, hash it outside the lock
+	if (!hashFile(path, hash))
+		return false;
+
+	Stamp stamp = { mtime, size, hash };
+	std::lock_guard<std::mutex> lock(this->mutex);
+	this->stamps[path] = stamp;
+	return true;
+}
+
+bool CookDatabase::upToDate(const std::string &output, uint64_t settings)
+{
+	Output entry;
+	int64_t mtime, size;
+	if (!find(output, entry) || entry.settings != settings || !fileStamp(output, mtime, size))
+		return false;
+
+	for (size_t i = 0; i < entry.inputs.size(); i++)
+	{
+		// a missing input was recorded with hash 0 and is fine as long as it stays missing
+		uint64_t current = 0;
+		hash(entry.inputs[i].path, current);
+		if (current != entry.inputs[i].hash)
+			return false;
+	}
+	return true;
+}
+
+bool CookDatabase::find(const std::string &output, Output &entry)
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	std::map<std::string, Output>::const_iterator found = this->outputs.find(output);
+	if (found == this->outputs.end())
+		return false;
+	entry = found->second;
+	return true;
+}
+
+void CookDatabase::record(const std::string &output, const Output &entry)
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	this->outputs[output] = entry;
+}
+
+void CookDatabase::retain(const std::set<std::string> &outputs)
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	std::set<std::string> inputs;
+	for (std::map<std::string, Output>::iterator it = this->outputs.begin(); it != this->outputs.end();)
+	{
+		if (!outputs.count(it->first))
+		{
+			it = this->outputs.erase(it);
+			continue;
+		}
+		for (size_t i = 0; i < it->second.inputs.size(); i++)
+			inputs.insert(it->second.inputs[i].path);
+		++it;
+	}
+
+	for (std::map<std::string, Stamp>::iterator it = this->stamps.begin(); it != this->stamps.end();)
+	{
+		if (inputs.count(it->first))
+			++it;
+		else
+			it = this->stamps.erase(it);
+	}
+}
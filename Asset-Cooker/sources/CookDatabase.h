@@ -0,0 +1,67 @@
+#pragma once
+
+#include "TextureLoader.h"
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+// What the last cook produced, kept as a text file in the cooked directory. Every output records the settings it
+// was cooked with and the content hash of each file it was cooked from, so a later run only cooks the outputs
+// whose inputs or settings changed. The stamp (modification time and size) of every hashed file is kept too,
+// so files untouched since the last run are not read again. Safe to use from the worker threads.
+class CookDatabase
+{
+public:
+	struct Input
+	{
+		std::string path;
+		uint64_t hash;
+	};
+
+	struct Output
+	{
+		uint64_t settings;
+		std::vector<Input> inputs;
+		// textures a model references with their usage, so an up to date model needs no parsing
+		std::vector<std::pair<std::string, TextureUsage>> textures;
+	};
+
+	// reads the database of an earlier run, returns false if there is none or it is from another version
+	bool load(const std::string &path);
+
+	// writes the database, returns false if the file cannot be written
+	bool save(const std::string &path);
+
+	// content hash of a file, taken from the last run when its stamp did not change
+	bool hash(const std::string &path, uint64_t &hash);
+
+	// true if output exists and was cooked with settings from inputs that still have the recorded content
+	bool upToDate(const std::string &output, uint64_t settings);
+
+	// recorded entry of an output, false if there is none
+	bool find(const std::string &output, Output &entry);
+
+	void record(const std::string &output, const Output &entry);
+
+	// drops the outputs not in outputs and the stamps of files no output reads anymore
+	void retain(const std::set<std::string> &outputs);
+
+private:
+	static const int VERSION = 1;
+
+	struct Stamp
+	{
+		int64_t mtime;
+		int64_t size;
+		uint64_t hash;
+	};
+
+	std::mutex mutex;
+	std::map<std::string, Stamp> stamps;
+	std::map<std::string, Output> outputs;
+};